@@ -3,471 +3,2029 @@ REST API 서버 구축을 위해 불특정 다수의 HTTP Request들을 패킷
 적절히 Parsing 할 수 있는 기반을 마련하는 것을 목표로 한다.
 
 [소켓 관련 처리] : 동시 다발적인 요청을 처리하기 위해서는 Queue가 필요하다.
-1. FD_SET을 통해 HTTP Client들을 Map에 넣고 Queue를 통해 작업들을 생성한다.
+1. Poller(Linux: epoll, 그 외: select)로 HTTP Client들을 감시하고 연결 테이블(ConnTable)에 넣은 뒤 Queue를 통해 작업들을 생성한다.
+    연결은 slot 번호와 generation 을 합친 handle 로 가리키므로, 닫힌 뒤 재사용된 slot 을 예전 handle 로 건드릴 수 없다.
+    Queue 는 Scheduler(scheduler.h)이며, 기본은 worker 별 lock-free 큐와 work stealing 이다. (--scheduler)
+    listener 는 non-blocking 이고, readiness 이벤트 한 번에 쌓여 있는 연결들을 accept 할 수 있는 만큼(ACCEPT_BATCH) 받는다.
+    주소, 포트, backlog, 소켓 옵션(TCP_NODELAY, TCP_DEFER_ACCEPT, TCP_FASTOPEN, 버퍼 크기 등)은 config 로 정한다. (--bind, --port ...)
 2. REST API Request를 처리하는 스레드를 여러개 만들고 Queue에 있는 작업들을 아래와 같이 처리한다.
+3. --mode sharded 인 경우에는 Queue 를 쓰지 않는다. 쓰레드(shard)마다 자기 listener(SO_REUSEPORT),
+    poller, 연결 목록을 가지고, 연결 하나는 처음 accept 한 shard 가 끝날 때까지 혼자 처리한다.
+4. --io-engine uring 이면 shard 들이 poller 대신 io_uring(uring.h)을 쓴다. listener 에는 multishot accept,
+    연결에는 multishot recv 를 한 번 걸어두면 커널이 provided buffer 에 받아서 completion 으로 알려준다.
+    send 도 ring 에 쌓아두었다가 completion 을 기다리는 syscall 한 번에 같이 제출하므로 request 당 syscall 이 1 보다 적다.
+    io_uring 을 쓸 수 없는 커널(6.0 미만, seccomp 로 막힌 경우 등)이면 경고를 남기고 poller 로 돈다.
 
 [Request 수신 순서] : Request Packet이 쪼개져서 올 수도 있다. 그리고 Body 부분 Packet은 HTTP 헤더 정보를 기반으로 필요한 만큼 수신해야 한다.
-1. CRLF(\r\n)을 연속 2번 받을 때까지 offset을 이용하여 "1바이트씩" recv 한다.
-    CRLF가 나올 때마다 헤더 종류를 체크한 후 다음 헤더 값들을 잘 저장한다. (저장한 후 buffer는 다시 초기화 해도 된다.)
+1. 버퍼의 남은 공간만큼 한 번에 recv 하고 뒤에 이어 붙인다.
+    버퍼(ConnBuffer)는 BufferPool 에서 빌려오며 --max-buffer 까지 필요한 만큼 커지고, 비면 pool 에 돌려준다.
+2. HttpParser(http_parser.h)가 지난번에 멈춘 곳부터 이어서 파싱한다. 요청이 어느 바이트에서 쪼개져 와도 된다.
+    파싱 결과는 버퍼를 가리키는 string_view 로 얻는다.
         Request 종류 (이건 무조건 첫 줄)
         Content-Type
         Content-Length
-        (목적에 따라 추가적으로 저장할 수 있다.)
-3. Content-Length만큼 offset을 이용하여 recv 한다.
-
-[Body 파싱 후 처리 순서 -> JSON 기준]
-1. 만약 Content-Type이 application/json이라면, Body를 JSON으로 Parsing한다.
+        (목적에 따라 추가적으로 찾아볼 수 있다.)
+3. Content-Length만큼(chunked 인 경우 마지막 chunk 까지) body 가 모이면 request 하나가 완성된다.
+    버퍼에 남은 바이트는 다음 request 의 앞부분이다.
+    body 가 버퍼 limit 안에 다 들어오지 않으면 handleBodyChunk() 로 조각조각 넘기고 버퍼에서 지운다.
+    Content-Length 가 --max-body 보다 크면 body 를 받기 전에 413 으로 거절한다.
+4. 한 번 recv 한 버퍼에 완성된 request 가 여러 개 있으면(pipelining) 모두 처리하고,
+    response 들은 순서대로 연결의 출력 큐(ResponseBatch)에 모아서 한 번의 gathered write(writev/WSASend)로 보낸다.
+    request 가 Connection: close 이거나 keep-alive 없는 HTTP/1.0 이면 그 response 까지 보내고 연결을 닫는다.
+5. active socket 은 non-blocking 이다. 소켓 송신 버퍼가 가득 차면 나머지는 출력 큐에 남겨두고 POLL_WRITE 로 rearm 해서
+    writable 해질 때 마저 보낸다. 따라서 worker 가 느린 상대 때문에 멈추는 일은 없다.
+    출력 큐가 --send-high 이상 쌓이면 그 연결에서는 더 읽지 않고, --send-low 이하로 줄면 다시 읽는다.
+6. 연결마다 timeout 이 있다. (--idle-timeout, --header-timeout, --body-timeout, --send-timeout)
+    헤더나 body 를 받다가 멈춘 연결(slowloris 등)에는 408 을 보내고 닫고, 놀거나 response 를 읽어가지 않는 연결은 그냥 닫는다.
+    타이머는 연결 안에 넣어둔 노드를 계층형 timing wheel(timer_wheel.h)에 거는 것이라 할당이 없고,
+    기한은 처리할 때마다 적어두기만 했다가 타이머가 만료될 때 확인하므로 request 마다 타이머를 옮기지 않는다.
+
+[Request 처리] : Router(router.h)가 method 와 경로로 handler 를 찾는다. 경로들은 시작할 때 registerRoutes() 에서 등록한다.
+    경로가 없으면 404, method 가 다르면 405(Allow 헤더 포함)를 자동으로 보낸다.
+    --static-root 를 주면 그 아래의 파일들을 --static-prefix 경로로 보여준다. (static_files.h)
+    파일은 처음 요청될 때 mmap 해서 캐시하고, body 는 매핑을 출력 큐에 참조로 넣어 다른 response 들과 같은 writev 로 보낸다.
+    ETag/Last-Modified 로 304 를, Range 로 206 을 보낸다.
+    --cache-size 를 주면 cachedRoute() 로 등록한 GET route 의 응답을 직렬화된 그대로 캐시해두고 (response_cache.h)
+    TTL 동안은 handler 없이 캐시된 바이트를 참조로 보낸다. If-None-Match 가 맞으면 304 를 보낸다.
+
+[로그와 metrics]
+    로그는 logger.h 의 LOG_* 매크로로 남긴다. 쓰레드별 ring 에 넣기만 하고 파일 쓰기는 background 쓰레드가 한다. (--log-level, --access-log)
+    --metrics 를 주면 쓰레드별 counter 와 단계별(job queue 대기, 헤더 파싱, body 수신, handler, send) 지연 시간 히스토그램을 모으고
+    GET /metrics 에서 합쳐서 보여준다. 꺼져 있으면 계측 지점마다 flag 하나만 확인한다. (metrics.h)
+
+[Body 파싱 후 처리 순서 -> JSON 기준] (POST /command, handleCommand())
+1. 만약 Content-Type이 application/json이라면, Body를 JSON으로 Parsing한다. (json.h, 복사 없이 버퍼 위에서 파싱)
 2. command와 userName을 알아내고 나머지 인수들을 받는다. (login command 없이 로그인 과정을 거치도록 한다)
+    처음 보는 userName 이면 user store(user_store.h)에 세션을 만들고, 이후 command 들은 그 세션의 상태를 고친다.
+    세션은 마지막 command 뒤 --session-ttl 이 지나면 만료된다. GET /users/{name} 은 세션의 상태를 보여준다.
 3. command별로 기존과 동일하게 처리한다.
 4. 다음과 같이 Response를 작성하고 send 한다.
     A. 만약 Request 종류나 Content-Type이 예상과 다른 경우
-        에러 코드를 잘 포장해서 전송
+        에러 코드를 잘 포장해서 전송 (Content-Type 이 다르면 415, JSON 이 잘못되었으면 400. body 는 {"error": ...})
     B. 잘 받은 경우
-        포멧 텍스트 : "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nContent-Type: application/json\r\n\r\n%s"
-        arg1 : 최종 json 문자열의 length
-        arg2 : 최종 json 문자열
+        appendJsonResponse() 가 헤더와 JSON 을 ResponseBatch 의 버퍼에 바로 쓴다.
+        Content-Length 는 자리만 비워두었다가 JSON 을 다 쓴 뒤에 채운다.
 */
 
 #include <chrono>
-#include <condition_variable>
-#include <iostream>
 #include <list>
-#include <map>
+#include "buffer_pool.h"
+#include "config.h"
+#include "conn_table.h"
+#include "http_parser.h"
+#include "json.h"
+#include "logger.h"
+#include "metrics.h"
+#include "overload.h"
+#include "platform.h"
+#include "poller.h"
+#include "response_batch.h"
+#include "response_cache.h"
+#include "router.h"
+#include "scheduler.h"
+#include "static_files.h"
+#include "timer_wheel.h"
+#include "uring.h"
+#include "user_store.h"
 #include <mutex>
-#include "mylib.h"
-#include <queue>
 #include <thread>
+#include <vector>
 
-#include <WinSock2.h>
-#include <WS2tcpip.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace std;
 
-// ws2_32.lib 를 링크한다.
-#pragma comment(lib, "Ws2_32.lib")
+// recv 하기 전에 버퍼에 확보할 최소 여유 공간
+static const size_t MIN_RECV_SPACE = 2048;
+
+// timeout 타이머의 정밀도. poller 는 타이머가 걸려 있으면 최대 이만큼만 기다린다.
+static const uint64_t TIMER_TICK_MS = 100;
+
+// CoDel 이 job queue 대기 시간의 최소값을 보는 구간 (--codel-target)
+static const uint64_t CODEL_INTERVAL_MS = 100;
+
+// accept 가 fd 부족 등으로 실패했을 때 listener 를 쉬게 하는 시간
+static const uint64_t ACCEPT_BACKOFF_MS = 100;
 
-static const int NUM_REST_THREADS = 3;
-static const unsigned short REST_SERVER_PORT = 27016;
-static const char* REST_SERVER_ADDRESS = "127.0.0.1";
-static const int BUFFER_SIZE = 8192;
+// listener 의 readiness 이벤트 한 번에 accept 하는 최대 연결 수. 남은 연결은 rearm 하면 poller 가 다시 알려준다.
+// 연결이 몰려도 이미 받은 연결들의 이벤트를 너무 오래 미루지 않게 한다.
+static const int ACCEPT_BATCH = 64;
+
+// 명령행 인자로 정해지는 서버 설정
+ServerConfig config;
 
 // 고정된 response 패킷 (Content-Length도 고정)
 // static const string response_packet = "HTTP/1.1 200 OK\r\nContent-Length: 8\r\nContent-Type: text/plain\r\n\r\nResponse";
 
+// 어떤 timeout 에 걸렸는지. header 와 body 는 408 을 보내고 닫는다.
+enum TimeoutKind {
+    TIMEOUT_IDLE,
+    TIMEOUT_HEADER,
+    TIMEOUT_BODY,
+    TIMEOUT_SEND,
+};
+
 class Client {
 public:
     SOCKET sock;  // 이 클라이언트의 active socket
 
-    atomic<bool> doingRecv;
-
-    bool lenCompleted;
-    int packetLen;
-    char packet[BUFFER_SIZE];
-    int offset;
-
-    Client(SOCKET sock) : sock(sock), doingRecv(false), lenCompleted(false), packetLen(0), offset(0) {
+    HttpParser parser;
+    ConnBuffer in;        // 받았지만 아직 처리하지 않은 바이트
+    bool streamingBody;   // 현재 request 의 body 를 조각조각 넘기고 있는지
+
+    ResponseBatch out;    // 아직 보내지 못한 response 들
+    bool readPaused;      // 출력 큐가 high watermark 를 넘어서 읽기를 멈췄는지
+    bool closing;         // 출력 큐를 다 보내면 연결을 닫는다. (오류 응답 이후)
+    bool readReady;       // handoff 모드에서 main 쓰레드가 받은 이벤트가 readable 이었는지
+
+    char peer[64];            // "주소:포트" (로그용)
+
+    // 아래 시각들은 access log 나 metrics 가 켜져 있을 때만 잰다. (metricsNowNs() 기준)
+    uint64_t requestStartNs;  // 지금 받고 있는 request 의 첫 바이트를 받은 시각
+    uint64_t headersDoneNs;   // 그 request 의 헤더를 다 받은 시각
+    uint64_t headerParseNs;   // 그 request 의 헤더를 파싱하는 데 쓴 시간
+    uint64_t queuedNs;        // handoff 모드에서 job queue 에 넣은 시각
+    uint64_t sendStartNs;     // io_uring 에 send 를 넣은 시각
+
+    // timeout. 연결을 처리한 쓰레드가 다음 기한(deadlineMs)을 정해두기만 하고,
+    // 타이머를 돌리는 쓰레드(handoff: main, sharded: shard)는 타이머가 만료될 때 기한을 확인해서
+    // 아직 남았으면 그 시각으로 다시 건다. 그래서 request 마다 타이머를 옮기지 않는다.
+    TimerNode timer;
+    uint64_t deadlineMs;
+    int timeoutKind;          // TimeoutKind
+    uint64_t requestBeginMs;  // 지금 받고 있는 request 의 첫 바이트(첫 request 는 accept)를 받은 시각
+    uint64_t lastRecvMs;      // 마지막으로 바이트를 받은 시각
+    uint64_t lastSendMs;      // 출력 큐가 마지막으로 비어있었거나 줄어든 시각
+    bool servedRequest;       // request 를 하나라도 처리했는지
+
+    // handoff 모드에서 job queue 에 넣은 횟수(main 쓰레드만 쓴다)와 worker 가 처리를 끝낸 횟수.
+    // 둘이 다르면 worker 가 아직 이 연결을 쓰고 있으므로 main 쓰레드는 timeout 으로 닫지 않는다.
+    uint32_t dispatched;
+    atomic<uint32_t> completed;
+
+    // io_uring 엔진에서만 쓴다. out 에 쌓인 response 들은 sending 으로 옮겨서 보내고,
+    // 보내는 동안(sendInFlight) 커널이 sending 의 버퍼를 읽으므로 새 response 는 out 에 쌓는다.
+    // recv 는 multishot 으로 한 번 걸어두면(recvArmed) 바이트가 올 때마다 completion 이 온다.
+    // 두 요청이 모두 끝나야 Client 를 지울 수 있다.
+    ResponseBatch sending;
+    bool recvArmed;
+    bool recvCancelling;      // 읽기를 멈추거나 닫으려고 recv 취소를 넣었다.
+    bool sendInFlight;
+#ifdef HAVE_IO_URING
+    struct msghdr sendMsg;
+#endif
+
+    Client(SOCKET sock, const char* peerName) : sock(sock), in(config.maxBufferBytes), streamingBody(false),
+        readPaused(false), closing(false), readReady(false),
+        requestStartNs(0), headersDoneNs(0), headerParseNs(0), queuedNs(0), sendStartNs(0),
+        servedRequest(false), dispatched(0), completed(0),
+        recvArmed(false), recvCancelling(false), sendInFlight(false) {
+        sprintf_s(peer, sizeof(peer), "%s", peerName);
+        parser.setMaxBodyBytes(config.maxBodyBytes);
+
+        uint64_t now = timerNowMs();
+        requestBeginMs = now;
+        lastRecvMs = now;
+        lastSendMs = now;
+        deadlineMs = now + config.headerTimeoutMs;
+        timeoutKind = TIMEOUT_HEADER;
     }
+};
 
-    ~Client() {
-        cout << "Client destroyed. Socket: " << sock << endl;
-    }
+// 연결들의 timeout 타이머.
+// handoff 모드에서는 main 쓰레드가 타이머를 돌리고 worker 가 연결을 닫을 수 있으므로 lock 으로 보호한다.
+// lock 을 잡는 것은 연결을 만들고 닫을 때와 tick 마다 한 번이다.
+struct ConnTimers {
+    ConnTimers() : wheel(TIMER_TICK_MS, timerNowMs()) {}
+
+    TimerWheel wheel;
+    mutex lock;
+    vector<uint64_t> expired;  // advance() 결과를 담는 버퍼. 재사용한다.
 };
 
-// 소켓으로부터 Client 객체 포인터를 얻어내기 위한 map
-map<SOCKET, shared_ptr<Client> > activeClients;
-mutex activeClientsMutex;
+// poller 에서 listener 를 나타내는 token. 어떤 연결 handle 과도 겹치지 않는다.
+static const uint64_t LISTENER_TOKEN = INVALID_CONN_HANDLE;
 
-// 패킷이 도착한 client 들의 큐
-queue<shared_ptr<Client> > jobQueue;
-mutex jobQueueMutex;
-condition_variable jobQueueFilledCv;
+// handoff 모드의 전체 동접 클라이언트 목록. poller token 과 job 값이 모두 이 테이블의 handle 이다.
+// one-shot poller 덕분에 한 연결은 이벤트를 받은 쓰레드 하나만 다루므로 Client 자체에는 lock 이 필요 없다.
+ConnTable<Client> activeClients;
 
-SOCKET createPassiveSocketREST() {
-    // REST API 통신용 TCP socket 을 만든다.
-    SOCKET passiveSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (passiveSock == INVALID_SOCKET) {
-        cerr << "socket failed with error " << WSAGetLastError() << endl;
-        return 1;
+// handoff 모드의 연결 timeout 타이머. main 쓰레드가 돌린다.
+ConnTimers handoffTimers;
+
+// 서버가 제공하는 API 들. main() 에서 등록한 뒤로는 읽기만 하므로 worker 들이 lock 없이 쓴다.
+Router router;
+
+// --static-root 아래의 파일들. 모든 쓰레드가 같이 쓴다.
+StaticFileCache staticFiles;
+
+// cachedRoute() 로 등록한 GET route 들의 response cache (--cache-size)
+ResponseCache responseCache;
+
+// 이 쓰레드가 response cache 를 채우는 다른 쓰레드를 기다려도 되는지. handoff 의 worker 만 true 다.
+// sharded/io_uring 의 쓰레드는 event loop 라서 기다리는 동안 그 shard 의 연결이 모두 멈춘다.
+thread_local bool cacheMayWait = false;
+
+// userName 별 세션 (--max-users, --session-ttl)
+UserStore userStore;
+
+// 패킷이 도착한 client 들의 큐. 작업 값은 연결 handle 이다.
+Scheduler* scheduler = NULL;
+
+// job queue 에 넣었지만 worker 가 아직 꺼내가지 않은 작업 수 (--max-queue)
+atomic<size_t> queuedJobs(0);
+
+// job queue 에서 기다린 시간으로 request 를 덜어낸다. (--codel-target)
+CoDel codel;
+
+// 모든 모드, 모든 shard 를 합친 열린 연결 수 (--max-connections)
+atomic<size_t> openConnections(0);
+
+// 서버가 시작한 시각 (metricsNowNs() 기준). accept rate 를 처음 잴 때 쓴다.
+uint64_t serverStartNs = 0;
+
+// 소켓 readiness 를 감시하는 poller. main() 에서 만들고 worker 들이 rearm 할 때 쓴다.
+Poller* poller = NULL;
+
+// listener 에 정수 소켓 옵션 하나를 건다. 실패하면 경고만 남긴다.
+static bool setListenerOption(SOCKET sock, int level, int option, int value, const char* name) {
+    if (setsockopt(sock, level, option, (const char*)&value, sizeof(value)) == SOCKET_ERROR) {
+        LOG_WARN("setsockopt(%s) failed with error %d", name, WSAGetLastError());
+        return false;
     }
+    return true;
+}
 
-    // socket 을 특정 주소, 포트에 바인딩 한다.
+// config 의 주소와 포트에 listen 하는 소켓을 만든다. 소켓 옵션도 config 대로 건다.
+// reusePort 가 true 이면 SO_REUSEPORT 를 켜서 여러 소켓이 같은 주소에 bind 할 수 있게 한다.
+// 소켓은 blocking 이다. poller 로 감시할 때는 호출자가 non-blocking 으로 바꾼다.
+// (io_uring 은 non-blocking listener 에 걸린 accept 를 기다리지 않고 바로 EAGAIN 으로 끝낸다)
+// 실패하면 INVALID_SOCKET 을 반환한다.
+SOCKET createPassiveSocketREST(bool reusePort) {
     struct sockaddr_in serverAddr;
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(REST_SERVER_PORT);
-    inet_pton(AF_INET, REST_SERVER_ADDRESS, &serverAddr.sin_addr.s_addr);
+    serverAddr.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.bindAddress.c_str(), &serverAddr.sin_addr.s_addr) != 1) {
+        LOG_ERROR("Invalid bind address %s", config.bindAddress.c_str());
+        return INVALID_SOCKET;
+    }
+
+    // REST API 통신용 TCP socket 을 만든다.
+    SOCKET passiveSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (passiveSock == INVALID_SOCKET) {
+        LOG_ERROR("socket failed with error %d", WSAGetLastError());
+        return INVALID_SOCKET;
+    }
 
+    // Windows 의 SO_REUSEADDR 는 다른 프로세스가 listen 중인 포트까지 가로챌 수 있게 하므로 켜지 않는다.
+#ifndef _WIN32
+    if (config.reuseAddr) {
+        setListenerOption(passiveSock, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+    }
+#endif
+
+#ifdef SO_REUSEPORT
+    if (reusePort || config.reusePort) {
+        int on = 1;
+        if (setsockopt(passiveSock, SOL_SOCKET, SO_REUSEPORT, (const char*)&on, sizeof(on)) == SOCKET_ERROR) {
+            LOG_ERROR("setsockopt(SO_REUSEPORT) failed with error %d", WSAGetLastError());
+            closesocket(passiveSock);
+            return INVALID_SOCKET;
+        }
+    }
+#else
+    (void)reusePort;
+#endif
+
+    // 아래 옵션들은 accept 한 소켓이 물려받는다. 버퍼 크기는 TCP window scale 이 정해지는 listen 전에 걸어야 한다.
+    if (config.tcpNoDelay) {
+        setListenerOption(passiveSock, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if (config.recvBufferBytes > 0) {
+        setListenerOption(passiveSock, SOL_SOCKET, SO_RCVBUF, (int)config.recvBufferBytes, "SO_RCVBUF");
+    }
+    if (config.sendBufferBytes > 0) {
+        setListenerOption(passiveSock, SOL_SOCKET, SO_SNDBUF, (int)config.sendBufferBytes, "SO_SNDBUF");
+    }
+    if (config.deferAcceptSec > 0) {
+#ifdef TCP_DEFER_ACCEPT
+        setListenerOption(passiveSock, IPPROTO_TCP, TCP_DEFER_ACCEPT, config.deferAcceptSec, "TCP_DEFER_ACCEPT");
+#else
+        LOG_WARN("TCP_DEFER_ACCEPT is not supported on this platform");
+#endif
+    }
+    if (config.fastOpenQueue > 0) {
+#ifdef TCP_FASTOPEN
+        setListenerOption(passiveSock, IPPROTO_TCP, TCP_FASTOPEN, config.fastOpenQueue, "TCP_FASTOPEN");
+#else
+        LOG_WARN("TCP_FASTOPEN is not supported on this platform");
+#endif
+    }
+
+    // socket 을 특정 주소, 포트에 바인딩 한다.
     int r = ::bind(passiveSock, (sockaddr*)&serverAddr, sizeof(serverAddr));
     if (r == SOCKET_ERROR) {
-        cerr << "bind failed with error " << WSAGetLastError() << endl;
-        return 1;
+        LOG_ERROR("bind failed with error %d", WSAGetLastError());
+        closesocket(passiveSock);
+        return INVALID_SOCKET;
     }
 
     // passive socket을 생성하고 반환한다.
-    r = listen(passiveSock, 10);
+    r = listen(passiveSock, config.listenBacklog);
     if (r == SOCKET_ERROR) {
-        cerr << "listen faijled with error " << WSAGetLastError() << endl;
-        return 1;
+        LOG_ERROR("listen failed with error %d", WSAGetLastError());
+        closesocket(passiveSock);
+        return INVALID_SOCKET;
     }
 
     return passiveSock;
 }
 
-string convertToJson() {
-    char jsonData[BUFFER_SIZE];
-    sprintf_s(jsonData, sizeof(jsonData), "{\"tag\": \"position\", \"x\": %d, \"y\": %d}", 10, 10);
-    return jsonData;
+// request 단위로 시각을 재야 하는지
+inline bool requestTimingOn() {
+    return metricsOn() || accessLogEnabled.load(memory_order_relaxed);
 }
 
-bool processRequest(shared_ptr<Client> client) {
-    SOCKET activeSock = client->sock;
-    int r;
-
-    // Header 부분을 읽는다.
-    if (client->lenCompleted == false) {
-        while (!client->lenCompleted) {
-            r = recv(activeSock, client->packet + client->offset, 1, 0);
-            if (r == SOCKET_ERROR) {
-                std::cerr << "recv failed with error " << WSAGetLastError() << std::endl;
-                return false;
-            } else if (r == 0) {
-                // 메뉴얼을 보면 recv() 는 소켓이 닫힌 경우 0 을 반환함을 알 수 있다.
-                // 따라서 r == 0 인 경우도 loop 을 탈출하게 해야된다.
-                return false;
-            }
-            client->offset++;
+// 새로 받은 연결의 로그를 찍고 센다. peer 에는 "주소:포트" 를 채운다.
+void describeAccepted(SOCKET activeSock, const struct sockaddr_in& clientAddr, char* peer, size_t peerSize) {
+    char strBuf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(clientAddr.sin_addr), strBuf, sizeof(strBuf));
+    sprintf_s(peer, peerSize, "%s:%d", strBuf, (int)ntohs(clientAddr.sin_port));
+    LOG_DEBUG("New client from %s. Socket: %d", peer, (int)activeSock);
+    if (metricsOn()) {
+        metricsAdd(COUNTER_CONNECTIONS_ACCEPTED);
+    }
+}
 
-            if (client->offset >= 2 && client->packet[client->offset - 2] == '\r' && client->packet[client->offset - 1] == '\n') {
-                if (client->offset == 2 && client->packet[0] == '\r' && client->packet[1] == '\n') {
-                    // Header 부분을 모두 읽은 경우
-                    client->lenCompleted = true;
-                } else {
-                    // Header 속성 하나를 모두 읽은 경우
-                    client->packet[client->offset-1] = '\0'; // \r과 \n를 제외하고 문자열의 끝임을 알린다.
-                    string field = client->packet;
-                    vector<string> result = split(field, ':');
-                    if (result.size() >= 2) {
-                        string key = result[0];
-                        string value = "";
-                        for (int i = 1; i < result.size(); ++i) {
-                            value += result[i];
-                        }
-                        trim(value); // 양옆 공백을 제거
-                        cout << "KEY : " << key << endl;
-                        cout << "VAL : " << value << endl << endl;
-
-                        if (key.compare("Content-Length") == 0) {
-                            client->packetLen = atoi(value.c_str());
-                        }
-                    } else if (result.size() == 1) {
-                        // 맨 첫줄
-                        // [0]: 요청타입 / [1]: 파라메터 / [2]: 프로토콜버전
-                        vector<string> result = split(field, ' ');
-                        string type = result[0];
-                        string param = result[1];
-                        string protocol = result[2];
-                        cout << "Request Type : " << type << endl;
-                        cout << "Params : " << param << endl;
-                        cout << "Protocol : " << protocol << endl;
-
-                        // GET 요청의 경우 패킷 길이를 0으로 지정한다. (Content-Length 헤더도 없다)
-                        // 더 이상 헤더 정보는 필요 없지만, 모두 다 받지 않으면
-                        // REST API Client에서 다음 요청을 보내오면 이전 요청의 헤더를 받아버리기 때문에
-                        // 헤더를 모두 받은 후 lenCompleted를 true로 바꿔야 한다.
-                        if (type.compare("GET") == 0) {
-                            client->packetLen = 0;
-                        }
-                    }
+// passive socket 에서 연결 하나를 받고 로그를 찍는다. 받을 연결이 없거나 실패하면 INVALID_SOCKET.
+// peer 에는 "주소:포트" 를 채운다.
+SOCKET acceptClient(SOCKET passiveSock, char* peer, size_t peerSize) {
+    struct sockaddr_in clientAddr;
+    socklen_t clientAddrSize = sizeof(clientAddr);
+#ifdef __linux__
+    // 느린 상대 때문에 send/recv 에서 멈추지 않도록 non-blocking 으로 받는다. fcntl 을 따로 부르지 않아도 된다.
+    SOCKET activeSock = accept4(passiveSock, (sockaddr*)&clientAddr, &clientAddrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (activeSock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+#else
+    SOCKET activeSock = accept(passiveSock, (sockaddr*)&clientAddr, &clientAddrSize);
+    if (activeSock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    setSocketNonBlocking(activeSock);
+    // Linux 는 listener 의 TCP_NODELAY 를 물려주지만 다른 플랫폼은 그렇다는 보장이 없다.
+    if (config.tcpNoDelay) {
+        int on = 1;
+        setsockopt(activeSock, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    }
+#endif
+    describeAccepted(activeSock, clientAddr, peer, peerSize);
+    return activeSock;
+}
 
-                    // 버퍼 초기화
-                    fill(client->packet, client->packet + client->offset, 0xcccccccc);
-                }
-                client->offset = 0;
-            }
+// 지금 쓰레드를 cpu 번 CPU 에서만 돌도록 고정한다. CPU 보다 shard 가 많으면 돌아가면서 배정한다.
+void pinCurrentThread(int cpu) {
+    unsigned int numCpus = thread::hardware_concurrency();
+    if (numCpus > 0) {
+        cpu %= numCpus;
+    }
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (cpu % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r != 0) {
+        LOG_WARN("pthread_setaffinity_np(%d) failed with error %d", cpu, r);
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+const char* statusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 415: return "Unsupported Media Type";
+    case 416: return "Range Not Satisfiable";
+    case 431: return "Request Header Fields Too Large";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+    }
+}
+
+// 보낸 response 하나를 상태 코드별로 센다.
+void countResponse(int status) {
+    static const MetricCounter COUNTER_BY_CLASS[] = {
+        COUNTER_RESPONSES_2XX, COUNTER_RESPONSES_2XX, COUNTER_RESPONSES_2XX,
+        COUNTER_RESPONSES_3XX, COUNTER_RESPONSES_4XX, COUNTER_RESPONSES_5XX,
+    };
+    int statusClass = status / 100;
+    metricsAdd(COUNTER_BY_CLASS[statusClass >= 1 && statusClass <= 5 ? statusClass : 5]);
+}
+
+// NULL 이 아니면 finishResponse() 가 세지 않고 여기에 모아둔다.
+// cachedRoute() 가 handler 의 응답을 따로 받을 때, 그중 실제로 보내는 것만 세기 위해서다.
+thread_local vector<int>* deferredStatuses = NULL;
+
+// response 하나를 다 붙였다. 상태 코드별로 센다.
+void finishResponse(ResponseBatch& batch, int status) {
+    batch.endResponse(status);
+    if (!metricsOn()) {
+        return;
+    }
+    if (deferredStatuses) {
+        deferredStatuses->push_back(status);
+        return;
+    }
+    countResponse(status);
+}
+
+// body 가 없는 응답. extraHeaders 는 "Name: value\r\n" 을 이어 붙인 것이다.
+void appendStatusResponse(ResponseBatch& batch, int status, const string& extraHeaders = "") {
+    char buffer[256];
+    int len = sprintf_s(buffer, sizeof(buffer), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n", status, statusText(status));
+    batch.append(buffer, len);
+    batch.append(extraHeaders);
+    batch.append("\r\n", 2);
+    finishResponse(batch, status);
+}
+
+// 잘못된 request 에 대한 응답. 이후 연결은 끊기므로 Connection: close 를 붙인다.
+void appendErrorResponse(ResponseBatch& batch, int status) {
+    appendStatusResponse(batch, status, "Connection: close\r\n");
+}
+
+// JSON body 를 담은 응답을 batch 의 버퍼에 바로 쓴다. writeBody(JsonWriter&) 가 body 를 쓴다.
+// Content-Length 는 body 를 다 써야 알 수 있으므로 body 를 "Content-Length: " 바로 뒤에 먼저 쓰고,
+// 길이와 헤더 끝을 그 자리에 끼워 넣는다. body 가 그만큼(몇 바이트) 뒤로 밀린다.
+template <typename WriteBody>
+void appendJsonResponse(ResponseBatch& batch, int status, WriteBody writeBody) {
+    string& out = batch.writeBuffer();
+    size_t from = out.size();
+    char buffer[128];
+    int len = sprintf_s(buffer, sizeof(buffer), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: ", status, statusText(status));
+    out.append(buffer, len);
+
+    size_t bodyStart = out.size();
+    JsonWriter writer(out);
+    writeBody(writer);
+
+    len = sprintf_s(buffer, sizeof(buffer), "%llu\r\n\r\n", (unsigned long long)(out.size() - bodyStart));
+    out.insert(bodyStart, buffer, len);
+    batch.commitWrite(from);
+    finishResponse(batch, status);
+}
+
+// {"error": message} 형태의 오류 응답. 연결은 유지한다.
+void appendJsonError(ResponseBatch& batch, int status, const char* message) {
+    appendJsonResponse(batch, status, [&](JsonWriter& w) {
+        w.beginObject();
+        w.key("error");
+        w.value(message);
+        w.endObject();
+    });
+}
+
+// Content-Type 이 application/json 인지. 대소문자와 뒤에 붙는 parameter(; charset=utf-8 등)는 무시한다.
+bool isJsonContentType(string_view contentType) {
+    static const char JSON_TYPE[] = "application/json";
+    static const size_t JSON_TYPE_LEN = sizeof(JSON_TYPE) - 1;
+    if (contentType.size() < JSON_TYPE_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < JSON_TYPE_LEN; ++i) {
+        if (tolower((unsigned char)contentType[i]) != JSON_TYPE[i]) {
+            return false;
         }
     }
+    string_view rest = contentType.substr(JSON_TYPE_LEN);
+    size_t i = 0;
+    while (i < rest.size() && (rest[i] == ' ' || rest[i] == '\t')) {
+        ++i;
+    }
+    return i == rest.size() || rest[i] == ';';
+}
 
-    // 여기까지 도달했다는 것은 packetLen 을 완성한 경우다. (== lenCompleted 가 true)
-    // packetLen 만큼 데이터를 읽으면서 완성한다.
-    if (client->lenCompleted == false) {
+// 출력 큐를 보낼 수 있는 만큼 보낸다. 연결 오류인 경우에만 false.
+bool flushResponses(Client* client, uint64_t now) {
+    ResponseBatch& out = client->out;
+    if (out.empty()) {
         return true;
     }
+    size_t bytes = out.size();
+    size_t count = out.responses();
+    uint64_t start = metricsOn() ? metricsNowNs() : 0;
+    if (!out.flush(client->sock)) {
+        if (metricsOn()) {
+            metricsAdd(COUNTER_SEND_ERRORS);
+        }
+        return false;
+    }
+    if (metricsOn()) {
+        metricsRecord(STAGE_SEND, metricsNowNs() - start);
+        metricsAdd(COUNTER_BYTES_OUT, bytes - out.size());
+    }
+    if (out.size() == bytes) {
+        return true;
+    }
+    client->lastSendMs = now;
+    if (out.empty()) {
+        LOG_DEBUG("[%d] Sent %zu bytes (%zu responses)", (int)client->sock, bytes, count);
+    } else {
+        LOG_DEBUG("[%d] Sent %zu bytes, %zu bytes queued", (int)client->sock, bytes - out.size(), out.size());
+    }
+    return true;
+}
 
-    // 받을게 있다면 받는다.
-    if (client->packetLen != 0) {
-        // Body 부분을 읽는다.
-        r = recv(client->sock, client->packet + client->offset, client->packetLen - client->offset, 0);
-        if (r == SOCKET_ERROR) {
-            std::cerr << "recv failed with error " << WSAGetLastError() << std::endl;
-            return false;
-        } else if (r == 0) {
-            // 메뉴얼을 보면 recv() 는 소켓이 닫힌 경우 0 을 반환함을 알 수 있다.
-            // 따라서 r == 0 인 경우도 loop 을 탈출하게 해야된다.
-            return false;
+// 버퍼에 다 담기지 않는 큰 body 는 이 함수로 조각조각 넘어온다.
+// 호출이 끝나면 chunk 는 버퍼에서 지워지므로 필요하면 복사해야 한다.
+void handleBodyChunk(Client* client, const HttpRequest& req, string_view chunk) {
+    if (req.chunked) {
+        LOG_DEBUG("[%d] Body chunk %zu bytes. %zu bytes so far", (int)client->sock, chunk.size(), client->parser.bodyTotal());
+    } else {
+        LOG_DEBUG("[%d] Body chunk %zu bytes. %zu/%zu bytes so far", (int)client->sock, chunk.size(),
+            client->parser.bodyTotal(), req.contentLength);
+    }
+}
+
+// HEAD request. GET 의 handler 일 수도 있으므로 response 를 따로 만들어서 헤더(Content-Length 포함)만 batch 에 옮긴다.
+// 상태 코드별 counter 는 handler 가 finishResponse() 할 때 이미 세었다.
+void appendHeadResponse(const RouteHandler& handler, const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    thread_local ResponseBatch full;
+    thread_local string response;
+    full.clear();
+    handler(req, params, full);
+    response.clear();
+    full.appendTo(response);
+    size_t headerEnd = response.find("\r\n\r\n");
+    batch.append(response.data(), headerEnd == string::npos ? response.size() : headerEnd + 4);
+    batch.endResponse(full.lastStatus());
+    full.clear();
+}
+
+// 완성된 request 하나를 처리하고 response 를 batch 에 쌓는다.
+void handleRequest(Client* client, const HttpRequest& req, ResponseBatch& batch) {
+    // 헤더 덤프는 debug level 에서만 한다. 꺼져 있으면 loop 도 돌지 않는다.
+    if (logEnabled(LOG_LEVEL_DEBUG)) {
+        LOG_DEBUG("[%d] %.*s %.*s %.*s", (int)client->sock, (int)req.method.size(), req.method.data(),
+            (int)req.path.size(), req.path.data(), (int)req.version.size(), req.version.data());
+        for (int i = 0; i < req.numHeaders; ++i) {
+            LOG_DEBUG("[%d]   %.*s: %.*s", (int)client->sock, (int)req.headers[i].name.size(), req.headers[i].name.data(),
+                (int)req.headers[i].value.size(), req.headers[i].value.data());
+        }
+        if (client->streamingBody) {
+            LOG_DEBUG("[%d] Received %zu bytes (streamed)", (int)client->sock, req.contentLength);
+        } else {
+            LOG_DEBUG("[%d] Received %zu bytes: %.*s", (int)client->sock, req.contentLength, (int)req.body.size(), req.body.data());
         }
-        client->offset += r;
+    }
+    size_t queuedBefore = batch.size();
+    uint64_t handlerStart = requestTimingOn() ? metricsNowNs() : 0;
+
+    // method 와 경로로 handler 를 찾는다. 못 찾으면 상황에 맞는 응답을 대신 보낸다.
+    const RouteHandler* handler = NULL;
+    RouteParams params;
+    string allow;
+    int status = router.match(req.method, req.path, handler, params, &allow);
+    if (status == 200 && req.method == "HEAD") {
+        appendHeadResponse(*handler, req, params, batch);
+    } else if (status == 200) {
+        (*handler)(req, params, batch);
+    } else if (status == 405) {
+        appendStatusResponse(batch, status, "Allow: " + allow + "\r\n");
+    } else {
+        appendStatusResponse(batch, status);
     }
 
-    // 완성한 경우와 partial recv 인 경우를 구분해서 로그를 찍는다.
-    if (client->offset == client->packetLen) {
-        cout << "[" << activeSock << "] Received " << client->packetLen << " bytes" << endl;
+    if (requestTimingOn()) {
+        uint64_t now = metricsNowNs();
+        if (metricsOn()) {
+            metricsAdd(COUNTER_REQUESTS);
+            metricsRecord(STAGE_HANDLER, now - handlerStart);
+            metricsRecord(STAGE_REQUEST, now - client->requestStartNs);
+        }
+        if (accessLogEnabled.load(memory_order_relaxed)) {
+            logAccess(client->peer, req.method.data(), req.method.size(), req.path.data(), req.path.size(),
+                batch.lastStatus(), batch.size() - queuedBefore, (now - client->requestStartNs) / 1000);
+        }
+    }
+}
 
-        client->packet[client->offset] = '\0'; // 버퍼의 뒤 쓰레기값부분은 자르도록 널 문자를 추가
-        cout << client->packet << endl;
+void writePosition(JsonWriter& w, int64_t x, int64_t y) {
+    w.beginObject();
+    w.key("tag");
+    w.value("position");
+    w.key("x");
+    w.value(x);
+    w.key("y");
+    w.value(y);
+    w.endObject();
+}
 
-        // 다음 패킷을 위해 패킷 관련 정보를 초기화한다.
-        client->lenCompleted = false;
-        client->offset = 0;
-        client->packetLen = 0;
+// 예전에 모든 request 에 보내던 응답
+void handlePosition(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    (void)req;
+    (void)params;
+    appendJsonResponse(batch, 200, [](JsonWriter& w) { writePosition(w, 10, 10); });
+}
 
-        // Body 부분에 JSON 메시지를 담고 헤더의 Content-Length를 지정하여 Response 메시지를 만든다.
-        string json = convertToJson();
-        char buffer[BUFFER_SIZE];
-        sprintf_s(buffer, sizeof(buffer), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nContent-Type: application/json\r\n\r\n%s", json.size(), json.c_str());
-        string response = buffer;
+// GET /users/{name}
+// name 은 퍼센트 인코딩을 푼 userName 이다. 세션이 없거나 만료되었으면 404.
+void handleGetUser(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    (void)req;
+    thread_local string name;
+    if (!percentDecode(params.get("name"), name)) {
+        appendJsonError(batch, 400, "Bad percent-encoding in user name");
+        return;
+    }
+    UserState state;
+    if (!userStore.get(name, state)) {
+        appendJsonError(batch, 404, "Unknown user");
+        return;
+    }
+    appendJsonResponse(batch, 200, [&](JsonWriter& w) {
+        w.beginObject();
+        w.key("userName");
+        w.value(name);
+        w.key("x");
+        w.value(state.x);
+        w.key("y");
+        w.value(state.y);
+        w.key("commands");
+        w.value((int64_t)state.commands);
+        w.key("sessionMs");
+        w.value((int64_t)(state.lastSeenMs - state.loginMs));
+        w.endObject();
+    });
+}
 
-        // Response를 전송한다.
-        int offset = 0;
-        while (offset < response.length()) {
-            r = send(client->sock, response.c_str() + offset, response.length() - offset, 0);
-            if (r == SOCKET_ERROR) {
-                std::cerr << "send failed with error " << WSAGetLastError() << std::endl;
-                return 1;
-            }
-            std::cout << "Sent " << r << " bytes" << std::endl;
-            offset += r;
+// userName 의 세션을 f 로 고친다. 처음 보는 이름이면 세션을 만든다. (implicit login)
+// user store 를 끈 경우(--max-users 0)에는 아무것도 하지 않는다. 실패하면 오류 response 를 쌓고 false.
+template <class F>
+bool updateUser(const string& userName, ResponseBatch& batch, F f) {
+    if (!userStore.enabled()) {
+        return true;
+    }
+    if (userName.empty() || userName.size() > UserStore::MAX_NAME_LEN) {
+        appendJsonError(batch, 400, "userName must be 1 to 64 bytes");
+        return false;
+    }
+    if (!userStore.update(userName, config.sessionTtlMs, f)) {
+        appendJsonError(batch, 503, "Too many users");
+        return false;
+    }
+    // 캐시된 GET /users/{name} 에 예전 상태가 남지 않게 한다. (HEAD 도 같은 key 다)
+    if (responseCache.enabled()) {
+        thread_local string path;
+        path = "/users/";
+        appendPercentEncoded(path, userName);
+        responseCache.invalidate("GET", path);
+    }
+    return true;
+}
+
+// POST /command
+// body 예: {"command": "move", "userName": "abc", "x": 1, "y": 2}
+void handleCommand(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    (void)params;
+    if (!isJsonContentType(req.contentType)) {
+        appendJsonError(batch, 415, "Content-Type must be application/json");
+        return;
+    }
+
+    // 버퍼에 다 담기지 않아 조각조각 넘겨받은 body 는 JSON 으로 파싱할 수 없다.
+    if (req.body.size() != req.contentLength) {
+        appendJsonError(batch, 413, "JSON body too large");
+        return;
+    }
+
+    // 문서 객체는 쓰레드마다 하나를 재사용하므로 token 배열을 매번 할당하지 않는다.
+    static thread_local JsonDocument doc;
+    if (!doc.parse(req.body)) {
+        char message[128];
+        sprintf_s(message, sizeof(message), "Invalid JSON at offset %llu: %s", (unsigned long long)doc.errorOffset(), doc.errorMessage());
+        appendJsonError(batch, 400, message);
+        return;
+    }
+
+    JsonValue root = doc.root();
+    JsonValue command = root["command"];
+    JsonValue userName = root["userName"];
+    string userNameValue;
+    if (!command.isString() || !userName.getString(userNameValue)) {
+        appendJsonError(batch, 400, "command and userName are required");
+        return;
+    }
+
+    if (command.equals("move")) {
+        int64_t x = 0;
+        int64_t y = 0;
+        if (!root["x"].getInt64(x) || !root["y"].getInt64(y)) {
+            appendJsonError(batch, 400, "move needs integer x and y");
+            return;
+        }
+        if (!updateUser(userNameValue, batch, [&](UserState& s) {
+                s.x = x;
+                s.y = y;
+                ++s.commands;
+            })) {
+            return;
         }
+        appendJsonResponse(batch, 200, [&](JsonWriter& w) { writePosition(w, x, y); });
+    } else if (command.equals("echo")) {
+        // userName 과 나머지 인수의 개수를 돌려준다.
+        if (!updateUser(userNameValue, batch, [](UserState& s) { ++s.commands; })) {
+            return;
+        }
+        appendJsonResponse(batch, 200, [&](JsonWriter& w) {
+            w.beginObject();
+            w.key("userName");
+            w.value(userNameValue);
+            w.key("args");
+            w.value((int64_t)root.size() - 2);
+            w.endObject();
+        });
     } else {
-        cout << "[" << activeSock << "] Partial recv " << r << "bytes. " << client->offset << "/" << client->packetLen << endl;
+        appendJsonError(batch, 400, "Unknown command");
     }
+}
 
-    return true;
+// 지난번 GET /metrics 이후 초당 accept 한 연결 수. 처음에는 서버가 시작한 뒤부터의 평균이다.
+// 누적 counter(rest_connections_accepted_total)의 rate 를 scraper 없이 바로 볼 수 있게 한다.
+static uint64_t acceptRateSinceLastScrape() {
+    static mutex lock;
+    static uint64_t lastNs = 0;
+    static uint64_t lastAccepted = 0;
+
+    lock_guard<mutex> guard(lock);
+    uint64_t now = metricsNowNs();
+    uint64_t accepted = metricsCounter(COUNTER_CONNECTIONS_ACCEPTED);
+    uint64_t since = lastNs > 0 ? lastNs : serverStartNs;
+    uint64_t rate = now > since ? (uint64_t)((accepted - lastAccepted) * 1e9 / (now - since)) : 0;
+    lastNs = now;
+    lastAccepted = accepted;
+    return rate;
 }
 
-void restThreadProc(int workerId) {
-    cout << "Rest thread is starting. WorkerId: " << workerId << endl;
+// GET /metrics
+// 쓰레드별 counter 와 단계별 지연 시간 히스토그램을 합쳐서 Prometheus text format 으로 보낸다.
+// 수집이 꺼져 있으면(--metrics 없음) 404.
+void handleMetrics(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    (void)req;
+    (void)params;
+    if (!metricsOn()) {
+        appendStatusResponse(batch, 404);
+        return;
+    }
+
+    thread_local string body;
+    body.clear();
+    writeMetrics(body);
+    if (scheduler) {
+        SchedulerStats stats = scheduler->stats();
+        writeMetricsGauge(body, "rest_job_queue_depth", "Jobs waiting in the job queue", stats.queueDepth);
+        writeMetricsCounter(body, "rest_scheduler_steals_total", "Jobs a worker took from another worker's queue", stats.steals);
+        writeMetricsCounter(body, "rest_scheduler_parks_total", "Times a worker went to sleep on an empty queue", stats.parks);
+        writeMetricsCounter(body, "rest_scheduler_wakeups_total", "Times a sleeping worker was woken for new work", stats.wakeups);
+    }
+    writeMetricsGauge(body, "rest_accept_rate", "Connections accepted per second since the previous scrape", acceptRateSinceLastScrape());
+    if (codel.enabled()) {
+        writeMetricsGauge(body, "rest_codel_overloaded", "1 while the job queue delay stays above --codel-target", codel.overloaded() ? 1 : 0);
+    }
+    if (responseCache.enabled()) {
+        writeMetricsGauge(body, "rest_response_cache_bytes", "Approximate size of the cached responses", responseCache.bytes());
+    }
+    if (userStore.enabled()) {
+        writeMetricsGauge(body, "rest_users", "User sessions in the user store, including expired ones not yet reclaimed", userStore.size());
+    }
+    writeMetricsGauge(body, "rest_log_dropped_records", "Log records dropped because a log ring was full", logDropped());
+
+    char buffer[160];
+    int len = sprintf_s(buffer, sizeof(buffer),
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %llu\r\n\r\n",
+        (unsigned long long)body.size());
+    batch.append(buffer, len);
+    batch.append(body);
+    finishResponse(batch, 200);
+}
+
+// GET/HEAD <staticPrefix>/{*path}
+// 헤더의 바뀌지 않는 부분은 파일을 읽을 때 만들어둔 것을 붙이고, body 는 mmap 한 파일을 복사 없이 참조해서 보낸다.
+// 조건부 request(304)와 Range 하나짜리(206, 416)를 지원한다.
+void handleStatic(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+    shared_ptr<const StaticFile> file = staticFiles.get(params.get("path"));
+    if (!file) {
+        appendStatusResponse(batch, 404);
+        return;
+    }
+
+    StaticReply reply = evaluateStaticRequest(*file, req);
+    char buffer[256];
+    int len = 0;
+    if (reply.status == 304) {
+        // 304 에는 body 가 없고 Content-Length 도 보내지 않는다.
+        len = sprintf_s(buffer, sizeof(buffer), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n\r\n",
+            file->etag.c_str(), file->lastModified.c_str());
+        batch.append(buffer, len);
+        finishResponse(batch, 304);
+        return;
+    }
+    if (reply.status == 416) {
+        len = sprintf_s(buffer, sizeof(buffer), "Content-Range: bytes */%llu\r\n", (unsigned long long)file->size);
+        appendStatusResponse(batch, 416, string(buffer, len));
+        return;
+    }
+
+    len = sprintf_s(buffer, sizeof(buffer), "HTTP/1.1 %d %s\r\nContent-Length: %llu\r\n",
+        reply.status, statusText(reply.status), (unsigned long long)reply.length);
+    batch.append(buffer, len);
+    if (reply.status == 206) {
+        len = sprintf_s(buffer, sizeof(buffer), "Content-Range: bytes %llu-%llu/%llu\r\n", (unsigned long long)reply.offset,
+            (unsigned long long)(reply.offset + reply.length - 1), (unsigned long long)file->size);
+        batch.append(buffer, len);
+    }
+    batch.append(file->headers);
+    batch.append("\r\n", 2);
+    if (req.method != "HEAD") {
+        batch.appendRef(file->data + reply.offset, reply.length, file);
+    }
+    finishResponse(batch, reply.status);
+}
+
+// 캐시된 response 를 보낸다. If-None-Match 가 ETag 와 맞으면 304 를 보낸다.
+// 바이트는 복사하지 않고 참조하며, 보내는 동안 entry 를 잡아둔다.
+int appendCachedResponse(const HttpRequest& req, const shared_ptr<const CachedResponse>& entry, ResponseBatch& batch) {
+    const HttpHeader* ifNoneMatch = req.findHeader("If-None-Match");
+    if (ifNoneMatch && etagMatches(ifNoneMatch->value, entry->etag)) {
+        batch.appendRef(entry->notModified.data(), entry->notModified.size(), entry);
+        return 304;
+    }
+    batch.appendRef(entry->response.data(), entry->response.size(), entry);
+    return 200;
+}
+
+// handler 의 200 응답을 ttlMs 동안 response cache 에 넣어두고, 같은 request 에는 handler 없이 캐시된 바이트를 보낸다.
+// key 는 method, 경로(query string 포함)와 varyHeaders 의 값들이다. 응답에는 body 로 만든 ETag 가 붙는다.
+// 캐시에 없으면 같은 key 의 request 들 중 하나만 handler 를 돌리고 나머지는 그 결과를 기다린다.
+// event loop 쓰레드는 기다리지 않고 만료된 응답을 보내거나, 그것도 없으면 handler 를 직접 돌린다. (캐시에는 넣지 않는다)
+RouteHandler cachedRoute(RouteHandler handler, uint64_t ttlMs, vector<string> varyHeaders = vector<string>()) {
+    return [handler, ttlMs, varyHeaders](const HttpRequest& req, const RouteParams& params, ResponseBatch& batch) {
+        if (!responseCache.enabled()) {
+            handler(req, params, batch);
+            return;
+        }
+
+        thread_local string key;
+        ResponseCache::makeKey(req, varyHeaders, key);
+        bool fill = false;
+        shared_ptr<const CachedResponse> entry = responseCache.lookup(key, cacheMayWait, fill);
+        if (entry) {
+            if (metricsOn()) {
+                metricsAdd(COUNTER_CACHE_HITS);
+            }
+            finishResponse(batch, appendCachedResponse(req, entry, batch));
+            return;
+        }
+        if (metricsOn()) {
+            metricsAdd(COUNTER_CACHE_MISSES);
+        }
+
+        // handler 의 응답을 따로 받아서 캐시에 넣는다. 캐시에서 304 를 보낼 수도 있으므로
+        // handler 가 붙인 상태 코드는 바로 세지 않고, 실제로 보내는 response 만 센다.
+        thread_local ResponseBatch scratch;
+        thread_local string response;
+        thread_local vector<int> statuses;
+        statuses.clear();
+        deferredStatuses = &statuses;
+        handler(req, params, scratch);
+        deferredStatuses = NULL;
+
+        if (!fill || scratch.responses() != 1 || scratch.lastStatus() != 200) {
+            if (fill) {
+                responseCache.abandon(key);
+            }
+            batch.appendResponses(scratch);
+            scratch.clear();
+            for (int status : statuses) {
+                countResponse(status);
+            }
+            return;
+        }
+        response.clear();
+        scratch.appendTo(response);
+        scratch.clear();
+        entry = responseCache.insert(key, response, ttlMs);
+        finishResponse(batch, appendCachedResponse(req, entry, batch));
+    };
+}
+
+// 서버가 제공하는 API 를 등록한다.
+bool registerRoutes() {
+    bool ok = true;
+    // 서버가 쓰는 경로. API 경로와 겹치면 등록에 실패한다.
+    ok = ok && router.add("GET", "/metrics", handleMetrics);
+    ok = ok && router.add("GET", "/", cachedRoute(handlePosition, 1000));
+    ok = ok && router.add("POST", "/", handlePosition);
+    ok = ok && router.add("GET", "/position", cachedRoute(handlePosition, 1000));
+    ok = ok && router.add("POST", "/position", handlePosition);
+    ok = ok && router.add("GET", "/users/{name}", cachedRoute(handleGetUser, 1000));
+    ok = ok && router.add("POST", "/command", handleCommand);
+    if (staticFiles.enabled()) {
+        string pattern = config.staticPrefix + "/{*path}";
+        ok = ok && router.add("GET", pattern, handleStatic);
+        ok = ok && router.add("HEAD", pattern, handleStatic);
+    }
+    return ok;
+}
+
+// in.writePtr() 에 새로 받은 n 바이트를 반영하고 완성된 request 들을 처리한다. 연결을 닫아야 하면 false.
+bool handleReceived(Client* client, size_t n, uint64_t now) {
+    SOCKET activeSock = client->sock;
+    ConnBuffer& in = client->in;
+    HttpParser& parser = client->parser;
+    ResponseBatch& batch = client->out;
+
+    client->lastRecvMs = now;
+    if (in.size() == 0 && !parser.headersComplete() && client->servedRequest) {
+        client->requestBeginMs = now;
+    }
+
+    // 새 request 의 첫 바이트다. request 의 처리 시간은 여기서부터 잰다.
+    if (requestTimingOn()) {
+        if (in.size() == 0 && !parser.headersComplete()) {
+            client->requestStartNs = metricsNowNs();
+            client->headerParseNs = 0;
+        }
+        if (metricsOn()) {
+            metricsAdd(COUNTER_BYTES_IN, n);
+        }
+    }
+    in.commit(n);
 
+    // 버퍼 안에 완성된 request 가 있는 동안 계속 처리한다.
+    // 하나만 처리하고 돌아가면 남은 request 는 이미 커널에서 꺼내왔기 때문에 poller 가 다시 알려주지 않는다.
+    // response 는 request 순서대로 batch 에 쌓았다가 마지막에 한 번에 보낸다.
     while (true) {
-        // lock_guard 혹은 unique_lock 의 경우 scope 단위로 lock 범위가 지정되므로,
-        // 아래처럼 새로 scope 을 열고 lock 을 잡는 것이 좋다.
-        shared_ptr<Client> client;
-        {
-            unique_lock<mutex> ul(jobQueueMutex);
-
-            // job queue 에 이벤트가 발생할 때까지 condition variable 을 잡을 것이다.
-            while (jobQueue.empty()) {
-                jobQueueFilledCv.wait(ul);
+        HttpParser::Status status = HttpParser::HEADERS_COMPLETE;
+        if (!parser.headersComplete()) {
+            uint64_t parseStart = metricsOn() ? metricsNowNs() : 0;
+            status = parser.parseHeaders(in.data(), in.size());
+            if (metricsOn()) {
+                uint64_t parseEnd = metricsNowNs();
+                client->headerParseNs += parseEnd - parseStart;
+                if (status == HttpParser::HEADERS_COMPLETE) {
+                    metricsRecord(STAGE_HEADER_PARSE, client->headerParseNs);
+                    client->headersDoneNs = parseEnd;
+                }
             }
+            if (status == HttpParser::HEADERS_COMPLETE) {
+                // body 가 버퍼 limit 안에 들어오지 않을 것이 확실하면 처음부터 스트리밍한다.
+                client->streamingBody = !parser.isChunked()
+                    && parser.declaredContentLength() > in.limit() - parser.headerLength();
+
+                // 상대가 response 를 읽어가지 않으면서 request 만 계속 보내고 있다.
+                // handler 를 돌리지 않고 body 도 읽지 않은 채 503 을 보내고 끊는다.
+                size_t inflight = batch.responses() + client->sending.responses();
+                if (config.maxInflight > 0 && inflight >= config.maxInflight) {
+                    LOG_INFO("[%d] %zu responses in flight. Shedding %s", (int)activeSock, inflight, client->peer);
+                    if (metricsOn()) {
+                        metricsAdd(COUNTER_SHED_INFLIGHT);
+                    }
+                    appendStatusResponse(batch, 503, "Retry-After: 1\r\nConnection: close\r\n");
+                    return false;
+                }
+            }
+        }
+        if (status == HttpParser::HEADERS_COMPLETE) {
+            status = parser.parseBody(in.data(), in.size());
+        }
 
-            // while loop 을 나왔다는 것은 job queue 에 작업이 있다는 것이다.
-            // queue 의 front 를 기억하고 front 를 pop 해서 큐에서 뺀다.
-            client = jobQueue.front();
-            jobQueue.pop();
+        if (status == HttpParser::FAILED) {
+            LOG_WARN("[%d] Bad request from %s. Status %d", (int)activeSock, client->peer, parser.errorStatus());
+            if (metricsOn()) {
+                metricsAdd(COUNTER_PARSE_ERRORS);
+            }
+            appendErrorResponse(batch, parser.errorStatus());
+            return false;
+        }
 
+        // chunked body 가 버퍼 limit 에 닿으면 그때부터 스트리밍으로 바꾼다.
+        if (status == HttpParser::INCOMPLETE && parser.headersComplete() && in.size() + MIN_RECV_SPACE > in.limit()) {
+            client->streamingBody = true;
         }
 
-        // 위의 block 을 나왔으면 client 는 존재할 것이다.
-        // 그러나 혹시 나중에 코드가 변경될 수도 있고 그러니 client 가 null 이 아닌지를 확인 후 처리하도록 하자.
-        // shared_ptr 은 boolean 이 필요한 곳에 쓰일 때면 null 인지 여부를 확인해준다.
-        if (client) {
-            SOCKET activeSock = client->sock;
-            bool successful = processRequest(client);
-            if (successful == false) {
-                closesocket(activeSock);
+        // 스트리밍 중이면 지금까지 디코딩된 body 를 handler 에 넘기고 버퍼에서 지운다.
+        if (client->streamingBody && parser.bodyBuffered() > 0) {
+            HttpRequest req;
+            parser.getRequest(in.data(), req);
+            handleBodyChunk(client, req, req.body);
+            in.erase(parser.headerLength(), parser.bodyBuffered());
+            parser.discardBody();
+        }
 
-                // 전체 동접 클라이언트 목록인 activeClients 에서 삭제한다.
-                // activeClients 는 메인 쓰레드에서도 접근한다. 따라서 mutex 으로 보호해야될 대상이다.
-                // lock_guard 가 scope 단위로 동작하므로 lock 잡히는 영역을 최소화하기 위해서 새로 scope 을 연다.
-                {
-                    lock_guard<mutex> lg(activeClientsMutex);
+        if (status != HttpParser::COMPLETE) {
+            if (in.size() > 0) {
+                LOG_DEBUG("[%d] Partial recv %zu bytes. %zu bytes buffered", (int)activeSock, n, in.size());
+            }
+            break;
+        }
+
+        HttpRequest req;
+        parser.getRequest(in.data(), req);
+        if (metricsOn() && (req.contentLength > 0 || req.chunked)) {
+            metricsRecord(STAGE_BODY_READ, metricsNowNs() - client->headersDoneNs);
+        }
+        handleRequest(client, req, batch);
+
+        // 상대가 연결을 끝내자고 했으면(Connection: close, keep-alive 없는 HTTP/1.0) 뒤에 온 바이트는 버리고
+        // 지금까지 쌓은 response 를 보낸 뒤에 닫는다.
+        if (!parser.keepAlive()) {
+            LOG_DEBUG("[%d] Closing after this response", (int)activeSock);
+            return false;
+        }
+
+        // 처리한 request 는 버퍼에서 빼고, 뒤에 남은 바이트(다음 request 의 앞부분)는 앞으로 당긴다.
+        in.consume(parser.consumed());
+        parser.reset();
+        client->streamingBody = false;
+        client->servedRequest = true;
+        client->requestBeginMs = now;
+        if (in.size() > 0 && requestTimingOn()) {
+            client->requestStartNs = metricsNowNs();
+            client->headerParseNs = 0;
+        }
+    }
+
+    // 처리할 것이 남아있지 않으면 버퍼를 pool 에 돌려준다.
+    in.releaseIfEmpty();
+    return true;
+}
+
+// 소켓에서 받을 수 있는 만큼 받아서 처리한다. 연결을 닫아야 하면 false.
+bool processRequest(Client* client, uint64_t now) {
+    SOCKET activeSock = client->sock;
+    ConnBuffer& in = client->in;
+    ResponseBatch& batch = client->out;
+
+    // 버퍼에 여유 공간을 만든다. 필요하면 limit 까지 키운다.
+    // limit 까지 찼는데도 request 가 진행되지 않았다면 헤더가 버퍼보다 큰 경우다.
+    if (!in.reserve(MIN_RECV_SPACE)) {
+        appendErrorResponse(batch, 431);
+        return false;
+    }
+
+    // 버퍼의 남은 공간만큼 한 번에 받는다.
+    int r = recv(activeSock, in.writePtr(), (int)in.writable(), 0);
+    if (r == SOCKET_ERROR) {
+        // 이벤트가 왔지만 읽을 것이 없는 경우. 다음 이벤트를 기다린다.
+        if (socketWouldBlock()) {
+            in.releaseIfEmpty();
+            return true;
+        }
+        LOG_WARN("[%d] recv failed with error %d", (int)activeSock, WSAGetLastError());
+        if (metricsOn()) {
+            metricsAdd(COUNTER_RECV_ERRORS);
+        }
+        return false;
+    } else if (r == 0) {
+        // 메뉴얼을 보면 recv() 는 소켓이 닫힌 경우 0 을 반환함을 알 수 있다.
+        // 따라서 r == 0 인 경우도 loop 을 탈출하게 해야된다.
+        return false;
+    }
+    return handleReceived(client, (size_t)r, now);
+}
+
+// 연결의 상태에 따라 다음 timeout 기한을 정한다. 타이머는 옮기지 않는다.
+static void updateDeadline(Client* client, uint64_t now) {
+    if (!client->out.empty() || !client->sending.empty()) {
+        // 상대가 response 를 읽어가지 않는다.
+        client->deadlineMs = client->lastSendMs + config.sendTimeoutMs;
+        client->timeoutKind = TIMEOUT_SEND;
+    } else if (client->parser.headersComplete()) {
+        // body 가 마지막으로 바이트를 받은 뒤로 멈췄다.
+        client->deadlineMs = client->lastRecvMs + config.bodyTimeoutMs;
+        client->timeoutKind = TIMEOUT_BODY;
+    } else if (client->in.size() > 0 || !client->servedRequest) {
+        // 헤더는 조금씩 보내더라도 request 를 시작한 때부터 잰다. (slowloris)
+        client->deadlineMs = client->requestBeginMs + config.headerTimeoutMs;
+        client->timeoutKind = TIMEOUT_HEADER;
+    } else {
+        client->deadlineMs = now + config.idleTimeoutMs;
+        client->timeoutKind = TIMEOUT_IDLE;
+    }
+}
+
+// 이벤트를 받은 연결 하나를 처리한다. readable 이면 읽어서 처리하고, 밀려있는 response 를 보낸다.
+// 계속 감시해야 하면 다음에 기다릴 이벤트(PollInterest)를, 연결을 닫아야 하면 0 을 반환한다.
+int serviceClient(Client* client, bool readable) {
+    uint64_t now = timerNowMs();
+    if (client->out.empty()) {
+        client->lastSendMs = now;
+    }
+
+    // 지난번에 다 보내지 못한 response 부터 보낸다.
+    if (!flushResponses(client, now)) {
+        return 0;
+    }
+
+    if (readable && !client->readPaused && !client->closing) {
+        // 실패하면 오류 응답이 큐에 있을 수 있으므로 그것까지 보낸 뒤에 닫는다.
+        if (!processRequest(client, now)) {
+            client->closing = true;
+        }
+        if (!flushResponses(client, now)) {
+            return 0;
+        }
+    }
+    updateDeadline(client, now);
+
+    size_t pending = client->out.size();
+    if (client->closing) {
+        return pending > 0 ? POLL_WRITE : 0;
+    }
+
+    // 상대가 response 를 읽어가지 않으면 새 request 를 더 읽지 않는다.
+    // 한 번 읽은 것은 끝까지 처리하므로 high watermark 를 recv 한 번 분량까지는 넘을 수 있다.
+    if (pending >= config.sendHighWatermark) {
+        if (!client->readPaused) {
+            LOG_INFO("[%d] %zu bytes queued. Pausing reads", (int)client->sock, pending);
+        }
+        client->readPaused = true;
+    } else if (pending <= config.sendLowWatermark) {
+        client->readPaused = false;
+    }
+    return (client->readPaused ? 0 : POLL_READ) | (pending > 0 ? POLL_WRITE : 0);
+}
+
+// 연결 하나를 닫고 테이블에서 지운다. timers.lock 을 잡은 상태에서 부른다.
+static void destroyClient(Poller* p, ConnTable<Client>& table, ConnTimers& timers, ConnHandle handle) {
+    Client* client = table.get(handle);
+    if (!client) {
+        return;
+    }
+
+    timers.wheel.cancel(&client->timer);
+    // poller 에서 먼저 빼야 같은 번호로 재사용된 새 소켓과 헷갈리지 않는다. (io_uring 엔진은 poller 가 없다)
+    if (p) {
+        p->remove(client->sock);
+    }
+    closesocket(client->sock);
+    table.destroy(handle);
+    openConnections.fetch_sub(1, memory_order_relaxed);
+    if (metricsOn()) {
+        metricsAdd(COUNTER_CONNECTIONS_CLOSED);
+    }
+}
+
+// 연결 하나를 닫는다. 이 연결의 이벤트를 받은 쓰레드만 부른다.
+void closeClient(Poller* p, ConnTable<Client>& table, ConnTimers& timers, ConnHandle handle) {
+    lock_guard<mutex> guard(timers.lock);
+    destroyClient(p, table, timers, handle);
+}
+
+// 새 연결의 timeout 타이머를 건다.
+static void startTimer(ConnTimers& timers, Client* client, ConnHandle handle) {
+    lock_guard<mutex> guard(timers.lock);
+    client->timer.token = handle;
+    timers.wheel.schedule(&client->timer, client->deadlineMs);
+}
+
+// 받은 연결을 table 에 넣는다. --max-connections 를 넘었거나 테이블이 가득 찼으면
+// 503 을 보내고 닫은 뒤 INVALID_CONN_HANDLE 을 반환한다.
+static ConnHandle registerClient(ConnTable<Client>& table, SOCKET activeSock, const char* peer) {
+    size_t open = openConnections.fetch_add(1, memory_order_relaxed);
+    if (config.maxConnections == 0 || open < config.maxConnections) {
+        ConnHandle handle = table.create(activeSock, peer);
+        if (handle != INVALID_CONN_HANDLE) {
+            return handle;
+        }
+    }
+    openConnections.fetch_sub(1, memory_order_relaxed);
+
+    LOG_WARN("Too many clients (%zu). Rejecting %s", open, peer);
+    if (metricsOn()) {
+        metricsAdd(COUNTER_CONNECTIONS_REJECTED);
+    }
+    sendOverloadResponse(activeSock);
+    closesocket(activeSock);
+    return INVALID_CONN_HANDLE;
+}
+
+// accept 실패를 처리한다. 연결 하나의 문제(상대가 먼저 끊은 연결 등)면 계속 받으면 되므로 false.
+// fd 나 메모리가 모자라서 실패했으면 listener 가 계속 readable 이라 바로 다시 실패하므로,
+// 잠시 쉬었다가 받도록 resumeMs 를 적고 true 를 반환한다. 그동안 listener 는 rearm 하지 않는다.
+static bool pauseAcceptOnError(int error, uint64_t& resumeMs) {
+    if (metricsOn()) {
+        metricsAdd(COUNTER_ACCEPT_ERRORS);
+    }
+    if (!socketOutOfResources(error)) {
+        LOG_WARN("accept failed with error %d", error);
+        return false;
+    }
+    LOG_ERROR("accept failed with error %d. Pausing accept for %llu ms", error, (unsigned long long)ACCEPT_BACKOFF_MS);
+    resumeMs = timerNowMs() + ACCEPT_BACKOFF_MS;
+    return true;
+}
 
-                    // activeClients 는 key 가 SOCKET 타입이고, value 가 shared_ptr<Client> 이므로 socket 으로 지운다.
-                    activeClients.erase(activeSock);
+// 쉬고 있던 listener 를 다시 받을 시각이 되었는지 확인한다. poller 를 기다릴 시간을 그 시각까지로 줄여서 돌려준다.
+// 시각이 되었으면 resumeMs 를 0 으로 하고 true 를 반환한다. 호출자가 listener 를 다시 감시한다.
+static bool acceptResumeDue(uint64_t& resumeMs, int& timeoutMs) {
+    if (resumeMs == 0) {
+        return false;
+    }
+    uint64_t now = timerNowMs();
+    if (now >= resumeMs) {
+        resumeMs = 0;
+        return true;
+    }
+    int left = (int)(resumeMs - now);
+    if (timeoutMs < 0 || left < timeoutMs) {
+        timeoutMs = left;
+    }
+    return false;
+}
+
+// non-blocking listener 에 쌓인 연결들을 ACCEPT_BATCH 개까지 받아서 하나씩 onAccepted(activeSock, peer) 에 넘긴다.
+// readiness 이벤트 한 번에 여러 연결을 받으므로 연결이 몰릴 때 poller 를 깨우는 횟수가 준다.
+// 자원이 모자라서 accept 를 쉬어야 하면 false 를 반환한다. 이때는 listener 를 rearm 하지 않는다.
+template <class F>
+static bool drainAccept(SOCKET listenSock, uint64_t& resumeMs, F onAccepted) {
+    int accepted = 0;
+    bool resume = true;
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        char peer[64];
+        SOCKET activeSock = acceptClient(listenSock, peer, sizeof(peer));
+        if (activeSock == INVALID_SOCKET) {
+            // 더 받을 연결이 없다. listener 를 여러 shard 가 같이 쓰는 경우(SO_REUSEPORT 가 없는 플랫폼)에는
+            // 다른 shard 가 먼저 가져간 것일 수도 있다. 이것은 오류가 아니다.
+            if (socketWouldBlock()) {
+                break;
+            }
+            // 연결 하나가 잘못된 것이면(상대가 먼저 끊은 연결 등) 다른 연결들은 계속 받는다.
+            if (pauseAcceptOnError(WSAGetLastError(), resumeMs)) {
+                resume = false;
+                break;
+            }
+            continue;
+        }
+        ++accepted;
+        onAccepted(activeSock, peer);
+    }
+    if (accepted > 0 && metricsOn()) {
+        metricsAdd(COUNTER_ACCEPT_BATCHES);
+    }
+    return resume;
+}
+
+// 다음 request 를 받기 전의 연결인지. 이런 연결은 지금 받은 request 를 파싱하지 않고 버려도 된다.
+static bool betweenRequests(const Client* client) {
+    return client->in.size() == 0 && !client->parser.headersComplete() && client->out.empty() && !client->closing;
+}
+
+// 과부하라서 이 연결이 보낸 request 를 처리하지 않고 503 을 보낸다. 호출한 뒤에 연결을 닫는다.
+static void shedClient(Client* client, MetricCounter reason) {
+    LOG_DEBUG("[%d] Overloaded. Shedding %s", (int)client->sock, client->peer);
+    if (metricsOn()) {
+        metricsAdd(reason);
+    }
+    sendOverloadResponse(client->sock);
+}
+
+// 만료된 타이머들을 처리하고 poller 를 얼마나 기다려도 되는지 돌려준다.
+// 기한이 남아있거나 worker 가 처리 중인 연결은 다시 걸고, 기한이 지난 연결은 shutdown 한다.
+// 여기서 바로 닫지 않는 것은 worker 가 아직 rearm 중일 수 있기 때문이다. shutdown 하면 poller 가 이벤트를 주므로
+// 그것을 받은 쓰레드가 평소처럼 닫는다. 소켓 번호는 그때까지 그대로이므로 재사용된 소켓과 헷갈리지 않는다.
+static int expireTimers(ConnTable<Client>& table, ConnTimers& timers) {
+    lock_guard<mutex> guard(timers.lock);
+    uint64_t now = timerNowMs();
+    timers.expired.clear();
+    timers.wheel.advance(now, timers.expired);
+
+    for (size_t i = 0; i < timers.expired.size(); ++i) {
+        ConnHandle handle = timers.expired[i];
+        Client* client = table.get(handle);
+        if (!client) {
+            continue;
+        }
+        if (client->dispatched != client->completed.load(memory_order_acquire)) {
+            timers.wheel.schedule(&client->timer, now + TIMER_TICK_MS);
+            continue;
+        }
+        if (client->deadlineMs > now) {
+            timers.wheel.schedule(&client->timer, client->deadlineMs);
+            continue;
+        }
+
+        static const char* const KIND_NAMES[] = { "idle", "header", "body", "send" };
+        static const MetricCounter KIND_COUNTERS[] = {
+            COUNTER_TIMEOUTS_IDLE, COUNTER_TIMEOUTS_HEADER, COUNTER_TIMEOUTS_BODY, COUNTER_TIMEOUTS_SEND
+        };
+        LOG_INFO("[%d] %s timeout. Closing connection", (int)client->sock, KIND_NAMES[client->timeoutKind]);
+        if (metricsOn()) {
+            metricsAdd(KIND_COUNTERS[client->timeoutKind]);
+        }
+        // request 를 받다가 멈춘 것이면 408 을 알려주고 닫는다. 다 못 보내도 기다리지 않는다.
+        if (client->timeoutKind == TIMEOUT_HEADER || client->timeoutKind == TIMEOUT_BODY) {
+            appendErrorResponse(client->out, 408);
+            flushResponses(client, now);
+        }
+        client->closing = true;
+        shutdown(client->sock, SD_BOTH);
+    }
+    return timers.wheel.pollTimeoutMs();
+}
+
+void restThreadProc(int workerId) {
+    LOG_INFO("Rest thread is starting. WorkerId: %d", workerId);
+    cacheMayWait = true;
+
+    // 작업이 생길 때까지 기다렸다가 하나씩 꺼낸다. 기다리는 방법은 scheduler 가 정한다.
+    uint64_t job;
+    while (scheduler->take(workerId, job)) {
+        // 혹시 나중에 코드가 변경될 수도 있으니 handle 이 아직 살아있는지 확인 후 처리하도록 하자.
+        ConnHandle handle = job;
+        queuedJobs.fetch_sub(1, memory_order_relaxed);
+        Client* client = activeClients.get(handle);
+        if (client) {
+            if (metricsOn() || codel.enabled()) {
+                uint64_t nowNs = metricsNowNs();
+                uint64_t waitedNs = nowNs - client->queuedNs;
+                if (metricsOn()) {
+                    metricsRecord(STAGE_QUEUE_WAIT, waitedNs);
                 }
+                // 큐가 계속 밀려 있는 동안에는 오래 기다린 request 를 처리하지 않는다.
+                // 처리해봐야 상대는 이미 포기했을 가능성이 높고, 뒤에 있는 request 들만 더 늦어진다.
+                if (codel.shouldShed(waitedNs, nowNs) && client->readReady && betweenRequests(client)) {
+                    shedClient(client, COUNTER_SHED_DELAY);
+                    closeClient(poller, activeClients, handoffTimers, handle);
+                    continue;
+                }
+            }
+            int interest = serviceClient(client, client->readReady);
+            if (interest == 0) {
+                // 전체 동접 클라이언트 목록인 activeClients 에서 삭제한다.
+                // slot 의 generation 이 바뀌므로 혹시 남아있는 예전 handle 은 더 이상 이 slot 을 찾지 못한다.
+                closeClient(poller, activeClients, handoffTimers, handle);
             } else {
-                // 다시 select 대상이 될 수 있도록 플래그를 꺼준다.
-                // 참고로 오직 성공한 경우만 이 flag 를 다루고 있다.
-                // 그 이유는 오류가 발생한 경우는 어차피 동접 리스트에서 빼버릴 것이고 select 를 할 일이 없기 때문이다.
-                client->doingRecv.store(false);
+                // 처리가 끝났음을 main 쓰레드의 타이머에 알린다. rearm 하기 전이어야 다음 이벤트의 처리와 순서가 섞이지 않는다.
+                client->completed.fetch_add(1, memory_order_release);
+
+                // 다시 poller 의 감시 대상이 되도록 rearm 해준다.
+                // 참고로 오직 계속 쓸 연결만 rearm 하고 있다.
+                // 그 이유는 닫기로 한 연결은 어차피 동접 리스트에서 빼버릴 것이고 감시할 일이 없기 때문이다.
+                poller->rearm(client->sock, handle, interest);
             }
         }
     }
 
-    cout << "Rest thread is quitting. Worker id: " << workerId << endl;
+    LOG_INFO("Rest thread is quitting. WorkerId: %d", workerId);
 }
 
-int main()
-{
-    char buffer[BUFFER_SIZE] = { 0, };
-    
-
+// handoff 모드. main 쓰레드가 poller 로 readiness 를 감시하고, 읽을 것이 생긴 client 를 job queue 로 worker 에게 넘긴다.
+int runHandoff(SOCKET passiveSock) {
     int r = 0;
 
-    // Winsock 을 초기화한다.
-    WSADATA wsaData;
-    r = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (r != NO_ERROR) {
-        cerr << "WSAStartup failed with error " << r << endl;
-        return 1;
-    }
+    // 쌓인 연결을 다 받으면 accept 가 막히지 않고 바로 돌아오도록 non-blocking 으로 둔다.
+    setSocketNonBlocking(passiveSock);
 
-    // passive socket 을 만들어준다.
-    SOCKET passiveSock = createPassiveSocketREST();
+    // poller 를 만들고 passive socket 을 등록한다.
+    // active socket 들의 token 은 연결 handle 이고, passive socket 은 그와 겹치지 않는 LISTENER_TOKEN 을 쓴다.
+    poller = Poller::create();
+    LOG_INFO("Using %s poller", poller->name());
+    poller->add(passiveSock, LISTENER_TOKEN);
+
+    if (config.scheduler == SCHEDULER_MUTEX) {
+        scheduler = new MutexScheduler();
+    } else {
+        scheduler = new WorkStealingScheduler(config.numThreads);
+    }
+    LOG_INFO("Using %s scheduler with %d workers", scheduler->name(), config.numThreads);
 
     // Request를 수신하고 처리하는 스레드
     list<shared_ptr<thread> > restThreads;
-    for (int i = 0; i < NUM_REST_THREADS; ++i) {
+    for (int i = 0; i < config.numThreads; ++i) {
         shared_ptr<thread> workerThread(new thread(restThreadProc, i));
         restThreads.push_back(workerThread);
     }
 
+    static const int MAX_EVENTS = 64;
+    PollEvent events[MAX_EVENTS];
+    uint64_t acceptResumeMs = 0;  // 0 이 아니면 이 시각까지 accept 를 쉰다.
+
     while (true) {
-        fd_set readSet, exceptionSet;
-
-        // Initial Set
-        FD_ZERO(&readSet);
-        FD_ZERO(&exceptionSet);
-
-        // select 의 첫번째 인자는 max socket 번호에 1을 더한 값이다.
-        // 따라서 max socket 번호를 계산한다.
-        SOCKET maxSock = -1;
-
-        // passive socket 은 기본으로 각 socket set 에 포함되어야 한다.
-        FD_SET(passiveSock, &readSet);
-        FD_SET(passiveSock, &exceptionSet);
-        maxSock = max(maxSock, passiveSock);
-
-        // 현재 남아있는 active socket 들에 대해서도 모두 set 에 넣어준다.
-        for (auto& entry : activeClients) {
-            SOCKET activeSock = entry.first;
-            shared_ptr<Client> client = entry.second;
-
-            // 아직 job queue 안에 안들어간 클라이언트만 select 확인 대상으로 한다.
-            if (client->doingRecv.load() == false) {
-                FD_SET(activeSock, &readSet);
-                FD_SET(activeSock, &exceptionSet);
-                maxSock = max(maxSock, activeSock);
+        // 준비된 소켓이 생길 때까지 기다린다.
+        // 예전에는 doingRecv 플래그를 다시 확인하기 위해 짧은 timeout 으로 select 를 반복했지만,
+        // 이제는 worker 가 처리를 마치면 직접 rearm 하므로 timeout 타이머의 tick 까지만 기다리면 된다.
+        int timeoutMs = expireTimers(activeClients, handoffTimers);
+        if (acceptResumeDue(acceptResumeMs, timeoutMs)) {
+            poller->rearm(passiveSock, LISTENER_TOKEN);
+        }
+        r = poller->wait(events, MAX_EVENTS, timeoutMs);
+        if (r < 0) {
+            LOG_ERROR("%s wait failed: %d", poller->name(), WSAGetLastError());
+            break;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            PollEvent& ev = events[i];
+
+            // passive socket 이 readable 하다면 이는 새 연결이 들어왔다는 것이다.
+            if (ev.token == LISTENER_TOKEN) {
+                // passive socket 에 쌓인 연결들을 accept() 한다. 연결이 완료되고 만들어지는 소켓은 active socket 이다.
+                // passive socket 은 non-blocking 이라 더 받을 연결이 없으면 바로 돌아온다.
+                bool resume = drainAccept(passiveSock, acceptResumeMs, [&](SOCKET activeSock, const char* peer) {
+                    // 새로 client 객체를 테이블의 빈 slot 에 만들고, 그 handle 을 poller token 으로 쓴다.
+                    ConnHandle handle = registerClient(activeClients, activeSock, peer);
+                    if (handle != INVALID_CONN_HANDLE) {
+                        startTimer(handoffTimers, activeClients.get(handle), handle);
+                        poller->add(activeSock, handle);
+                    }
+                });
+
+                // 대기 중인 연결이 더 있으면 poller 가 다시 알려준다.
+                if (resume) {
+                    poller->rearm(passiveSock, LISTENER_TOKEN);
+                }
+                continue;
+            }
+
+            ConnHandle handle = ev.token;
+            Client* client = activeClients.get(handle);
+            if (!client) {
+                continue;
+            }
+
+            // 오류 이벤트가 발생하는 소켓의 클라이언트는 제거한다.
+            // one-shot 이므로 이 이벤트를 받은 main 쓰레드 외에는 이 소켓을 다루는 쓰레드가 없다.
+            if (ev.error) {
+                LOG_WARN("Exception on socket %d", (int)client->sock);
+                closeClient(poller, activeClients, handoffTimers, handle);
+                continue;
+            }
+
+            // 읽기/쓰기 이벤트가 발생하는 소켓의 경우 job queue 에 넣는다.
+            // one-shot 이므로 worker 가 rearm 하기 전까지는 다시 이벤트가 오지 않는다.
+            // 그 사이에는 main 쓰레드만 client 를 만지므로 readReady 를 써도 된다.
+            if (ev.readable || ev.writable) {
+                // worker 들이 밀려 있으면 새 request 는 큐에 넣지 않고 바로 503 으로 돌려보낸다.
+                // 처리 중인 request 가 있는 연결은 그대로 넣는다. (큐는 그만큼 제한을 넘을 수 있다)
+                if (ev.readable && config.maxQueuedJobs > 0 && queuedJobs.load(memory_order_relaxed) >= config.maxQueuedJobs
+                    && betweenRequests(client)) {
+                    shedClient(client, COUNTER_SHED_QUEUE);
+                    closeClient(poller, activeClients, handoffTimers, handle);
+                    continue;
+                }
+
+                // 해당 client 를 job queue 에 넣자. 필요하면 scheduler 가 worker thread 를 깨워준다.
+                client->readReady = ev.readable;
+                if (metricsOn() || codel.enabled()) {
+                    client->queuedNs = metricsNowNs();
+                }
+                client->dispatched++;
+                queuedJobs.fetch_add(1, memory_order_relaxed);
+                scheduler->submit(handle);
             }
         }
+    }
 
-        // select 를 해준다. 동접이 있더라도 doingRecv 가 켜진 것들은 포함하지 않았었다.
-        // 이런 것들은 worker thread 가 처리 후 doingRecv 를 끄면 다시 select 대상이 되어야 하는데,
-        // 아래는 timeout 없이 한정 없이 select 를 기다리므로 doingRecv 변경으로 다시 select 되어야 하는 것들이
-        // 굉장히 오래 걸릴 수 있다. 그런 문제를 해결하기 위해서 select 의 timeout 을 100 msec 정도로 제한한다.
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 100;
-        r = select(maxSock + 1, &readSet, NULL, &exceptionSet, &timeout);
+    // worker 들을 깨워서 끝내고 join 한다.
+    scheduler->stop();
+    for (shared_ptr<thread>& restThread : restThreads) {
+        restThread->join();
+    }
+    delete scheduler;
+
+    delete poller;
+    return 0;
+}
 
-        // select 의 반환값이 오류일 때 SOCKET_ERROR, 그 외의 경우 이벤트가 발생한 소켓 갯수이다.
-        // 따라서 반환값 r 이 0인 경우는 아래를 스킵하게 한다.
-        if (r == SOCKET_ERROR) {
-            std::cerr << "select failed: " << WSAGetLastError() << std::endl;
+// sharded 모드에서 쓰레드 하나가 맡는 단위.
+// listener, poller, 연결 목록을 모두 자기 것만 쓰므로 다른 쓰레드와 주고받는 것이 없다.
+struct Shard {
+    int id;
+    SOCKET listenSock;
+    Poller* poller;
+    ConnTable<Client> clients;  // 이 shard 쓰레드만 만진다.
+    ConnTimers timers;          // 이 shard 쓰레드만 쓰므로 lock 은 항상 비어있다.
+    uint64_t acceptResumeMs;    // 0 이 아니면 이 시각까지 accept 를 쉰다.
+};
+
+void shardThreadProc(Shard* shard) {
+    LOG_INFO("Shard thread is starting. ShardId: %d", shard->id);
+    if (config.pinThreads) {
+        pinCurrentThread(shard->id);
+    }
+
+    static const int MAX_EVENTS = 64;
+    PollEvent events[MAX_EVENTS];
+
+    while (true) {
+        int timeoutMs = expireTimers(shard->clients, shard->timers);
+        if (acceptResumeDue(shard->acceptResumeMs, timeoutMs)) {
+            shard->poller->rearm(shard->listenSock, LISTENER_TOKEN);
+        }
+        int r = shard->poller->wait(events, MAX_EVENTS, timeoutMs);
+        if (r < 0) {
+            LOG_ERROR("[shard %d] %s wait failed: %d", shard->id, shard->poller->name(), WSAGetLastError());
             break;
-        } else if (r == 0)  continue;
-
-        // passive socket 이 readable 하다면 이는 새 연결이 들어왔다는 것이다.
-        if (FD_ISSET(passiveSock, &readSet)) {
-            // passive socket 을 이용해 accept() 를 한다.
-            // accept() 는 blocking 이지만 이미 select() 를 통해 새 연결이 있음을 알고 accept() 를 호출한다.
-            // 따라서 여기서는 blocking 되지 않는다.
-            // 연결이 완료되고 만들어지는 소켓은 active socket 이다.
-            std::cout << "Waiting for a connection" << std::endl;
-            struct sockaddr_in clientAddr;
-            int clientAddrSize = sizeof(clientAddr);
-            SOCKET activeSock = accept(passiveSock, (sockaddr*)&clientAddr, &clientAddrSize);
-
-            // accpet() 가 실패하면 해당 연결은 이루어지지 않았음을 의미한다.
-            // 그 연결이 잘못된다고 하더라도 다른 연결들을 처리해야되므로 에러가 발생했다고 하더라도 계속 진행한다.
-            if (activeSock == INVALID_SOCKET) {
-                std::cerr << "accept failed with error " << WSAGetLastError() << std::endl;
-                return 1;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            PollEvent& ev = events[i];
+
+            if (ev.token == LISTENER_TOKEN) {
+                bool resume = drainAccept(shard->listenSock, shard->acceptResumeMs, [&](SOCKET activeSock, const char* peer) {
+                    ConnHandle handle = registerClient(shard->clients, activeSock, peer);
+                    if (handle != INVALID_CONN_HANDLE) {
+                        startTimer(shard->timers, shard->clients.get(handle), handle);
+                        shard->poller->add(activeSock, handle);
+                    }
+                });
+                if (resume) {
+                    shard->poller->rearm(shard->listenSock, LISTENER_TOKEN);
+                }
+                continue;
+            }
+
+            ConnHandle handle = ev.token;
+            Client* client = shard->clients.get(handle);
+            if (!client) {
+                continue;
+            }
+
+            if (ev.error) {
+                LOG_WARN("Exception on socket %d", (int)client->sock);
+                closeClient(shard->poller, shard->clients, shard->timers, handle);
+                continue;
+            }
+
+            // 다른 쓰레드에 넘기지 않고 이 자리에서 바로 처리한다.
+            if (ev.readable || ev.writable) {
+                int interest = serviceClient(client, ev.readable);
+                if (interest != 0) {
+                    shard->poller->rearm(client->sock, handle, interest);
+                } else {
+                    closeClient(shard->poller, shard->clients, shard->timers, handle);
+                }
+            }
+        }
+    }
+
+    LOG_INFO("Shard thread is quitting. ShardId: %d", shard->id);
+}
+
+int runSharded() {
+    // shard 마다 SO_REUSEPORT 로 자기 listener 를 만든다. 커널이 새 연결을 listener 들에 나눠준다.
+    // SO_REUSEPORT 가 없으면 listener 하나를 모든 shard 가 같이 감시한다.
+    vector<Shard*> shards;
+    SOCKET sharedListener = INVALID_SOCKET;
+    for (int i = 0; i < config.numThreads; ++i) {
+        Shard* shard = new Shard();
+        shard->id = i;
+        shard->acceptResumeMs = 0;
+#ifdef SO_REUSEPORT
+        shard->listenSock = createPassiveSocketREST(true);
+#else
+        if (sharedListener == INVALID_SOCKET) {
+            sharedListener = createPassiveSocketREST(false);
+        }
+        shard->listenSock = sharedListener;
+#endif
+        if (shard->listenSock == INVALID_SOCKET) {
+            return 1;
+        }
+
+        // 쌓인 연결을 다 받았거나 다른 shard 가 먼저 accept 해도 막히지 않도록 non-blocking 으로 둔다.
+        setSocketNonBlocking(shard->listenSock);
+
+        shard->poller = Poller::create();
+        shard->poller->add(shard->listenSock, LISTENER_TOKEN);
+        shards.push_back(shard);
+    }
+    LOG_INFO("Running %zu shards with %s poller", shards.size(), shards[0]->poller->name());
+
+    list<shared_ptr<thread> > shardThreads;
+    for (Shard* shard : shards) {
+        shardThreads.push_back(shared_ptr<thread>(new thread(shardThreadProc, shard)));
+    }
+
+    for (shared_ptr<thread>& shardThread : shardThreads) {
+        shardThread->join();
+    }
+
+    for (Shard* shard : shards) {
+        if (shard->listenSock != sharedListener) {
+            closesocket(shard->listenSock);
+        }
+        delete shard->poller;
+        delete shard;
+    }
+    if (sharedListener != INVALID_SOCKET) {
+        closesocket(sharedListener);
+    }
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+// io_uring 엔진의 ring 크기와 shard 마다의 recv 버퍼.
+// 버퍼는 completion 을 처리하자마자 돌려주므로 한 번 기다리는 동안 도착하는 recv 수만큼만 있으면 된다.
+static const unsigned URING_ENTRIES = 1024;
+static const unsigned URING_BUFFER_COUNT = 512;
+static const unsigned URING_BUFFER_SIZE = 4096;
+
+// io_uring 요청의 user_data 에 연결 handle 과 함께 넣는 요청 종류.
+// handle 의 slot 번호는 2^20 보다 작으므로(ConnTable 의 최대 slot 수) 그 위 8비트(24~31)를 쓴다.
+// listener 의 accept 는 LISTENER_TOKEN 을 그대로 쓴다.
+enum UringOp {
+    URING_RECV = 1,
+    URING_SEND = 2,
+    URING_CANCEL = 3,
+};
+
+static const int URING_OP_SHIFT = 24;
+
+static inline uint64_t uringUserData(ConnHandle handle, int op) {
+    return handle | ((uint64_t)op << URING_OP_SHIFT);
+}
+
+// io_uring 엔진에서 쓰레드 하나가 맡는 단위. Shard 와 같지만 poller 대신 ring 을 가진다.
+struct UringShard {
+    int id;
+    SOCKET listenSock;
+    IoUring ring;
+    ConnTable<Client> clients;  // 이 shard 쓰레드만 만진다.
+    ConnTimers timers;
+    uint64_t acceptResumeMs;    // 0 이 아니면 이 시각까지 accept 를 다시 걸지 않는다.
+};
+
+// out 에 쌓인 response 들을 sending 으로 옮겨서(부분 전송이었으면 sending 의 나머지를) 보내도록 ring 에 넣는다.
+static void uringSend(UringShard* shard, Client* client, ConnHandle handle) {
+    if (client->sending.empty()) {
+        client->sending.swap(client->out);
+    }
+    int count = 0;
+    IoBuf* bufs = client->sending.gather(count);
+    memset(&client->sendMsg, 0, sizeof(client->sendMsg));
+    client->sendMsg.msg_iov = bufs;
+    client->sendMsg.msg_iovlen = count;
+    shard->ring.prepSendmsg(client->sock, &client->sendMsg, uringUserData(handle, URING_SEND));
+    client->sendInFlight = true;
+    if (metricsOn()) {
+        client->sendStartNs = metricsNowNs();
+    }
+}
+
+static void uringCancelRecv(UringShard* shard, Client* client, ConnHandle handle) {
+    if (client->recvArmed && !client->recvCancelling) {
+        shard->ring.prepCancel(uringUserData(handle, URING_RECV), uringUserData(handle, URING_CANCEL));
+        client->recvCancelling = true;
+    }
+}
+
+// completion 을 처리한 뒤 연결이 다음에 할 일을 ring 에 넣는다. serviceClient() 의 뒷부분과 rearm 에 해당한다.
+// 닫을 연결은 걸려 있는 요청이 모두 끝나면 지운다. 커널이 Client 안의 버퍼를 쓰고 있을 수 있기 때문이다.
+static void uringUpdate(UringShard* shard, Client* client, ConnHandle handle, uint64_t now) {
+    if (!client->sendInFlight && (!client->sending.empty() || !client->out.empty())) {
+        uringSend(shard, client, handle);
+    }
+    updateDeadline(client, now);
+
+    if (client->closing) {
+        // 오류 응답까지 보낸 뒤에 닫는다.
+        if (!client->sendInFlight) {
+            if (client->recvArmed) {
+                uringCancelRecv(shard, client, handle);
             } else {
-                // 새로 client 객체를 만든다.
-                shared_ptr<Client> newClient(new Client(activeSock));
+                lock_guard<mutex> guard(shard->timers.lock);
+                destroyClient(NULL, shard->clients, shard->timers, handle);
+            }
+        }
+        return;
+    }
 
-                // socket 을 key 로 하고 해당 객체 포인터를 value 로 하는 map 에 집어 넣는다.
-                activeClients.insert(make_pair(activeSock, newClient));
+    // poll 엔진과 같은 watermark 로 읽기를 멈추고 다시 시작한다.
+    size_t pending = client->out.size() + client->sending.size();
+    if (pending >= config.sendHighWatermark) {
+        if (!client->readPaused) {
+            LOG_INFO("[%d] %zu bytes queued. Pausing reads", (int)client->sock, pending);
+        }
+        client->readPaused = true;
+    } else if (pending <= config.sendLowWatermark) {
+        client->readPaused = false;
+    }
 
-                // 로그를 찍는다.
-                char strBuf[1024];
-                inet_ntop(AF_INET, &(clientAddr.sin_addr), strBuf, sizeof(strBuf));
-                std::cout << "New client from " << strBuf << ":" << ntohs(clientAddr.sin_port) << ". "
-                    << "Socket: " << activeSock << std::endl;
+    if (client->readPaused) {
+        uringCancelRecv(shard, client, handle);
+    } else if (!client->recvArmed) {
+        shard->ring.prepMultishotRecv(client->sock, uringUserData(handle, URING_RECV));
+        client->recvArmed = true;
+    }
+}
+
+// 커널의 recv 버퍼에 받은 바이트를 연결의 수신 버퍼로 옮기면서 처리한다. 연결을 닫아야 하면 false.
+static bool uringReceive(Client* client, const char* data, size_t len, uint64_t now) {
+    ConnBuffer& in = client->in;
+    while (len > 0) {
+        // poll 엔진에서 recv 할 공간이 없을 때와 같다. 헤더가 버퍼 limit 보다 크다.
+        if (!in.reserve(len)) {
+            appendErrorResponse(client->out, 431);
+            return false;
+        }
+        size_t n = min(len, in.writable());
+        memcpy(in.writePtr(), data, n);
+        if (!handleReceived(client, n, now)) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void uringOnRecv(UringShard* shard, Client* client, ConnHandle handle, int res, uint32_t flags, uint64_t now) {
+    if (!IoUring::more(flags)) {
+        client->recvArmed = false;
+        client->recvCancelling = false;
+    }
+
+    if (res > 0 && IoUring::hasBuffer(flags)) {
+        uint16_t bid = IoUring::bufferId(flags);
+        if (!client->closing) {
+            if (client->out.empty() && client->sending.empty()) {
+                client->lastSendMs = now;
+            }
+            if (!uringReceive(client, shard->ring.buffer(bid), (size_t)res, now)) {
+                client->closing = true;
             }
         }
+        shard->ring.recycleBuffer(bid);
+    } else if (res == 0) {
+        // 상대가 연결을 닫았다.
+        client->closing = true;
+    } else if (res == -ENOBUFS) {
+        // recv 버퍼가 모자라서 multishot 이 끝났다. 버퍼는 이번 completion 들을 처리하면서 돌아오므로 다시 건다.
+        LOG_DEBUG("[%d] Out of io_uring receive buffers", (int)client->sock);
+    } else if (res < 0 && res != -ECANCELED) {
+        LOG_WARN("[%d] recv failed with error %d", (int)client->sock, -res);
+        if (metricsOn()) {
+            metricsAdd(COUNTER_RECV_ERRORS);
+        }
+        client->closing = true;
+    }
+    uringUpdate(shard, client, handle, now);
+}
+
+static void uringOnSend(UringShard* shard, Client* client, ConnHandle handle, int res, uint64_t now) {
+    client->sendInFlight = false;
+    if (res < 0) {
+        LOG_WARN("[%d] send failed with error %d", (int)client->sock, -res);
+        if (metricsOn()) {
+            metricsAdd(COUNTER_SEND_ERRORS);
+        }
+        client->sending.clear();
+        client->out.clear();
+        client->closing = true;
+    } else {
+        size_t bytes = client->sending.size();
+        size_t count = client->sending.responses();
+        client->sending.sent((size_t)res);
+        if (metricsOn()) {
+            metricsRecord(STAGE_SEND, metricsNowNs() - client->sendStartNs);
+            metricsAdd(COUNTER_BYTES_OUT, res);
+        }
+        if (res > 0) {
+            client->lastSendMs = now;
+        }
+        if (client->sending.empty()) {
+            LOG_DEBUG("[%d] Sent %zu bytes (%zu responses)", (int)client->sock, bytes, count);
+        } else {
+            LOG_DEBUG("[%d] Sent %d bytes, %zu bytes queued", (int)client->sock, res, client->sending.size() + client->out.size());
+        }
+    }
+    uringUpdate(shard, client, handle, now);
+}
 
-        // 오류 이벤트가 발생하는 소켓의 클라이언트는 제거한다.
-        // activeClients 를 순회하는 동안 그 내용을 변경하면 안되니 지우는 경우를 위해 별도로 list 를 쓴다.
-        list<SOCKET> toDelete;
-        for (auto& entry : activeClients) {
-            SOCKET activeSock = entry.first;
-            shared_ptr<Client> client = entry.second;
+// 연결을 받았으면 true
+static bool uringOnAccept(UringShard* shard, int res, uint32_t flags, uint64_t now) {
+    if (res >= 0) {
+        // multishot accept 는 상대 주소를 돌려주지 않으므로 따로 묻는다. request 가 아니라 연결마다 한 번이다.
+        SOCKET activeSock = res;
+        struct sockaddr_in clientAddr;
+        socklen_t clientAddrSize = sizeof(clientAddr);
+        memset(&clientAddr, 0, sizeof(clientAddr));
+        getpeername(activeSock, (sockaddr*)&clientAddr, &clientAddrSize);
+        char peer[64];
+        describeAccepted(activeSock, clientAddr, peer, sizeof(peer));
+
+        ConnHandle handle = registerClient(shard->clients, activeSock, peer);
+        if (handle != INVALID_CONN_HANDLE) {
+            Client* client = shard->clients.get(handle);
+            startTimer(shard->timers, client, handle);
+            uringUpdate(shard, client, handle, now);
+        }
+    } else if (pauseAcceptOnError(-res, shard->acceptResumeMs) && IoUring::more(flags)) {
+        // multishot 이 아직 걸려 있어서 쉬게 할 수 없다. 다시 걸지 않도록 쉬는 시각을 지운다.
+        shard->acceptResumeMs = 0;
+    }
 
-            if (FD_ISSET(activeSock, &exceptionSet)) {
-                std::cerr << "Exception on socket " << activeSock << std::endl;
+    // 커널이 multishot 을 끝냈으면(오류 등) 다시 건다. 쉬는 중이면 쉬는 시간이 끝난 뒤에 건다.
+    if (!IoUring::more(flags) && shard->acceptResumeMs == 0) {
+        shard->ring.prepMultishotAccept(shard->listenSock, LISTENER_TOKEN);
+    }
+    return res >= 0;
+}
 
-                // 소켓을 닫는다.
-                closesocket(activeSock);
+void uringThreadProc(UringShard* shard) {
+    LOG_INFO("Shard thread is starting. ShardId: %d", shard->id);
+    if (config.pinThreads) {
+        pinCurrentThread(shard->id);
+    }
 
-                // 지울 대상에 포함시킨다.
-                // 여기서 activeClients 에서 바로 지우지 않는 이유는 현재 activeClients 를 순회중이기 때문이다.
-                toDelete.push_back(activeSock);
+    // ring 은 그것을 쓸 쓰레드에서 만들어야 한다. (IORING_SETUP_SINGLE_ISSUER)
+    if (!shard->ring.init(URING_ENTRIES, URING_BUFFER_COUNT, URING_BUFFER_SIZE)) {
+        LOG_ERROR("[shard %d] io_uring setup failed with error %d", shard->id, errno);
+        return;
+    }
 
-                // 소켓을 닫은 경우 더 이상 처리할 필요가 없으니 아래 read 작업은 하지 않는다.
+    shard->ring.prepMultishotAccept(shard->listenSock, LISTENER_TOKEN);
+    while (true) {
+        // 지난번에 쌓은 send/recv 요청들을 제출하는 것과 completion 을 기다리는 것이 syscall 한 번이다.
+        int timeoutMs = expireTimers(shard->clients, shard->timers);
+        if (acceptResumeDue(shard->acceptResumeMs, timeoutMs)) {
+            shard->ring.prepMultishotAccept(shard->listenSock, LISTENER_TOKEN);
+        }
+        if (shard->ring.submitAndWait(timeoutMs) < 0) {
+            LOG_ERROR("[shard %d] io_uring_enter failed: %d", shard->id, errno);
+            break;
+        }
+
+        uint64_t now = timerNowMs();
+        int accepted = 0;  // 이번에 깨어나서 받은 연결 수. multishot accept 는 연결마다 completion 이 따로 온다.
+        struct io_uring_cqe* cqe;
+        while ((cqe = shard->ring.peekCqe()) != NULL) {
+            uint64_t userData = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            shard->ring.cqeSeen();
+
+            if (userData == LISTENER_TOKEN) {
+                if (uringOnAccept(shard, res, flags, now)) {
+                    ++accepted;
+                }
                 continue;
             }
 
-            // 읽기 이벤트가 발생하는 소켓의 경우 recv() 를 처리한다.
-            // 주의: 아래는 여전히 recv() 에 의해 blocking 이 발생할 수 있다.
-            //       우리는 이를 producer-consumer 형태로 바꿀 것이다.
-            if (FD_ISSET(activeSock, &readSet)) {
-                // 이제 다시 select 대상이 되지 않도록 client 의 flag 를 켜준다.
-                client->doingRecv.store(true);
-
-                // 해당 client 를 job queue 에 넣자. lock_guard 를 써도 되고 unique_lock 을 써도 된다.
-                // lock 걸리는 범위를 명시적으로 제어하기 위해서 새로 scope 을 열어준다.
-                {
-                    lock_guard<mutex> lg(jobQueueMutex);
-
-                    bool wasEmpty = jobQueue.empty();
-                    jobQueue.push(client);
-
-                    // 그리고 worker thread 를 깨워준다.
-                    // 무조건 condition variable 을 notify 해도 되는데,
-                    // 해당 condition variable 은 queue 에 뭔가가 들어가서 더 이상 빈 큐가 아닐 때 쓰이므로
-                    // 여기서는 무의미하게 CV 를 notify하지 않도록 큐의 길이가 0에서 1이 되는 순간 notify 를 하도록 하자.
-                    if (wasEmpty) {
-                        jobQueueFilledCv.notify_one();
-                    }
-
-                    // lock_guard 는 scope 이 벗어날 때 풀릴 것이다.
+            int op = (int)((userData >> URING_OP_SHIFT) & 0xff);
+            ConnHandle handle = userData & ~((uint64_t)0xff << URING_OP_SHIFT);
+            Client* client = shard->clients.get(handle);
+            if (!client) {
+                // 이미 지운 연결이다. (취소 요청의 completion 등) 받은 버퍼가 있으면 돌려준다.
+                if (res > 0 && IoUring::hasBuffer(flags)) {
+                    shard->ring.recycleBuffer(IoUring::bufferId(flags));
                 }
+                continue;
+            }
+
+            // 취소 요청 자체의 결과는 볼 필요가 없다. 취소된 recv 의 completion 이 따로 온다.
+            if (op == URING_RECV) {
+                uringOnRecv(shard, client, handle, res, flags, now);
+            } else if (op == URING_SEND) {
+                uringOnSend(shard, client, handle, res, now);
             }
         }
+        if (accepted > 0 && metricsOn()) {
+            metricsAdd(COUNTER_ACCEPT_BATCHES);
+        }
+    }
 
-        // 이제 지울 것이 있었다면 지운다.
-        for (auto& closedSock : toDelete) {
+    LOG_INFO("Shard thread is quitting. ShardId: %d", shard->id);
+}
 
-            // 맵에서 지우고 객체도 지워준다.
-            // shared_ptr 을 썼기 때문에 맵에서 지워서 더 이상 사용하는 곳이 없어지면 객체도 지워진다.
-            activeClients.erase(closedSock);
+// io_uring 엔진. 쓰레드마다 SO_REUSEPORT listener 와 ring 을 가지고 sharded 모드처럼 연결을 혼자 처리한다.
+int runUring() {
+    vector<UringShard*> shards;
+    for (int i = 0; i < config.numThreads; ++i) {
+        UringShard* shard = new UringShard();
+        shard->id = i;
+        shard->acceptResumeMs = 0;
+        shard->listenSock = createPassiveSocketREST(true);
+        if (shard->listenSock == INVALID_SOCKET) {
+            return 1;
         }
+        shards.push_back(shard);
     }
+    LOG_INFO("Running %zu shards with io_uring", shards.size());
 
-    // join
-    for (shared_ptr<thread>& restThread : restThreads) {
-        restThread->join();
+    list<shared_ptr<thread> > shardThreads;
+    for (UringShard* shard : shards) {
+        shardThreads.push_back(shared_ptr<thread>(new thread(uringThreadProc, shard)));
     }
 
-    // 연결을 기다리는 passive socket 을 닫는다.
-    r = closesocket(passiveSock);
-    if (r == SOCKET_ERROR) {
-        cerr << "closesocket(passive) failed with error " << WSAGetLastError() << endl;
+    for (shared_ptr<thread>& shardThread : shardThreads) {
+        shardThread->join();
+    }
+
+    for (UringShard* shard : shards) {
+        closesocket(shard->listenSock);
+        delete shard;
+    }
+    return 0;
+}
+#else
+// io_uring 이 없는 플랫폼. ioUringAvailable() 이 false 이므로 불리지 않는다.
+int runUring() {
+    return 1;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    int r = 0;
+
+    if (!parseServerConfig(argc, argv, config)) {
+        printServerConfigUsage(argv[0]);
         return 1;
     }
+    logLevel.store(config.logLevel);
+    accessLogEnabled.store(config.accessLog);
+    metricsEnabled.store(config.metrics);
+    serverStartNs = metricsNowNs();
 
+    if (!config.staticRoot.empty() && !staticFiles.open(config.staticRoot)) {
+        LOG_ERROR("--static-root %s is not a directory", config.staticRoot.c_str());
+        return 1;
+    }
+
+    responseCache.setBudget(config.responseCacheBytes);
+    userStore.configure(config.maxUsers);
+    codel.configure(config.codelTargetMs, CODEL_INTERVAL_MS);
+    if (!registerRoutes()) {
+        LOG_ERROR("Invalid route table");
+        return 1;
+    }
+
+#ifdef _WIN32
+    // Winsock 을 초기화한다.
+    WSADATA wsaData;
+    r = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (r != NO_ERROR) {
+        LOG_ERROR("WSAStartup failed with error %d", r);
+        return 1;
+    }
+#else
+    // 끊어진 소켓에 send() 하면 SIGPIPE 로 프로세스가 죽으므로 무시하고 오류 코드로 처리한다.
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // 여기서부터 로그는 background 쓰레드가 쓴다.
+    startLogger();
+
+    if (config.ioEngine == IO_ENGINE_URING && !ioUringAvailable()) {
+        LOG_WARN("io_uring is not available (error %d). Using %s", errno, config.mode == MODE_SHARDED ? "sharded mode" : "handoff mode");
+        config.ioEngine = IO_ENGINE_POLL;
+    }
+
+    LOG_INFO("Listening on %s:%u", config.bindAddress.c_str(), (unsigned)config.port);
+    if (config.ioEngine == IO_ENGINE_URING) {
+        r = runUring();
+    } else if (config.mode == MODE_SHARDED) {
+        r = runSharded();
+    } else {
+        // passive socket 을 만들어준다.
+        SOCKET passiveSock = createPassiveSocketREST(false);
+        if (passiveSock == INVALID_SOCKET) {
+            r = 1;
+        } else {
+            r = runHandoff(passiveSock);
+
+            // 연결을 기다리는 passive socket 을 닫는다.
+            if (closesocket(passiveSock) == SOCKET_ERROR) {
+                LOG_ERROR("closesocket(passive) failed with error %d", WSAGetLastError());
+                r = 1;
+            }
+        }
+    }
+
+    stopLogger();
+
+#ifdef _WIN32
     // Winsock 을 정리한다.
     WSACleanup();
-    return 0;
+#endif
+    return r;
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+﻿// HttpParser 와 예전 processRequest() 의 헤더 처리 방식(1바이트 recv + split + trim)을 비교한다.
+//
+// 1. in-memory : syscall 없이 파싱 비용만 비교한다.
+// 2. socketpair: 실제로 소켓에서 읽어오는 비용까지 포함해서 비교한다.
+//
+// 사용법: bench_http_parser [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../http_parser.h"
+#include "../mylib.h"
+
+using namespace std;
+
+static const char* SAMPLE_REQUEST =
+    "POST /api/command HTTP/1.1\r\n"
+    "Host: 127.0.0.1:27016\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Language: ko-KR,ko;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 47\r\n"
+    "\r\n"
+    "{\"command\": \"move\", \"userName\": \"abc\", \"x\": 1}\n";
+
+// 예전 processRequest() 의 헤더/바디 처리를 그대로 옮긴 것이다. (로그 출력만 뺐다)
+// readByte(dst) 는 1바이트를 읽어 dst 에 쓰고, readBody(dst, n) 은 n 바이트를 읽는다.
+template <typename ReadByte, typename ReadBody>
+static size_t legacyParse(ReadByte readByte, ReadBody readBody) {
+    char packet[8192];
+    int offset = 0;
+    int packetLen = 0;
+    bool lenCompleted = false;
+    size_t checksum = 0;
+
+    while (!lenCompleted) {
+        readByte(packet + offset);
+        offset++;
+
+        if (offset >= 2 && packet[offset - 2] == '\r' && packet[offset - 1] == '\n') {
+            if (offset == 2) {
+                lenCompleted = true;
+            } else {
+                packet[offset - 1] = '\0';
+                string field = packet;
+                vector<string> result = split(field, ':');
+                if (result.size() >= 2) {
+                    string key = result[0];
+                    string value = "";
+                    for (size_t i = 1; i < result.size(); ++i) {
+                        value += result[i];
+                    }
+                    trim(value);
+                    checksum += key.size() + value.size();
+                    if (key.compare("Content-Length") == 0) {
+                        packetLen = atoi(value.c_str());
+                    }
+                } else if (result.size() == 1) {
+                    vector<string> result = split(field, ' ');
+                    checksum += result[0].size() + result[1].size() + result[2].size();
+                }
+                fill(packet, packet + offset, (char)0xcc);
+            }
+            offset = 0;
+        }
+    }
+
+    if (packetLen > 0) {
+        readBody(packet, packetLen);
+    }
+    return checksum + packetLen;
+}
+
+static size_t newParse(char* buf, size_t len) {
+    HttpParser parser;
+    HttpRequest req;
+    if (parser.parse(buf, len, req) != HttpParser::COMPLETE) {
+        fprintf(stderr, "parse failed\n");
+        exit(1);
+    }
+    size_t checksum = req.method.size() + req.path.size() + req.version.size();
+    for (int i = 0; i < req.numHeaders; ++i) {
+        checksum += req.headers[i].name.size() + req.headers[i].value.size();
+    }
+    return checksum + req.body.size();
+}
+
+template <typename F>
+static void report(const char* name, int iterations, F f) {
+    auto start = chrono::steady_clock::now();
+    size_t checksum = 0;
+    for (int i = 0; i < iterations; ++i) {
+        checksum += f();
+    }
+    double ns = (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    printf("%-28s %10.1f ns/request  %10.0f requests/s  (checksum %zu)\n",
+        name, ns / iterations, iterations / (ns / 1e9), checksum);
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    size_t len = strlen(SAMPLE_REQUEST);
+
+    // parse() 는 chunked body 를 제자리에서 디코딩하므로 쓰기 가능한 버퍼가 필요하다.
+    char request[8192];
+    memcpy(request, SAMPLE_REQUEST, len);
+    printf("request size: %zu bytes, iterations: %d\n\n", len, iterations);
+
+    // 1. in-memory
+    report("legacy (in-memory)", iterations, [&]() {
+        size_t pos = 0;
+        return legacyParse(
+            [&](char* dst) { *dst = SAMPLE_REQUEST[pos++]; },
+            [&](char* dst, int n) { memcpy(dst, SAMPLE_REQUEST + pos, n); pos += n; });
+    });
+    report("HttpParser (in-memory)", iterations, [&]() {
+        return newParse(request, len);
+    });
+
+    // 요청이 아무 곳에서나 쪼개져 오는 경우: 바이트마다 parse() 를 다시 부른다.
+    report("HttpParser (1B fragments)", iterations / 10, [&]() {
+        HttpParser parser;
+        HttpRequest req;
+        for (size_t i = 1; i <= len; ++i) {
+            if (parser.parse(request, i, req) == HttpParser::COMPLETE) {
+                return (size_t)req.numHeaders;
+            }
+        }
+        fprintf(stderr, "fragmented parse failed\n");
+        exit(1);
+    });
+
+    // 2. socketpair
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    int sockIterations = iterations / 10;
+    report("legacy (1B recv syscalls)", sockIterations, [&]() {
+        if (send(sv[0], SAMPLE_REQUEST, len, 0) != (ssize_t)len) {
+            exit(1);
+        }
+        return legacyParse(
+            [&](char* dst) { recv(sv[1], dst, 1, 0); },
+            [&](char* dst, int n) {
+                int got = 0;
+                while (got < n) {
+                    got += (int)recv(sv[1], dst + got, n - got, 0);
+                }
+            });
+    });
+    report("HttpParser (single recv)", sockIterations, [&]() {
+        if (send(sv[0], SAMPLE_REQUEST, len, 0) != (ssize_t)len) {
+            exit(1);
+        }
+        char buf[8192];
+        size_t got = 0;
+        while (got < len) {
+            got += recv(sv[1], buf + got, sizeof(buf) - got, 0);
+        }
+        return newParse(buf, got);
+    });
+
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
@@ -0,0 +1,107 @@
+﻿// JSON 파싱과 직렬화 비용을 잰다.
+//
+// 1. parse    : POST /command 의 body 를 JsonDocument 로 파싱하고 값 몇 개를 꺼낸다.
+// 2. serialize: GET /position 의 응답(헤더 + JSON body)을 JsonWriter 로 재사용하는 버퍼에 쓴다.
+//               예전 방식(ostringstream 으로 문자열을 만들어서 이어 붙이기)과 비교한다.
+//
+// 사용법: bench_json [iterations] [body_size]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "../json.h"
+
+using namespace std;
+
+static inline uint64_t nowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, uint64_t ns, int iterations, size_t checksum) {
+    printf("%-28s %10.1f ns/op  %10.0f ops/s  (checksum %zu)\n",
+        name, (double)ns / iterations, iterations * 1e9 / ns, checksum);
+}
+
+// 예전 응답 작성 방식. body 문자열을 만든 뒤 헤더 문자열에 이어 붙인다.
+static string oldPositionResponse(int64_t x, int64_t y) {
+    ostringstream body;
+    body << "{\"tag\":\"position\",\"x\":" << x << ",\"y\":" << y << "}";
+    string b = body.str();
+    ostringstream response;
+    response << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << b.size() << "\r\n\r\n" << b;
+    return response.str();
+}
+
+// 서버의 appendJsonResponse() 와 같은 방식. Content-Length 자리를 비워두고 body 를 쓴 뒤에 채운다.
+static void newPositionResponse(string& out, int64_t x, int64_t y) {
+    static const size_t LENGTH_DIGITS = 20;
+    out.append("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ");
+    size_t lengthPos = out.size();
+    out.append(LENGTH_DIGITS, ' ');
+    out.append("\r\n\r\n");
+
+    size_t bodyStart = out.size();
+    JsonWriter w(out);
+    w.beginObject();
+    w.key("tag");
+    w.value("position");
+    w.key("x");
+    w.value(x);
+    w.key("y");
+    w.value(y);
+    w.endObject();
+
+    char buffer[32];
+    int len = snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)(out.size() - bodyStart));
+    memcpy(&out[lengthPos], buffer, len);
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+    size_t bodySize = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+
+    // {"command": "move", "userName": "xxx...", "x": 1, "y": 2} 를 bodySize 에 맞춘다.
+    string body = "{\"command\": \"move\", \"userName\": \"\", \"x\": 1, \"y\": 2}";
+    if (bodySize > body.size()) {
+        body.insert(body.find("\"\"") + 1, bodySize - body.size(), 'x');
+    }
+    printf("body: %zu bytes, iterations: %d\n\n", body.size(), iterations);
+
+    JsonDocument doc;
+    size_t checksum = 0;
+    uint64_t start = nowNs();
+    for (int i = 0; i < iterations; ++i) {
+        if (!doc.parse(body)) {
+            fprintf(stderr, "parse failed: %s\n", doc.errorMessage());
+            return 1;
+        }
+        JsonValue root = doc.root();
+        int64_t x = 0;
+        root["x"].getInt64(x);
+        checksum += (size_t)x + root["command"].equals("move") + root["userName"].raw().size();
+    }
+    report("parse (JsonDocument)", nowNs() - start, iterations, checksum);
+
+    checksum = 0;
+    start = nowNs();
+    for (int i = 0; i < iterations; ++i) {
+        string response = oldPositionResponse(i, -i);
+        checksum += response.size();
+    }
+    report("serialize (ostringstream)", nowNs() - start, iterations, checksum);
+
+    checksum = 0;
+    string out;
+    start = nowNs();
+    for (int i = 0; i < iterations; ++i) {
+        out.clear();
+        newPositionResponse(out, i, -i);
+        checksum += out.size();
+    }
+    report("serialize (JsonWriter)", nowNs() - start, iterations, checksum);
+    return 0;
+}
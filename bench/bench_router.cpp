@@ -0,0 +1,157 @@
+﻿// Router(radix tree)와 route 목록을 처음부터 차례로 비교하는 단순한 방식의 경로 찾기 비용을 비교한다.
+//
+// resource 마다 6개씩 route 를 만들고(기본 50개 -> 300 route), 등록된 경로와 없는 경로를 섞어서 찾는다.
+//
+// 사용법: bench_router [resources] [lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../router.h"
+
+using namespace std;
+
+static inline uint64_t nowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 비교 대상: route 를 등록 순서대로 하나씩 '/' 구간 단위로 비교한다. {name} 구간은 아무 값과 맞는다.
+class LinearRouter {
+public:
+    void add(string_view method, string_view pattern) {
+        routes.push_back(Route { string(method), string(pattern) });
+    }
+
+    int match(string_view method, string_view path, RouteParams& params) const {
+        for (size_t i = 0; i < routes.size(); ++i) {
+            if (routes[i].method == method && matchPattern(routes[i].pattern, path, params)) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+private:
+    struct Route {
+        string method;
+        string pattern;
+    };
+
+    static bool matchPattern(string_view pattern, string_view path, RouteParams& params) {
+        params.count = 0;
+        while (!pattern.empty() && !path.empty()) {
+            size_t pe = pattern.find('/', 1);
+            size_t se = path.find('/', 1);
+            string_view pseg = pattern.substr(0, pe);
+            string_view sseg = path.substr(0, se);
+            if (pseg.size() > 1 && pseg[1] == '{') {
+                if (sseg.size() < 2 || params.count >= RouteParams::MAX_PARAMS) {
+                    return false;
+                }
+                RouteParams::Param& p = params.params[params.count++];
+                p.name = pseg.substr(2, pseg.size() - 3);
+                p.value = sseg.substr(1);
+            } else if (pseg != sseg) {
+                return false;
+            }
+            pattern = pe == string_view::npos ? string_view() : pattern.substr(pe);
+            path = se == string_view::npos ? string_view() : path.substr(se);
+        }
+        return pattern.empty() && path.empty();
+    }
+
+    vector<Route> routes;
+};
+
+int main(int argc, char* argv[]) {
+    int numResources = argc > 1 ? atoi(argv[1]) : 50;
+    int numLookups = argc > 2 ? atoi(argv[2]) : 2000000;
+
+    Router router;
+    LinearRouter linear;
+    RouteHandler noop = [](const HttpRequest&, const RouteParams&, ResponseBatch&) {};
+
+    static const char* PATTERNS[][2] = {
+        { "GET", "/api/v1/%s" },
+        { "POST", "/api/v1/%s" },
+        { "GET", "/api/v1/%s/{id}" },
+        { "PUT", "/api/v1/%s/{id}" },
+        { "DELETE", "/api/v1/%s/{id}" },
+        { "GET", "/api/v1/%s/{id}/items/{item}" },
+    };
+
+    char buf[256];
+    vector<string> names;
+    for (int r = 0; r < numResources; ++r) {
+        snprintf(buf, sizeof(buf), "resource%d", r);
+        names.push_back(buf);
+        for (auto& p : PATTERNS) {
+            snprintf(buf, sizeof(buf), p[1], names.back().c_str());
+            if (!router.add(p[0], buf, noop)) {
+                printf("add failed: %s %s\n", p[0], buf);
+                return 1;
+            }
+            linear.add(p[0], buf);
+        }
+    }
+
+    // 찾을 경로들. 8개 중 1개는 없는 경로다.
+    vector<pair<string, string> > lookups;
+    for (int i = 0; i < 4096; ++i) {
+        const string& name = names[(i * 7919) % numResources];
+        switch (i % 8) {
+        case 0: snprintf(buf, sizeof(buf), "/api/v1/%s", name.c_str()); lookups.push_back(make_pair("GET", buf)); break;
+        case 1: snprintf(buf, sizeof(buf), "/api/v1/%s", name.c_str()); lookups.push_back(make_pair("POST", buf)); break;
+        case 2: snprintf(buf, sizeof(buf), "/api/v1/%s/%d", name.c_str(), i); lookups.push_back(make_pair("GET", buf)); break;
+        case 3: snprintf(buf, sizeof(buf), "/api/v1/%s/%d", name.c_str(), i); lookups.push_back(make_pair("PUT", buf)); break;
+        case 4: snprintf(buf, sizeof(buf), "/api/v1/%s/%d?verbose=1", name.c_str(), i); lookups.push_back(make_pair("DELETE", buf)); break;
+        case 5:
+        case 6: snprintf(buf, sizeof(buf), "/api/v1/%s/%d/items/abc%d", name.c_str(), i, i); lookups.push_back(make_pair("GET", buf)); break;
+        default: snprintf(buf, sizeof(buf), "/api/v2/%s/%d", name.c_str(), i); lookups.push_back(make_pair("GET", buf)); break;
+        }
+    }
+    printf("%zu routes, %d lookups\n\n", router.size(), numLookups);
+
+    // 두 방식의 결과(찾았는지, 변수 개수)가 같은지 먼저 확인한다. 단순한 방식은 query string 을 떼지 않으므로 여기서 뗀다.
+    for (auto& l : lookups) {
+        string_view path = l.second;
+        path = path.substr(0, path.find('?'));
+        const RouteHandler* handler = NULL;
+        RouteParams a, b;
+        int status = router.match(l.first, path, handler, a);
+        int index = linear.match(l.first, path, b);
+        if ((status == 200) != (index >= 0) || (status == 200 && a.count != b.count)) {
+            printf("mismatch: %s %s\n", l.first.c_str(), l.second.c_str());
+            return 1;
+        }
+    }
+
+    size_t hits = 0;
+    uint64_t start = nowNs();
+    for (int i = 0; i < numLookups; ++i) {
+        auto& l = lookups[i & 4095];
+        const RouteHandler* handler = NULL;
+        RouteParams params;
+        hits += router.match(l.first, l.second, handler, params) == 200;
+    }
+    uint64_t radixNs = nowNs() - start;
+
+    size_t linearHits = 0;
+    start = nowNs();
+    for (int i = 0; i < numLookups; ++i) {
+        auto& l = lookups[i & 4095];
+        string_view path = l.second;
+        path = path.substr(0, path.find('?'));
+        RouteParams params;
+        linearHits += linear.match(l.first, path, params) >= 0;
+    }
+    uint64_t linearNs = nowNs() - start;
+
+    printf("radix  : %7.1f ns/lookup (%zu hits)\n", (double)radixNs / numLookups, hits);
+    printf("linear : %7.1f ns/lookup (%zu hits)\n", (double)linearNs / numLookups, linearHits);
+    return 0;
+}
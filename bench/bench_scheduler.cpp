@@ -0,0 +1,94 @@
+﻿// MutexScheduler(예전 std::queue + mutex 방식)와 WorkStealingScheduler 를 비교한다.
+//
+// producer 쓰레드 하나가 main 쓰레드처럼 작업을 burst 단위로 넣고, worker 들은 짧은 일을 한다.
+// 작업을 넣은 뒤 worker 가 꺼내갈 때까지의 시간(dispatch latency)과 전체 처리량을 잰다.
+//
+// 사용법: bench_scheduler [workers] [jobs] [burst] [work_ns]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../scheduler.h"
+
+using namespace std;
+
+static inline uint64_t nowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void spinFor(uint64_t ns) {
+    uint64_t end = nowNs() + ns;
+    while (nowNs() < end) {
+    }
+}
+
+static void run(Scheduler* scheduler, int numWorkers, int numJobs, int burst, uint64_t workNs) {
+    vector<uint64_t> submitTime(numJobs);
+    vector<uint64_t> latency(numJobs);
+    atomic<int> done(0);
+
+    vector<thread> workers;
+    for (int w = 0; w < numWorkers; ++w) {
+        workers.push_back(thread([&, w]() {
+            uint64_t job;
+            while (scheduler->take(w, job)) {
+                latency[job] = nowNs() - submitTime[job];
+                spinFor(workNs);
+                done.fetch_add(1, memory_order_release);
+            }
+        }));
+    }
+
+    uint64_t start = nowNs();
+    for (int i = 0; i < numJobs; ++i) {
+        submitTime[i] = nowNs();
+        scheduler->submit((uint64_t)i);
+
+        // burst 사이에는 쉬어서 worker 들이 잠들었다가 깨어나는 경로를 타게 한다.
+        if ((i + 1) % burst == 0) {
+            while (done.load(memory_order_acquire) < i + 1) {
+                this_thread::yield();
+            }
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+    while (done.load(memory_order_acquire) < numJobs) {
+        this_thread::yield();
+    }
+    uint64_t elapsed = nowNs() - start;
+
+    SchedulerStats stats = scheduler->stats();
+    scheduler->stop();
+    for (thread& t : workers) {
+        t.join();
+    }
+
+    sort(latency.begin(), latency.end());
+    printf("%-6s %9.0f jobs/s  dispatch p50 %7.1f us  p99 %8.1f us  max %8.1f us  "
+        "steals %llu parks %llu wakeups %llu max depth %zu\n",
+        scheduler->name(), numJobs / (elapsed / 1e9),
+        latency[numJobs / 2] / 1e3, latency[(size_t)(numJobs * 0.99)] / 1e3, latency[numJobs - 1] / 1e3,
+        (unsigned long long)stats.steals, (unsigned long long)stats.parks, (unsigned long long)stats.wakeups,
+        stats.maxQueueDepth);
+}
+
+int main(int argc, char* argv[]) {
+    int numWorkers = argc > 1 ? atoi(argv[1]) : 3;
+    int numJobs = argc > 2 ? atoi(argv[2]) : 200000;
+    int burst = argc > 3 ? atoi(argv[3]) : 64;
+    uint64_t workNs = argc > 4 ? strtoull(argv[4], NULL, 10) : 2000;
+    printf("workers %d, jobs %d, burst %d, work %llu ns\n\n", numWorkers, numJobs, burst, (unsigned long long)workNs);
+
+    unique_ptr<Scheduler> mutexScheduler(new MutexScheduler());
+    run(mutexScheduler.get(), numWorkers, numJobs, burst, workNs);
+
+    unique_ptr<Scheduler> stealScheduler(new WorkStealingScheduler(numWorkers));
+    run(stealScheduler.get(), numWorkers, numJobs, burst, workNs);
+    return 0;
+}
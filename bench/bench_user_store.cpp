@@ -0,0 +1,152 @@
+﻿// UserStore 와 mutex 하나로 감싼 unordered_map 을 쓰레드 수를 늘려가며 비교한다.
+//
+// 사용자들을 미리 넣어두고, 쓰레드마다 무작위 이름으로 get 을 하다가 write_percent % 는 update 를 한다.
+// hot 을 주면 모든 쓰레드가 한 사용자만 본다. (가장 심한 경합)
+//
+// 사용법: bench_user_store [max_threads] [users] [write_percent] [duration_ms] [hot]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../user_store.h"
+
+using namespace std;
+
+static const uint64_t TTL_MS = 600 * 1000;
+
+// 비교 대상: 가장 먼저 떠올릴 만한 방법
+class MutexUserMap {
+public:
+    const char* name() const { return "mutex"; }
+
+    bool get(const string& name, UserState& state) {
+        lock_guard<mutex> guard(lock);
+        unordered_map<string, UserState>::iterator it = users.find(name);
+        if (it == users.end()) {
+            return false;
+        }
+        state = it->second;
+        return true;
+    }
+
+    void update(const string& name) {
+        lock_guard<mutex> guard(lock);
+        ++users[name].commands;
+    }
+
+private:
+    mutex lock;
+    unordered_map<string, UserState> users;
+};
+
+class ShardedUserStore {
+public:
+    explicit ShardedUserStore(size_t capacity) { store.configure(capacity); }
+
+    const char* name() const { return "store"; }
+
+    bool get(const string& name, UserState& state) { return store.get(name, state); }
+
+    void update(const string& name) {
+        store.update(name, TTL_MS, [](UserState& s) { ++s.commands; });
+    }
+
+private:
+    UserStore store;
+};
+
+// xorshift64
+static inline uint64_t nextRandom(uint64_t& s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+template <class Map>
+static double run(Map& map, const vector<string>& names, int numThreads, int writePercent, int durationMs) {
+    atomic<bool> stop(false);
+    atomic<uint64_t> totalOps(0);
+    atomic<uint64_t> misses(0);
+
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.push_back(thread([&, t]() {
+            uint64_t seed = 0x9e3779b97f4a7c15ULL * (t + 1);
+            uint64_t ops = 0;
+            uint64_t missed = 0;
+            UserState state;
+            while (!stop.load(memory_order_relaxed)) {
+                // 시간 확인을 줄이려고 조금씩 묶어서 한다.
+                for (int i = 0; i < 256; ++i) {
+                    uint64_t r = nextRandom(seed);
+                    const string& name = names[r % names.size()];
+                    if ((int)((r >> 32) % 100) < writePercent) {
+                        map.update(name);
+                    } else if (!map.get(name, state)) {
+                        ++missed;
+                    }
+                }
+                ops += 256;
+            }
+            totalOps.fetch_add(ops);
+            misses.fetch_add(missed);
+        }));
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(durationMs));
+    stop.store(true);
+    for (thread& t : threads) {
+        t.join();
+    }
+    if (misses.load() > 0) {
+        printf("  (%llu lookups missed)\n", (unsigned long long)misses.load());
+    }
+    return totalOps.load() / (durationMs / 1e3);
+}
+
+int main(int argc, char* argv[]) {
+    int maxThreads = argc > 1 ? atoi(argv[1]) : (int)thread::hardware_concurrency();
+    int numUsers = argc > 2 ? atoi(argv[2]) : 10000;
+    int writePercent = argc > 3 ? atoi(argv[3]) : 5;
+    int durationMs = argc > 4 ? atoi(argv[4]) : 500;
+    bool hot = argc > 5 && strcmp(argv[5], "hot") == 0;
+    if (maxThreads < 1) {
+        maxThreads = 1;
+    }
+    printf("users %d, writes %d%%, %d ms per run%s\n\n", numUsers, writePercent, durationMs, hot ? ", one hot user" : "");
+
+    vector<string> names;
+    for (int i = 0; i < numUsers; ++i) {
+        names.push_back("user" + to_string(i));
+    }
+
+    MutexUserMap mutexMap;
+    ShardedUserStore store((size_t)numUsers * 2);
+    for (const string& name : names) {
+        mutexMap.update(name);
+        store.update(name);
+    }
+    if (hot) {
+        names.resize(1);
+    }
+
+    printf("%-8s %14s %14s\n", "threads", "mutex ops/s", "store ops/s");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double a = run(mutexMap, names, threads, writePercent, durationMs);
+        double b = run(store, names, threads, writePercent, durationMs);
+        printf("%-8d %14.0f %14.0f\n", threads, a, b);
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    return 0;
+}
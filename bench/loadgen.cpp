@@ -0,0 +1,374 @@
+﻿// 서버에 부하를 거는 HTTP 클라이언트. loopback 주소로만 연결한다.
+//
+// 쓰레드마다 연결 여러 개를 poll() 로 돌린다. 연결마다 response 를 기다리는 request 가 --pipeline 개가 되도록
+// 계속 보내고(closed loop), request 를 보낸 시각부터 response 를 다 받은 시각까지를 지연 시간으로 잰다.
+// --fragment 를 주면 request 를 그 크기로 잘라 따로따로 send 해서 서버의 partial recv 경로를 지나가게 한다.
+//
+// 사용법: loadgen [--host 127.0.0.1] [--port 27016] [--threads 2] [--connections 32] [--duration 10]
+//                 [--pipeline 1] [--post-ratio 0] [--body-size 64] [--fragment 0] [--fragment-delay-us 0]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../metrics.h"
+
+using namespace std;
+
+struct LoadConfig {
+    LoadConfig() : host("127.0.0.1"), port(27016), threads(2), connections(32), duration(10), pipeline(1),
+        postRatio(0), bodySize(64), fragment(0), fragmentDelayUs(0) {}
+
+    const char* host;
+    int port;
+    int threads;
+    int connections;
+    double duration;
+    int pipeline;
+    double postRatio;     // POST /command 의 비율. 나머지는 GET /position
+    size_t bodySize;      // POST body(JSON) 의 크기
+    size_t fragment;      // 0 이 아니면 request 를 이 크기로 잘라서 보낸다.
+    int fragmentDelayUs;  // 조각 사이에 쉬는 시간
+};
+
+// 쓰레드 하나의 결과
+struct LoadResult {
+    LoadResult() : requests(0), errors(0), non2xx(0), bytesIn(0), bytesOut(0) {}
+
+    uint64_t requests;  // response 를 받은 request
+    uint64_t errors;    // 연결 실패, 끊김, 잘못된 response
+    uint64_t non2xx;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    LatencyHistogram latency;
+};
+
+struct Connection {
+    int fd;
+    string in;               // 받았지만 아직 다 해석하지 못한 response
+    deque<uint64_t> sentNs;  // response 를 기다리는 request 들을 보낸 시각
+};
+
+// 모든 쓰레드가 연결을 다 맺은 뒤에 동시에 시작한다. (listen backlog 가 작으면 연결에만 몇 초가 걸릴 수 있다)
+static atomic<int> connectedThreads(0);
+static atomic<bool> started(false);
+static atomic<bool> stopping(false);
+
+static const string& getRequest() {
+    static const string request =
+        "GET /position HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "\r\n";
+    return request;
+}
+
+// {"command": "echo", "userName": "loadgen", "data": "xxxx..."} 를 bodySize 에 맞춰 만든다.
+// userName 은 서버의 user store 에 들어가므로 길이 제한이 있어 data 로 채운다.
+static string postRequest(size_t bodySize) {
+    string body = "{\"command\": \"echo\", \"userName\": \"loadgen\", \"data\": \"\"}";
+    if (bodySize > body.size()) {
+        body.insert(body.size() - 2, bodySize - body.size(), 'x');
+    }
+    char header[256];
+    snprintf(header, sizeof(header),
+        "POST /command HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %zu\r\n"
+        "\r\n", body.size());
+    return header + body;
+}
+
+static bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static int connectTo(const LoadConfig& config) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)config.port);
+    inet_pton(AF_INET, config.host, &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 버퍼 앞에 완성된 response 가 있으면 그 길이를, 아직 덜 왔으면 0 을, 잘못되었으면 -1 을 반환한다.
+static long parseResponse(string_view in, int& status) {
+    size_t end = in.find("\r\n\r\n");
+    if (end == string_view::npos) {
+        return 0;
+    }
+    if (in.compare(0, 9, "HTTP/1.1 ") != 0 || end < 12) {
+        return -1;
+    }
+    status = atoi(in.data() + 9);
+
+    // 서버는 항상 Content-Length 를 보낸다. (헤더 끝의 "\r\n\r\n" 이 숫자 뒤에서 strtoul 을 멈춘다)
+    size_t contentLength = 0;
+    size_t pos = 0;
+    while ((pos = in.find("\r\n", pos)) != string_view::npos && pos < end) {
+        pos += 2;
+        if (strncasecmp(in.data() + pos, "Content-Length:", 15) == 0) {
+            contentLength = strtoul(in.data() + pos + 15, NULL, 10);
+            break;
+        }
+    }
+    size_t total = end + 4 + contentLength;
+    return in.size() >= total ? (long)total : 0;
+}
+
+static void loadThreadProc(const LoadConfig& config, int numConnections, unsigned seed, LoadResult& result) {
+    const string& get = getRequest();
+    const string post = postRequest(config.bodySize);
+
+    vector<Connection> conns(numConnections);
+    vector<pollfd> fds(numConnections);
+    for (int i = 0; i < numConnections; ++i) {
+        conns[i].fd = connectTo(config);
+        if (conns[i].fd < 0) {
+            ++result.errors;
+        }
+        fds[i].fd = conns[i].fd;
+        fds[i].events = POLLIN;
+    }
+    connectedThreads.fetch_add(1);
+    while (!started.load()) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    string out;
+    char buf[65536];
+    while (!stopping.load(memory_order_relaxed)) {
+        // 기다리는 request 가 pipeline 개가 되도록 채운다.
+        for (Connection& c : conns) {
+            if (c.fd < 0 || (int)c.sentNs.size() >= config.pipeline) {
+                continue;
+            }
+            out.clear();
+            while ((int)c.sentNs.size() < config.pipeline) {
+                seed = seed * 1103515245 + 12345;
+                bool isPost = (seed >> 16) % 1000 < config.postRatio * 1000;
+                out += isPost ? post : get;
+                c.sentNs.push_back(metricsNowNs());
+            }
+
+            bool ok = true;
+            if (config.fragment == 0) {
+                ok = sendAll(c.fd, out.data(), out.size());
+            } else {
+                for (size_t off = 0; ok && off < out.size(); off += config.fragment) {
+                    ok = sendAll(c.fd, out.data() + off, min(config.fragment, out.size() - off));
+                    if (config.fragmentDelayUs > 0) {
+                        this_thread::sleep_for(chrono::microseconds(config.fragmentDelayUs));
+                    }
+                }
+            }
+            if (!ok) {
+                ++result.errors;
+                close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            result.bytesOut += out.size();
+        }
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            fds[i].fd = conns[i].fd;
+        }
+        if (poll(fds.data(), fds.size(), 100) <= 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            Connection& c = conns[i];
+            if (c.fd < 0 || !(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+                continue;
+            }
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                ++result.errors;
+                close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            result.bytesIn += (size_t)n;
+            c.in.append(buf, (size_t)n);
+
+            // 받은 response 들을 앞에서부터 떼어낸다.
+            size_t consumed = 0;
+            uint64_t now = metricsNowNs();
+            while (!c.sentNs.empty()) {
+                int status = 0;
+                long len = parseResponse(string_view(c.in).substr(consumed), status);
+                if (len <= 0) {
+                    if (len < 0) {
+                        ++result.errors;
+                        close(c.fd);
+                        c.fd = -1;
+                    }
+                    break;
+                }
+                consumed += (size_t)len;
+                result.latency.record(now - c.sentNs.front());
+                c.sentNs.pop_front();
+                ++result.requests;
+                if (status < 200 || status >= 300) {
+                    ++result.non2xx;
+                }
+            }
+            c.in.erase(0, consumed);
+        }
+    }
+
+    for (Connection& c : conns) {
+        if (c.fd >= 0) {
+            close(c.fd);
+        }
+    }
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <ipv4>             loopback address of the server (default 127.0.0.1)\n"
+        "  --port <n>                (default 27016)\n"
+        "  --threads <n>             client threads (default 2)\n"
+        "  --connections <n>         connections in total (default 32)\n"
+        "  --duration <seconds>      (default 10)\n"
+        "  --pipeline <n>            requests in flight per connection (default 1)\n"
+        "  --post-ratio <0..1>       share of POST /command, the rest is GET /position (default 0)\n"
+        "  --body-size <bytes>       JSON body size of POST requests (default 64)\n"
+        "  --fragment <bytes>        send requests in pieces of this size (default 0: whole)\n"
+        "  --fragment-delay-us <us>  pause between pieces (default 0)\n", program);
+}
+
+static bool parseArgs(int argc, char* argv[], LoadConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[++i] : NULL;
+        if (!value) {
+            return false;
+        }
+        if (strcmp(name, "--host") == 0) {
+            config.host = value;
+        } else if (strcmp(name, "--port") == 0) {
+            config.port = atoi(value);
+        } else if (strcmp(name, "--threads") == 0) {
+            config.threads = atoi(value);
+        } else if (strcmp(name, "--connections") == 0) {
+            config.connections = atoi(value);
+        } else if (strcmp(name, "--duration") == 0) {
+            config.duration = atof(value);
+        } else if (strcmp(name, "--pipeline") == 0) {
+            config.pipeline = atoi(value);
+        } else if (strcmp(name, "--post-ratio") == 0) {
+            config.postRatio = atof(value);
+        } else if (strcmp(name, "--body-size") == 0) {
+            config.bodySize = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "--fragment") == 0) {
+            config.fragment = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "--fragment-delay-us") == 0) {
+            config.fragmentDelayUs = atoi(value);
+        } else {
+            return false;
+        }
+    }
+
+    // 다른 호스트에 부하를 거는 일이 없도록 loopback(127.0.0.0/8)만 허용한다.
+    in_addr addr;
+    if (inet_pton(AF_INET, config.host, &addr) != 1 || (ntohl(addr.s_addr) >> 24) != 127) {
+        fprintf(stderr, "--host must be a loopback IPv4 address\n");
+        return false;
+    }
+    return config.threads > 0 && config.connections >= config.threads && config.pipeline > 0
+        && config.duration > 0 && config.postRatio >= 0 && config.postRatio <= 1;
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    printf("%s:%d, %d threads, %d connections, pipeline %d, post ratio %.2f, body %zu bytes, fragment %zu, %.1f s\n",
+        config.host, config.port, config.threads, config.connections, config.pipeline, config.postRatio,
+        config.bodySize, config.fragment, config.duration);
+
+    vector<LoadResult*> results;
+    vector<thread> threads;
+    for (int t = 0; t < config.threads; ++t) {
+        // 연결을 쓰레드에 고르게 나눈다.
+        int numConnections = config.connections / config.threads + (t < config.connections % config.threads ? 1 : 0);
+        results.push_back(new LoadResult());
+        threads.emplace_back(loadThreadProc, cref(config), numConnections, 12345u + t, ref(*results.back()));
+    }
+
+    uint64_t connectStart = metricsNowNs();
+    while (connectedThreads.load() < config.threads) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    uint64_t start = metricsNowNs();
+    printf("connected  : %.1f ms\n", (start - connectStart) / 1e6);
+    started.store(true);
+    this_thread::sleep_for(chrono::duration<double>(config.duration));
+    stopping.store(true);
+    for (thread& t : threads) {
+        t.join();
+    }
+    double seconds = (metricsNowNs() - start) / 1e9;
+
+    LoadResult total;
+    for (LoadResult* r : results) {
+        total.requests += r->requests;
+        total.errors += r->errors;
+        total.non2xx += r->non2xx;
+        total.bytesIn += r->bytesIn;
+        total.bytesOut += r->bytesOut;
+        r->latency.mergeInto(total.latency);
+        delete r;
+    }
+
+    printf("requests   : %llu (%llu non-2xx, %llu errors)\n",
+        (unsigned long long)total.requests, (unsigned long long)total.non2xx, (unsigned long long)total.errors);
+    printf("throughput : %.0f requests/s, in %.1f MB/s, out %.1f MB/s\n",
+        total.requests / seconds, total.bytesIn / seconds / 1e6, total.bytesOut / seconds / 1e6);
+    printf("latency    : p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+        total.latency.percentile(0.5) / 1e3, total.latency.percentile(0.99) / 1e3,
+        total.latency.percentile(0.999) / 1e3, total.latency.max() / 1e3);
+    return total.errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+# 벤치마크를 모두 빌드하고 돌린다.
+#
+# 1. microbenchmark: HTTP 파서, JSON 파싱/직렬화, router, scheduler, user store
+# 2. 부하 테스트: 서버를 127.0.0.1:27016 에 띄우고 loadgen 으로 시나리오별 처리량과 지연 시간을 잰다.
+#
+# 사용법: bench/run_bench.sh [build_dir] [duration_seconds] [server options...]
+#   예) bench/run_bench.sh build 5 --mode sharded --threads 4
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-"$ROOT/build-bench"}
+DURATION=${2:-5}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release >/dev/null
+cmake --build "$BUILD" -j"$(nproc 2>/dev/null || echo 4)" >/dev/null
+
+echo "== microbenchmarks"
+"$BUILD/bench_http_parser"
+echo
+"$BUILD/bench_json"
+echo
+"$BUILD/bench_router"
+echo
+"$BUILD/bench_scheduler"
+echo
+"$BUILD/bench_user_store"
+echo
+
+if ss -tanH '( sport = :27016 )' 2>/dev/null | grep -q LISTEN; then
+    echo "port 27016 is already in use" >&2
+    exit 1
+fi
+
+echo "== server: $*"
+"$BUILD/TCP_REST_API_Server" --log-level warn "$@" >"$BUILD/server.log" 2>&1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null' EXIT
+sleep 0.5
+
+run() {
+    echo
+    echo "-- $1"
+    shift
+    "$BUILD/loadgen" --duration "$DURATION" "$@"
+}
+
+run "GET, 64 connections"                     --threads 2 --connections 64
+run "GET, 64 connections, pipeline 16"        --threads 2 --connections 64 --pipeline 16
+run "POST 1 KB JSON, 64 connections"          --threads 2 --connections 64 --post-ratio 1 --body-size 1024
+run "mixed 50% POST, pipeline 4"              --threads 2 --connections 64 --pipeline 4 --post-ratio 0.5
+run "fragmented (7 byte pieces), POST 256 B"  --threads 2 --connections 16 --post-ratio 1 --body-size 256 --fragment 7
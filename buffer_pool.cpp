@@ -0,0 +1,121 @@
+﻿#include "buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// BufferPool
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool() : maxCachedPerClass(1024) {
+}
+
+BufferPool::~BufferPool() {
+    for (int i = 0; i < NUM_CLASSES; ++i) {
+        for (char* chunk : classes[i].freeChunks) {
+            delete[] chunk;
+        }
+    }
+}
+
+// size 를 담을 수 있는 가장 작은 class. 모든 class 보다 크면 -1.
+int BufferPool::classIndex(size_t size) {
+    size_t classSize = MIN_CLASS_SIZE;
+    for (int i = 0; i < NUM_CLASSES; ++i) {
+        if (size <= classSize) {
+            return i;
+        }
+        classSize <<= 1;
+    }
+    return -1;
+}
+
+char* BufferPool::acquire(size_t size, size_t& capacity) {
+    int index = classIndex(size);
+    if (index < 0) {
+        capacity = size;
+        return new char[size];
+    }
+
+    capacity = MIN_CLASS_SIZE << index;
+    {
+        SizeClass& sc = classes[index];
+        lock_guard<mutex> lg(sc.m);
+        if (!sc.freeChunks.empty()) {
+            char* chunk = sc.freeChunks.back();
+            sc.freeChunks.pop_back();
+            return chunk;
+        }
+    }
+    return new char[capacity];
+}
+
+void BufferPool::release(char* chunk, size_t capacity) {
+    int index = classIndex(capacity);
+    if (index >= 0 && (MIN_CLASS_SIZE << index) == capacity) {
+        SizeClass& sc = classes[index];
+        lock_guard<mutex> lg(sc.m);
+        if (sc.freeChunks.size() < maxCachedPerClass) {
+            sc.freeChunks.push_back(chunk);
+            return;
+        }
+    }
+    delete[] chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ConnBuffer
+
+ConnBuffer::ConnBuffer(size_t limit) : buf(NULL), cap(0), len(0), maxSize(limit) {
+}
+
+ConnBuffer::~ConnBuffer() {
+    if (buf) {
+        BufferPool::instance().release(buf, cap);
+    }
+}
+
+bool ConnBuffer::reserve(size_t minFree) {
+    if (writable() >= minFree) {
+        return true;
+    }
+    if (cap >= maxSize) {
+        return writable() > 0;
+    }
+
+    // 두 배씩 키우되 limit 을 넘지 않는다.
+    size_t want = max(len + minFree, max(cap * 2, BufferPool::MIN_CLASS_SIZE));
+    want = min(want, maxSize);
+
+    size_t newCap = 0;
+    char* newBuf = BufferPool::instance().acquire(want, newCap);
+    if (buf) {
+        memcpy(newBuf, buf, len);
+        BufferPool::instance().release(buf, cap);
+    }
+    buf = newBuf;
+    cap = newCap;
+    return writable() > 0;
+}
+
+void ConnBuffer::erase(size_t off, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    memmove(buf + off, buf + off + n, len - off - n);
+    len -= n;
+}
+
+void ConnBuffer::releaseIfEmpty() {
+    if (len == 0 && buf) {
+        BufferPool::instance().release(buf, cap);
+        buf = NULL;
+        cap = 0;
+    }
+}
@@ -0,0 +1,85 @@
+﻿#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// 크기별(size class)로 메모리 조각을 재사용하는 pool.
+// 2KB 부터 두 배씩 커지는 class 가 있고, 가장 큰 class 보다 큰 요청은 pool 을 거치지 않는다.
+class BufferPool {
+public:
+    static const size_t MIN_CLASS_SIZE = 2048;
+    static const int NUM_CLASSES = 10;  // 2KB ~ 1MB
+
+    static BufferPool& instance();
+
+    // size 이상인 조각을 하나 빌린다. 실제 크기는 capacity 로 돌려준다.
+    char* acquire(size_t size, size_t& capacity);
+
+    // acquire() 로 빌린 조각을 돌려준다. capacity 는 acquire() 가 돌려준 값이어야 한다.
+    void release(char* chunk, size_t capacity);
+
+    // 각 class 별로 재사용을 위해 남겨둘 조각 수. 넘치는 조각은 바로 해제한다.
+    void setMaxCachedPerClass(size_t n) { maxCachedPerClass = n; }
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+    static int classIndex(size_t size);
+
+    struct SizeClass {
+        std::mutex m;
+        std::vector<char*> freeChunks;
+    };
+
+    SizeClass classes[NUM_CLASSES];
+    size_t maxCachedPerClass;
+};
+
+// 연결 하나의 수신 버퍼. BufferPool 에서 조각을 빌려 쓰며 limit 까지 필요한 만큼 커진다.
+// 비어있을 때 release() 를 부르면 조각을 pool 에 돌려주므로, 놀고 있는 연결은 메모리를 잡고 있지 않는다.
+class ConnBuffer {
+public:
+    explicit ConnBuffer(size_t limit);
+    ~ConnBuffer();
+
+    char* data() { return buf; }
+    size_t size() const { return len; }
+    size_t capacity() const { return cap; }
+    size_t limit() const { return maxSize; }
+
+    // pool 의 조각은 2의 거듭제곱 크기라 limit 보다 클 수 있다. 쓸 수 있는 것은 limit 까지다.
+    size_t usable() const { return cap < maxSize ? cap : maxSize; }
+
+    char* writePtr() { return buf + len; }
+    size_t writable() const { return usable() - len; }
+
+    // 최소 minFree 바이트를 쓸 수 있도록 키운다. limit 때문에 그만큼 못 키우면
+    // 가능한 만큼만 키우고, 쓸 공간이 하나도 없으면 false 를 반환한다.
+    bool reserve(size_t minFree);
+
+    // writePtr() 에 n 바이트를 쓴 뒤 호출한다.
+    void commit(size_t n) { len += n; }
+
+    // 앞에서 n 바이트를 지운다.
+    void consume(size_t n) { erase(0, n); }
+
+    // [off, off + n) 을 지우고 뒤를 당긴다.
+    void erase(size_t off, size_t n);
+
+    // 비어있으면 조각을 pool 에 돌려준다.
+    void releaseIfEmpty();
+
+private:
+    ConnBuffer(const ConnBuffer&);
+    ConnBuffer& operator=(const ConnBuffer&);
+
+    char* buf;
+    size_t cap;
+    size_t len;
+    size_t maxSize;
+};
+
+#endif
@@ -0,0 +1,270 @@
+﻿#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+ServerConfig::ServerConfig()
+    : mode(MODE_HANDOFF),
+      ioEngine(IO_ENGINE_POLL),
+      numThreads(3),
+      scheduler(SCHEDULER_STEAL),
+      pinThreads(false),
+      maxBufferBytes(64 * 1024),
+      maxBodyBytes(16 * 1024 * 1024),
+      sendHighWatermark(256 * 1024),
+      sendLowWatermark(64 * 1024),
+      idleTimeoutMs(60 * 1000),
+      headerTimeoutMs(10 * 1000),
+      bodyTimeoutMs(30 * 1000),
+      sendTimeoutMs(30 * 1000),
+      bindAddress("127.0.0.1"),
+      port(27016),
+      listenBacklog(511),
+      reuseAddr(true),
+      reusePort(false),
+      tcpNoDelay(true),
+      deferAcceptSec(0),
+      fastOpenQueue(0),
+      recvBufferBytes(0),
+      sendBufferBytes(0),
+      maxConnections(0),
+      maxQueuedJobs(0),
+      maxInflight(0),
+      codelTargetMs(0),
+      staticPrefix("/static"),
+      responseCacheBytes(0),
+      maxUsers(65536),
+      sessionTtlMs(600 * 1000),
+      logLevel(LOG_LEVEL_INFO),
+      accessLog(false),
+      metrics(false) {
+}
+
+// 10진수 크기 값을 읽는다. k/m 접미사를 붙이면 KB/MB 단위다.
+static bool parseSize(const char* s, size_t& out) {
+    char* end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) {
+        return false;
+    }
+    if (*end == 'k' || *end == 'K') {
+        v *= 1024;
+        ++end;
+    } else if (*end == 'm' || *end == 'M') {
+        v *= 1024 * 1024;
+        ++end;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    out = (size_t)v;
+    return true;
+}
+
+// 초 단위 timeout 을 읽어서 millisecond 로 바꾼다. 0 은 허용하지 않는다.
+static bool parseTimeout(const char* s, uint64_t& outMs) {
+    size_t seconds = 0;
+    if (!parseSize(s, seconds) || seconds == 0 || seconds > 24 * 3600) {
+        return false;
+    }
+    outMs = (uint64_t)seconds * 1000;
+    return true;
+}
+
+// on 이나 off 를 읽는다.
+static bool parseSwitch(const char* s, bool& out) {
+    if (strcmp(s, "on") == 0) {
+        out = true;
+    } else if (strcmp(s, "off") == 0) {
+        out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseServerConfig(int argc, char* argv[], ServerConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        // 값이 없는 플래그
+        if (strcmp(name, "--pin") == 0) {
+            config.pinThreads = true;
+            continue;
+        }
+        if (strcmp(name, "--access-log") == 0) {
+            config.accessLog = true;
+            continue;
+        }
+        if (strcmp(name, "--metrics") == 0) {
+            config.metrics = true;
+            continue;
+        }
+        if (strcmp(name, "--reuse-port") == 0) {
+            config.reusePort = true;
+            continue;
+        }
+
+        bool ok = false;
+        size_t n = 0;
+        if (strcmp(name, "--mode") == 0 && value) {
+            ok = true;
+            if (strcmp(value, "handoff") == 0) {
+                config.mode = MODE_HANDOFF;
+            } else if (strcmp(value, "sharded") == 0) {
+                config.mode = MODE_SHARDED;
+            } else {
+                ok = false;
+            }
+        } else if (strcmp(name, "--io-engine") == 0 && value) {
+            ok = true;
+            if (strcmp(value, "poll") == 0) {
+                config.ioEngine = IO_ENGINE_POLL;
+            } else if (strcmp(value, "uring") == 0) {
+                config.ioEngine = IO_ENGINE_URING;
+            } else {
+                ok = false;
+            }
+        } else if (strcmp(name, "--scheduler") == 0 && value) {
+            ok = true;
+            if (strcmp(value, "mutex") == 0) {
+                config.scheduler = SCHEDULER_MUTEX;
+            } else if (strcmp(value, "steal") == 0) {
+                config.scheduler = SCHEDULER_STEAL;
+            } else {
+                ok = false;
+            }
+        } else if (strcmp(name, "--threads") == 0 && value) {
+            // 0 이면 CPU 수만큼 만든다.
+            ok = parseSize(value, n) && n <= 1024;
+            if (ok) {
+                config.numThreads = n > 0 ? (int)n : (int)max(1u, thread::hardware_concurrency());
+            }
+        } else if (strcmp(name, "--max-buffer") == 0 && value) {
+            ok = parseSize(value, config.maxBufferBytes) && config.maxBufferBytes >= 1024;
+        } else if (strcmp(name, "--max-body") == 0 && value) {
+            ok = parseSize(value, config.maxBodyBytes);
+        } else if (strcmp(name, "--send-high") == 0 && value) {
+            ok = parseSize(value, config.sendHighWatermark) && config.sendHighWatermark > 0;
+        } else if (strcmp(name, "--send-low") == 0 && value) {
+            ok = parseSize(value, config.sendLowWatermark);
+        } else if (strcmp(name, "--idle-timeout") == 0 && value) {
+            ok = parseTimeout(value, config.idleTimeoutMs);
+        } else if (strcmp(name, "--header-timeout") == 0 && value) {
+            ok = parseTimeout(value, config.headerTimeoutMs);
+        } else if (strcmp(name, "--body-timeout") == 0 && value) {
+            ok = parseTimeout(value, config.bodyTimeoutMs);
+        } else if (strcmp(name, "--send-timeout") == 0 && value) {
+            ok = parseTimeout(value, config.sendTimeoutMs);
+        } else if (strcmp(name, "--bind") == 0 && value) {
+            config.bindAddress = value;
+            ok = !config.bindAddress.empty();
+        } else if (strcmp(name, "--port") == 0 && value) {
+            ok = parseSize(value, n) && n > 0 && n <= 65535;
+            config.port = (unsigned short)n;
+        } else if (strcmp(name, "--backlog") == 0 && value) {
+            ok = parseSize(value, n) && n > 0 && n <= 65535;
+            if (ok) {
+                config.listenBacklog = (int)n;
+            }
+        } else if (strcmp(name, "--reuse-addr") == 0 && value) {
+            ok = parseSwitch(value, config.reuseAddr);
+        } else if (strcmp(name, "--nodelay") == 0 && value) {
+            ok = parseSwitch(value, config.tcpNoDelay);
+        } else if (strcmp(name, "--defer-accept") == 0 && value) {
+            ok = parseSize(value, n) && n <= 3600;
+            config.deferAcceptSec = (int)n;
+        } else if (strcmp(name, "--fastopen") == 0 && value) {
+            ok = parseSize(value, n) && n <= 65535;
+            config.fastOpenQueue = (int)n;
+        } else if (strcmp(name, "--rcvbuf") == 0 && value) {
+            ok = parseSize(value, config.recvBufferBytes) && config.recvBufferBytes <= 1024 * 1024 * 1024;
+        } else if (strcmp(name, "--sndbuf") == 0 && value) {
+            ok = parseSize(value, config.sendBufferBytes) && config.sendBufferBytes <= 1024 * 1024 * 1024;
+        } else if (strcmp(name, "--max-connections") == 0 && value) {
+            ok = parseSize(value, config.maxConnections);
+        } else if (strcmp(name, "--max-queue") == 0 && value) {
+            ok = parseSize(value, config.maxQueuedJobs);
+        } else if (strcmp(name, "--max-inflight") == 0 && value) {
+            ok = parseSize(value, config.maxInflight);
+        } else if (strcmp(name, "--codel-target") == 0 && value) {
+            ok = parseSize(value, n);
+            config.codelTargetMs = n;
+        } else if (strcmp(name, "--static-root") == 0 && value) {
+            config.staticRoot = value;
+            ok = !config.staticRoot.empty();
+        } else if (strcmp(name, "--static-prefix") == 0 && value) {
+            // "/" 하나면 모든 경로가 정적 파일이다.
+            config.staticPrefix = value;
+            while (!config.staticPrefix.empty() && config.staticPrefix.back() == '/') {
+                config.staticPrefix.pop_back();
+            }
+            ok = value[0] == '/';
+        } else if (strcmp(name, "--cache-size") == 0 && value) {
+            ok = parseSize(value, config.responseCacheBytes);
+        } else if (strcmp(name, "--max-users") == 0 && value) {
+            ok = parseSize(value, config.maxUsers) && config.maxUsers <= 0xffffffffULL;
+        } else if (strcmp(name, "--session-ttl") == 0 && value) {
+            ok = parseTimeout(value, config.sessionTtlMs);
+        } else if (strcmp(name, "--log-level") == 0 && value) {
+            ok = parseLogLevel(value, config.logLevel);
+        }
+
+        if (!ok) {
+            cerr << "Invalid argument: " << name << (value ? " " : "") << (value ? value : "") << endl;
+            return false;
+        }
+        ++i;
+    }
+
+    if (config.sendLowWatermark > config.sendHighWatermark) {
+        cerr << "--send-low must not be larger than --send-high" << endl;
+        return false;
+    }
+    return true;
+}
+
+void printServerConfigUsage(const char* program) {
+    cerr << "Usage: " << program << " [options]" << endl
+        << "  --mode <handoff|sharded>                 I/O threading model (default handoff)" << endl
+        << "  --io-engine <poll|uring>                 socket I/O via epoll/select or io_uring, uring implies sharded (default poll)" << endl
+        << "  --threads <n>                            worker threads or shards, 0 = one per CPU (default 3)" << endl
+        << "  --scheduler <mutex|steal>                handoff job queue (default steal)" << endl
+        << "  --pin                                    pin shard i to CPU i (sharded mode)" << endl
+        << "  --max-buffer <size>                      per-connection receive buffer limit (default 64k)" << endl
+        << "  --max-body <size>                        request body limit, larger bodies get 413 (default 16m)" << endl
+        << "  --send-high <size>                       stop reading a client with this much unsent output (default 256k)" << endl
+        << "  --send-low <size>                        resume reading once unsent output drops to this (default 64k)" << endl
+        << "  --idle-timeout <seconds>                 close keep-alive connections idle this long (default 60)" << endl
+        << "  --header-timeout <seconds>               408 unless the request headers arrive within this (default 10)" << endl
+        << "  --body-timeout <seconds>                 408 when a request body makes no progress this long (default 30)" << endl
+        << "  --send-timeout <seconds>                 close when the client reads no response bytes this long (default 30)" << endl
+        << "  --bind <address>                         IPv4 address to listen on, 0.0.0.0 = all interfaces (default 127.0.0.1)" << endl
+        << "  --port <n>                               TCP port to listen on (default 27016)" << endl
+        << "  --backlog <n>                            listen backlog (default 511)" << endl
+        << "  --reuse-addr <on|off>                    SO_REUSEADDR on the listener (default on)" << endl
+        << "  --reuse-port                             SO_REUSEPORT in handoff mode too, sharded/uring always set it" << endl
+        << "  --nodelay <on|off>                       TCP_NODELAY on accepted connections (default on)" << endl
+        << "  --defer-accept <seconds>                 TCP_DEFER_ACCEPT, accept once the first data arrives, 0 = off (default 0)" << endl
+        << "  --fastopen <n>                           TCP_FASTOPEN queue length, 0 = off (default 0)" << endl
+        << "  --rcvbuf <size>                          SO_RCVBUF of accepted connections, 0 = OS default (default 0)" << endl
+        << "  --sndbuf <size>                          SO_SNDBUF of accepted connections, 0 = OS default (default 0)" << endl
+        << "  --max-connections <n>                    503 and close new connections beyond this many, 0 = no limit (default 0)" << endl
+        << "  --max-queue <n>                          503 requests while this many jobs wait for a worker, 0 = no limit (default 0)" << endl
+        << "  --max-inflight <n>                       503 a client with this many unsent responses, 0 = no limit (default 0)" << endl
+        << "  --codel-target <ms>                      shed requests when job queue delay stays above this, 0 = off (default 0)" << endl
+        << "  --static-root <dir>                      serve files under this directory (default none)" << endl
+        << "  --static-prefix <path>                   URL path the static files are served under (default /static)" << endl
+        << "  --cache-size <size>                      memory budget of the GET response cache, 0 = off (default 0)" << endl
+        << "  --max-users <n>                          user sessions kept in memory, 0 = keep no user state (default 65536)" << endl
+        << "  --session-ttl <seconds>                  a user session expires this long after its last command (default 600)" << endl
+        << "  --log-level <debug|info|warn|error|off>  minimum level of log lines (default info)" << endl
+        << "  --access-log                             one line per request: peer, request line, status, bytes, time" << endl
+        << "  --metrics                                collect counters and latency histograms, served at GET /metrics" << endl;
+}
@@ -0,0 +1,128 @@
+﻿#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "logger.h"
+
+enum ServerMode {
+    // accept 와 readiness 감시는 main 쓰레드가 하고, 처리는 job queue 를 통해 worker 쓰레드들에 넘긴다.
+    MODE_HANDOFF,
+    // 쓰레드마다 자기 listener, poller, 연결 목록을 가지고 연결을 처음부터 끝까지 혼자 처리한다.
+    MODE_SHARDED,
+};
+
+// handoff 모드에서 main 쓰레드가 worker 들에게 작업을 넘기는 방법
+enum SchedulerKind {
+    SCHEDULER_MUTEX,  // std::queue + mutex + condition variable 하나
+    SCHEDULER_STEAL,  // worker 별 lock-free 큐 + work stealing
+};
+
+// 소켓 I/O 를 하는 방법
+enum IoEngine {
+    // poller(epoll/select)로 readiness 를 기다렸다가 직접 accept/recv/send 한다.
+    IO_ENGINE_POLL,
+    // accept/recv/send 를 io_uring 에 맡겨두고 completion 만 받는다. (Linux 6.0 이상)
+    // 쓰레드마다 ring 과 listener 를 가지는 sharded 구조로만 돈다.
+    IO_ENGINE_URING,
+};
+
+// 서버 실행 옵션. 기본값은 아래와 같고, 명령행 인자로 바꿀 수 있다.
+struct ServerConfig {
+    ServerMode mode;  // --mode handoff|sharded
+
+    // --io-engine poll|uring. uring 을 쓸 수 없는 환경이면 poll 로 돈다.
+    IoEngine ioEngine;
+
+    // handoff 모드의 worker 쓰레드 수, sharded 모드의 shard 수 (--threads).
+    int numThreads;
+
+    SchedulerKind scheduler;  // --scheduler mutex|steal
+
+    // sharded 모드에서 shard i 를 CPU i 에 고정한다 (--pin).
+    bool pinThreads;
+
+    // 연결 하나의 수신 버퍼가 커질 수 있는 최대 크기 (--max-buffer).
+    // 헤더와 body 가 이 안에 다 들어오지 않으면 body 는 조각조각 handler 에 넘겨진다.
+    size_t maxBufferBytes;
+
+    // request body 최대 크기 (--max-body). 넘으면 413 으로 거절한다.
+    size_t maxBodyBytes;
+
+    // 연결 하나의 출력 큐에 보내지 못한 response 가 high 이상 쌓이면 그 연결에서 더 읽지 않고,
+    // low 이하로 줄어들면 다시 읽는다 (--send-high, --send-low).
+    size_t sendHighWatermark;
+    size_t sendLowWatermark;
+
+    // 연결별 timeout (millisecond). 명령행에서는 초 단위로 준다.
+    // idle  : 다음 request 를 기다리는 keep-alive 연결 (--idle-timeout). 넘으면 그냥 닫는다.
+    // header: request 의 첫 바이트(새 연결은 accept)부터 헤더를 다 받을 때까지 (--header-timeout). 넘으면 408.
+    // body  : body 를 받는 중에 새 바이트가 오지 않는 시간 (--body-timeout). 넘으면 408.
+    // send  : 보낼 response 가 있는데 상대가 읽어가지 않는 시간 (--send-timeout). 넘으면 닫는다.
+    uint64_t idleTimeoutMs;
+    uint64_t headerTimeoutMs;
+    uint64_t bodyTimeoutMs;
+    uint64_t sendTimeoutMs;
+
+    // listener 설정. 소켓 옵션은 listener 에 걸어두면 받은 연결들이 물려받는다.
+    // bindAddress     : 받을 IPv4 주소 (--bind). 0.0.0.0 이면 모든 인터페이스
+    // port            : 받을 포트 (--port)
+    // listenBacklog   : 커널이 accept 를 기다리게 두는 연결 수 (--backlog)
+    // reuseAddr       : SO_REUSEADDR (--reuse-addr on|off). 이전 프로세스의 TIME_WAIT 연결이 남아 있어도 바로 bind 한다.
+    // reusePort       : handoff 모드에서도 SO_REUSEPORT 를 켠다 (--reuse-port). 여러 프로세스가 한 포트를 나눠 받을 수 있다.
+    //                   sharded 모드와 io_uring 엔진은 shard 마다 listener 를 만들므로 항상 켠다.
+    // tcpNoDelay      : TCP_NODELAY (--nodelay on|off). response 를 Nagle 알고리즘 때문에 붙잡아두지 않는다.
+    // deferAcceptSec  : TCP_DEFER_ACCEPT (--defer-accept, Linux). 첫 데이터가 올 때까지 최대 이만큼 accept 를 미룬다. 0 이면 끈다.
+    // fastOpenQueue   : TCP_FASTOPEN 의 대기열 길이 (--fastopen). SYN 에 실어 온 request 를 handshake 전에 받는다. 0 이면 끈다.
+    // recvBufferBytes : SO_RCVBUF (--rcvbuf). 0 이면 OS 기본값
+    // sendBufferBytes : SO_SNDBUF (--sndbuf). 0 이면 OS 기본값
+    std::string bindAddress;
+    unsigned short port;
+    int listenBacklog;
+    bool reuseAddr;
+    bool reusePort;
+    bool tcpNoDelay;
+    int deferAcceptSec;
+    int fastOpenQueue;
+    size_t recvBufferBytes;
+    size_t sendBufferBytes;
+
+    // 과부하 보호. 넘치는 연결이나 request 에는 handler 를 돌리지 않고 바로 503 + Retry-After 를 보내고 닫는다.
+    // maxConnections : 동시에 여는 연결 수 (--max-connections). 0 이면 연결 테이블이 찰 때까지 받는다.
+    // maxQueuedJobs  : handoff 모드의 job queue 에 쌓일 수 있는 작업 수 (--max-queue). 0 이면 제한 없음.
+    // maxInflight    : 연결 하나에 보내지 못하고 쌓인 response 수 (--max-inflight). pipelining 을 과하게 하는 상대를 막는다. 0 이면 제한 없음.
+    // codelTargetMs  : handoff 모드에서 job queue 대기 시간의 목표 (--codel-target). 0 이면 끈다. (overload.h 의 CoDel)
+    size_t maxConnections;
+    size_t maxQueuedJobs;
+    size_t maxInflight;
+    uint64_t codelTargetMs;
+
+    // 이 디렉터리 아래의 파일들을 GET/HEAD <staticPrefix>/<경로> 로 보여준다 (--static-root, --static-prefix).
+    // staticRoot 가 비어있으면 정적 파일을 보여주지 않는다. staticPrefix 는 '/' 로 시작하고 '/' 로 끝나지 않는다.
+    std::string staticRoot;
+    std::string staticPrefix;
+
+    // GET response cache 의 메모리 한도 (--cache-size). 0 이면 캐시하지 않는다.
+    // 캐시할 route 와 TTL 은 registerRoutes() 에서 정한다.
+    size_t responseCacheBytes;
+
+    // POST /command 로 들어온 사용자들의 세션을 user store(user_store.h)에 몇 명까지 둘지 (--max-users). 0 이면 두지 않는다.
+    // 세션은 마지막 command 뒤 sessionTtlMs 가 지나면 만료된다 (--session-ttl, 명령행에서는 초 단위).
+    size_t maxUsers;
+    uint64_t sessionTtlMs;
+
+    LogLevel logLevel;  // --log-level debug|info|warn|error|off
+    bool accessLog;     // request 하나에 한 줄씩 access log 를 남긴다 (--access-log).
+    bool metrics;       // counter 와 지연 시간 히스토그램을 모아 GET /metrics 로 보여준다 (--metrics).
+
+    ServerConfig();
+};
+
+// "--이름 값" 또는 "--플래그" 형태의 인자들을 읽는다. 모르는 인자나 잘못된 값이 있으면 false.
+bool parseServerConfig(int argc, char* argv[], ServerConfig& config);
+
+void printServerConfigUsage(const char* program);
+
+#endif
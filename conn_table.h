@@ -0,0 +1,144 @@
+﻿#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// 연결 handle. 하위 32비트는 slot 번호, 상위 32비트는 그 slot 의 generation 이다.
+// slot 이 재사용되면 generation 이 바뀌므로 예전 handle 로는 새 연결에 접근할 수 없다.
+typedef uint64_t ConnHandle;
+
+static const ConnHandle INVALID_CONN_HANDLE = ~(ConnHandle)0;
+
+// slot/generation 으로 찾는 연결 테이블.
+// 객체들은 slot 256개짜리 slab 에 나란히 만들어지고, 비워진 slot 은 free list 로 바로 재사용된다.
+// slab 은 한 번 만들면 옮기지 않으므로 get() 은 lock 없이 배열 접근과 generation 비교만 한다.
+//
+// 여러 쓰레드에서 써도 되지만, 한 연결은 한 번에 한 쓰레드만 다룬다는 전제가 있다.
+// (one-shot poller 로 이벤트를 받은 쓰레드가 그 연결의 주인이다.)
+template <typename T>
+class ConnTable {
+public:
+    static const uint32_t SLOTS_PER_SLAB = 256;
+    static const uint32_t MAX_SLABS = 4096;
+
+    ConnTable() : numSlabs(0), count(0) {
+        for (uint32_t i = 0; i < MAX_SLABS; ++i) {
+            slabs[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    ~ConnTable() {
+        uint32_t n = numSlabs.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < n; ++i) {
+            Slot* slab = slabs[i].load(std::memory_order_relaxed);
+            for (uint32_t j = 0; j < SLOTS_PER_SLAB; ++j) {
+                if (slab[j].used) {
+                    slab[j].object()->~T();
+                }
+            }
+            delete[] slab;
+        }
+    }
+
+    // 빈 slot 에 T 를 만들고 handle 을 돌려준다. 더 이상 slot 이 없으면 INVALID_CONN_HANDLE.
+    template <typename... Args>
+    ConnHandle create(Args&&... args) {
+        uint32_t index;
+        {
+            std::lock_guard<std::mutex> lg(freeMutex);
+            if (freeSlots.empty() && !grow()) {
+                return INVALID_CONN_HANDLE;
+            }
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+
+        Slot& slot = slotAt(index);
+        new (slot.storage) T(std::forward<Args>(args)...);
+        slot.used = true;
+        count.fetch_add(1, std::memory_order_relaxed);
+        return ((ConnHandle)slot.gen.load(std::memory_order_relaxed) << 32) | index;
+    }
+
+    // handle 이 아직 살아있는 연결을 가리키면 그 객체를, 아니면 NULL 을 돌려준다.
+    T* get(ConnHandle handle) {
+        uint32_t index = (uint32_t)handle;
+        if (index / SLOTS_PER_SLAB >= numSlabs.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        Slot& slot = slotAt(index);
+        if (slot.gen.load(std::memory_order_acquire) != (uint32_t)(handle >> 32) || !slot.used) {
+            return NULL;
+        }
+        return slot.object();
+    }
+
+    // 연결 객체를 없애고 slot 을 돌려준다. generation 이 바뀌므로 이 handle 은 더 이상 쓸 수 없다.
+    bool destroy(ConnHandle handle) {
+        T* object = get(handle);
+        if (!object) {
+            return false;
+        }
+
+        uint32_t index = (uint32_t)handle;
+        Slot& slot = slotAt(index);
+        slot.gen.fetch_add(1, std::memory_order_release);
+        slot.used = false;
+        object->~T();
+        count.fetch_sub(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lg(freeMutex);
+        freeSlots.push_back(index);
+        return true;
+    }
+
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    ConnTable(const ConnTable&);
+    ConnTable& operator=(const ConnTable&);
+
+    struct Slot {
+        Slot() : gen(1), used(false) {}
+
+        T* object() { return reinterpret_cast<T*>(storage); }
+
+        std::atomic<uint32_t> gen;
+        bool used;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    Slot& slotAt(uint32_t index) {
+        return slabs[index / SLOTS_PER_SLAB].load(std::memory_order_acquire)[index % SLOTS_PER_SLAB];
+    }
+
+    // freeMutex 를 잡은 상태에서 부른다.
+    bool grow() {
+        uint32_t n = numSlabs.load(std::memory_order_relaxed);
+        if (n >= MAX_SLABS) {
+            return false;
+        }
+        slabs[n].store(new Slot[SLOTS_PER_SLAB], std::memory_order_release);
+        numSlabs.store(n + 1, std::memory_order_release);
+
+        // 낮은 번호부터 쓰도록 거꾸로 넣는다.
+        for (uint32_t j = SLOTS_PER_SLAB; j > 0; --j) {
+            freeSlots.push_back(n * SLOTS_PER_SLAB + j - 1);
+        }
+        return true;
+    }
+
+    std::atomic<Slot*> slabs[MAX_SLABS];
+    std::atomic<uint32_t> numSlabs;
+
+    std::mutex freeMutex;
+    std::vector<uint32_t> freeSlots;  // 최근에 비워진 slot 부터 재사용한다.
+    std::atomic<size_t> count;
+};
+
+#endif
@@ -0,0 +1,548 @@
+﻿#include "http_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// 헤더 부분(request line 포함)이 이보다 길면 431 로 거절한다.
+static const size_t HTTP_MAX_HEADER_BYTES = 8192;
+
+static bool equalsIgnoreCase(string_view a, string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const HttpHeader* HttpRequest::findHeader(string_view name) const {
+    for (int i = 0; i < numHeaders; ++i) {
+        if (equalsIgnoreCase(headers[i].name, name)) {
+            return &headers[i];
+        }
+    }
+    return NULL;
+}
+
+static string_view trimSpaces(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool etagMatches(string_view ifNoneMatch, string_view etag) {
+    string_view list = trimSpaces(ifNoneMatch);
+    if (list == "*") {
+        return true;
+    }
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        string_view tag = trimSpaces(list.substr(0, comma));
+        if (tag.substr(0, 2) == "W/") {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+        if (comma == string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool percentDecode(string_view in, string& out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); ++i) {
+        char c = in[i];
+        if (c == '%') {
+            int hi = i + 2 < in.size() ? hexValue(in[i + 1]) : -1;
+            int lo = hi >= 0 ? hexValue(in[i + 2]) : -1;
+            if (lo < 0) {
+                return false;
+            }
+            c = (char)(hi * 16 + lo);
+            i += 2;
+        }
+        out.push_back(c);
+    }
+    return true;
+}
+
+void appendPercentEncoded(string& out, string_view segment) {
+    static const char HEX[] = "0123456789ABCDEF";
+    for (char c : segment) {
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+            || c == '-' || c == '.' || c == '_' || c == '~') {
+            out.push_back(c);
+        } else {
+            out.push_back('%');
+            out.push_back(HEX[(unsigned char)c >> 4]);
+            out.push_back(HEX[(unsigned char)c & 15]);
+        }
+    }
+}
+
+// 쉼표로 나뉜 token 목록(Connection 헤더 등)에 token 이 있는지. 대소문자를 구분하지 않는다.
+static bool hasToken(string_view list, string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        if (equalsIgnoreCase(trimSpaces(list.substr(0, comma)), token)) {
+            return true;
+        }
+        if (comma == string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+HttpParser::HttpParser() : maxBodyBytes(SIZE_MAX) {
+    reset();
+}
+
+void HttpParser::reset() {
+    state = S_METHOD;
+    pos = 0;
+    tokenStart = 0;
+    method.off = method.len = 0;
+    path.off = path.len = 0;
+    version.off = version.len = 0;
+    numHeaders = 0;
+    contentTypeIndex = -1;
+    hasContentLength = false;
+    chunked = false;
+    badTransferEncoding = false;
+    http10 = false;
+    connectionClose = false;
+    connectionKeepAlive = false;
+    contentLength = 0;
+    headerLen = 0;
+    bodyState = B_CHUNK_SIZE;
+    rawPos = 0;
+    decoded = 0;
+    bodyReceived = 0;
+    chunkRemaining = 0;
+    chunkSizeDigits = false;
+    error = 0;
+}
+
+HttpParser::Status HttpParser::fail(int status) {
+    error = status;
+    return FAILED;
+}
+
+// 방금 끝난 헤더 하나를 기억하고, Content-Length / Content-Type 이면 따로 처리한다.
+bool HttpParser::finishHeader(const char* buf) {
+    HeaderRange& h = headers[numHeaders];
+    string_view name(buf + h.name.off, h.name.len);
+    string_view value(buf + h.value.off, h.value.len);
+
+    if (equalsIgnoreCase(name, "Content-Length")) {
+        if (value.empty()) {
+            return false;
+        }
+        size_t n = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9' || n > (SIZE_MAX - 9) / 10) {
+                return false;
+            }
+            n = n * 10 + (c - '0');
+        }
+        // 값이 다른 Content-Length 가 여러 개 오면 어느 쪽을 믿을지 알 수 없다.
+        if (hasContentLength && contentLength != n) {
+            return false;
+        }
+        hasContentLength = true;
+        contentLength = n;
+    } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+        // chunked 만 지원한다. 다른 coding 이 섞여 있으면 headers 가 끝난 뒤 501 로 거절한다.
+        if (equalsIgnoreCase(value, "chunked")) {
+            chunked = true;
+        } else {
+            badTransferEncoding = true;
+        }
+    } else if (equalsIgnoreCase(name, "Content-Type")) {
+        contentTypeIndex = numHeaders;
+    } else if (equalsIgnoreCase(name, "Connection")) {
+        connectionClose = connectionClose || hasToken(value, "close");
+        connectionKeepAlive = connectionKeepAlive || hasToken(value, "keep-alive");
+    }
+
+    ++numHeaders;
+    return true;
+}
+
+// 헤더가 모두 끝났을 때 body 를 어떻게 읽을지 정한다.
+bool HttpParser::finishHeaders() {
+    if (badTransferEncoding) {
+        fail(501);
+        return false;
+    }
+    // Content-Length 와 Transfer-Encoding 이 같이 오면 request smuggling 에 쓰일 수 있으므로 거절한다.
+    if (chunked && hasContentLength) {
+        fail(400);
+        return false;
+    }
+    if (!chunked && contentLength > maxBodyBytes) {
+        fail(413);
+        return false;
+    }
+
+    rawPos = headerLen;
+    bodyState = chunked ? B_CHUNK_SIZE : B_DONE;
+    return true;
+}
+
+HttpParser::Status HttpParser::parseHeaders(const char* buf, size_t len) {
+    while (state != S_BODY && pos < len) {
+        if (pos >= HTTP_MAX_HEADER_BYTES) {
+            return fail(431);
+        }
+
+        char c = buf[pos];
+        switch (state) {
+        case S_METHOD:
+            if (c == ' ') {
+                if (pos == tokenStart) {
+                    return fail(400);
+                }
+                method.off = (uint32_t)tokenStart;
+                method.len = (uint32_t)(pos - tokenStart);
+                tokenStart = pos + 1;
+                state = S_PATH;
+            } else if (c < 'A' || c > 'Z') {
+                return fail(400);
+            }
+            ++pos;
+            break;
+
+        case S_PATH: {
+            // 공백이 나올 때까지 한꺼번에 건너뛴다.
+            const char* sp = (const char*)memchr(buf + pos, ' ', len - pos);
+            size_t end = sp ? (size_t)(sp - buf) : len;
+            for (size_t i = pos; i < end; ++i) {
+                if ((unsigned char)buf[i] <= ' ' || buf[i] == 0x7f) {
+                    return fail(400);
+                }
+            }
+            pos = end;
+            if (sp) {
+                if (pos == tokenStart) {
+                    return fail(400);
+                }
+                path.off = (uint32_t)tokenStart;
+                path.len = (uint32_t)(pos - tokenStart);
+                ++pos;
+                tokenStart = pos;
+                state = S_VERSION;
+            }
+            break;
+        }
+
+        case S_VERSION:
+            if (c == '\r') {
+                version.off = (uint32_t)tokenStart;
+                version.len = (uint32_t)(pos - tokenStart);
+                if (version.len < 6 || memcmp(buf + tokenStart, "HTTP/", 5) != 0) {
+                    return fail(400);
+                }
+                // HTTP/1.0 이하는 Connection: keep-alive 가 없으면 response 뒤에 연결을 닫는다.
+                http10 = version.len == 8 && (memcmp(buf + tokenStart, "HTTP/1.0", 8) == 0 || memcmp(buf + tokenStart, "HTTP/0.9", 8) == 0);
+                state = S_REQUEST_LINE_LF;
+            } else if ((unsigned char)c <= ' ') {
+                return fail(400);
+            }
+            ++pos;
+            break;
+
+        case S_REQUEST_LINE_LF:
+        case S_HEADER_LF:
+            if (c != '\n') {
+                return fail(400);
+            }
+            if (state == S_HEADER_LF && !finishHeader(buf)) {
+                return fail(400);
+            }
+            ++pos;
+            state = S_HEADER_START;
+            break;
+
+        case S_HEADER_START:
+            if (c == '\r') {
+                ++pos;
+                state = S_HEADERS_END_LF;
+            } else if (numHeaders >= HTTP_MAX_HEADERS) {
+                return fail(431);
+            } else {
+                tokenStart = pos;
+                state = S_HEADER_NAME;
+            }
+            break;
+
+        case S_HEADER_NAME:
+            if (c == ':') {
+                if (pos == tokenStart) {
+                    return fail(400);
+                }
+                headers[numHeaders].name.off = (uint32_t)tokenStart;
+                headers[numHeaders].name.len = (uint32_t)(pos - tokenStart);
+                state = S_HEADER_VALUE_WS;
+            } else if ((unsigned char)c <= ' ') {
+                return fail(400);
+            }
+            ++pos;
+            break;
+
+        case S_HEADER_VALUE_WS:
+            if (c == ' ' || c == '\t') {
+                ++pos;
+            } else {
+                tokenStart = pos;
+                state = S_HEADER_VALUE;
+            }
+            break;
+
+        case S_HEADER_VALUE: {
+            // CR 이 나올 때까지 한꺼번에 건너뛴다.
+            // 그 사이에 HTAB 이 아닌 제어 문자(LF 하나만 온 줄바꿈, NUL 등)가 있으면 거절한다.
+            // 앞뒤 서버가 줄바꿈을 다르게 해석하게 만드는 request smuggling 이나 response splitting 에 쓰일 수 있다.
+            const char* cr = (const char*)memchr(buf + pos, '\r', len - pos);
+            size_t scanEnd = cr ? (size_t)(cr - buf) : len;
+            for (size_t i = pos; i < scanEnd; ++i) {
+                unsigned char b = (unsigned char)buf[i];
+                if ((b < ' ' && b != '\t') || b == 0x7f) {
+                    return fail(400);
+                }
+            }
+            if (!cr) {
+                pos = len;
+                break;
+            }
+            size_t end = (size_t)(cr - buf);
+            while (end > tokenStart && (buf[end - 1] == ' ' || buf[end - 1] == '\t')) {
+                --end;
+            }
+            headers[numHeaders].value.off = (uint32_t)tokenStart;
+            headers[numHeaders].value.len = (uint32_t)(end - tokenStart);
+            pos = (size_t)(cr - buf) + 1;
+            state = S_HEADER_LF;
+            break;
+        }
+
+        case S_HEADERS_END_LF:
+            if (c != '\n') {
+                return fail(400);
+            }
+            ++pos;
+            headerLen = pos;
+            state = S_BODY;
+            if (!finishHeaders()) {
+                return FAILED;
+            }
+            return HEADERS_COMPLETE;
+
+        case S_BODY:
+            break;
+        }
+    }
+
+    return state == S_BODY ? HEADERS_COMPLETE : INCOMPLETE;
+}
+
+HttpParser::Status HttpParser::parseBody(char* buf, size_t len) {
+    if (chunked) {
+        return parseChunked(buf, len);
+    }
+
+    // Content-Length 인 경우 body 는 이미 헤더 바로 뒤에 연속으로 있으므로 세기만 하면 된다.
+    // Content-Length 가 없으면 body 는 없다.
+    size_t take = min(len - rawPos, contentLength - bodyReceived);
+    rawPos += take;
+    decoded += take;
+    bodyReceived += take;
+    return bodyReceived == contentLength ? COMPLETE : INCOMPLETE;
+}
+
+HttpParser::Status HttpParser::parseChunked(char* buf, size_t len) {
+    while (bodyState != B_DONE && rawPos < len) {
+        char c = buf[rawPos];
+        switch (bodyState) {
+        case B_CHUNK_SIZE: {
+            int digit = -1;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+            if (digit >= 0) {
+                if (chunkRemaining > (SIZE_MAX >> 4)) {
+                    return fail(413);
+                }
+                chunkRemaining = (chunkRemaining << 4) | (size_t)digit;
+                chunkSizeDigits = true;
+            } else if (chunkSizeDigits && (c == ';' || c == ' ' || c == '\t')) {
+                bodyState = B_CHUNK_EXT;
+                tokenStart = rawPos;
+            } else if (chunkSizeDigits && c == '\r') {
+                bodyState = B_CHUNK_SIZE_LF;
+            } else {
+                return fail(400);
+            }
+            ++rawPos;
+            break;
+        }
+
+        case B_CHUNK_EXT:
+            // chunk extension 은 무시한다.
+            if (c == '\r') {
+                bodyState = B_CHUNK_SIZE_LF;
+            }
+            ++rawPos;
+            break;
+
+        case B_CHUNK_SIZE_LF:
+            if (c != '\n') {
+                return fail(400);
+            }
+            ++rawPos;
+            chunkSizeDigits = false;
+            if (chunkRemaining == 0) {
+                bodyState = B_TRAILER_START;
+            } else if (chunkRemaining > maxBodyBytes - bodyReceived) {
+                return fail(413);
+            } else {
+                bodyState = B_CHUNK_DATA;
+            }
+            break;
+
+        case B_CHUNK_DATA: {
+            // chunk 데이터를 지금까지 디코딩한 body 바로 뒤로 당긴다.
+            size_t take = min(len - rawPos, chunkRemaining);
+            size_t dst = headerLen + decoded;
+            if (dst != rawPos) {
+                memmove(buf + dst, buf + rawPos, take);
+            }
+            rawPos += take;
+            decoded += take;
+            bodyReceived += take;
+            chunkRemaining -= take;
+            if (chunkRemaining == 0) {
+                bodyState = B_CHUNK_DATA_CR;
+            }
+            break;
+        }
+
+        case B_CHUNK_DATA_CR:
+            if (c != '\r') {
+                return fail(400);
+            }
+            ++rawPos;
+            bodyState = B_CHUNK_DATA_LF;
+            break;
+
+        case B_CHUNK_DATA_LF:
+            if (c != '\n') {
+                return fail(400);
+            }
+            ++rawPos;
+            bodyState = B_CHUNK_SIZE;
+            break;
+
+        case B_TRAILER_START:
+            // trailer 필드는 읽고 버린다. 빈 줄이 나오면 body 가 끝난다.
+            bodyState = c == '\r' ? B_FINAL_LF : B_TRAILER;
+            tokenStart = rawPos;
+            ++rawPos;
+            break;
+
+        case B_TRAILER:
+            if (c == '\r') {
+                bodyState = B_TRAILER_LF;
+            }
+            ++rawPos;
+            break;
+
+        case B_TRAILER_LF:
+        case B_FINAL_LF:
+            if (c != '\n') {
+                return fail(400);
+            }
+            ++rawPos;
+            bodyState = bodyState == B_FINAL_LF ? B_DONE : B_TRAILER_START;
+            break;
+
+        case B_DONE:
+            break;
+        }
+
+        // chunk extension 이나 trailer 한 줄이 비정상적으로 긴 경우
+        if ((bodyState == B_CHUNK_EXT || bodyState == B_TRAILER) && rawPos - tokenStart > HTTP_MAX_HEADER_BYTES) {
+            return fail(431);
+        }
+    }
+
+    return bodyState == B_DONE ? COMPLETE : INCOMPLETE;
+}
+
+HttpParser::Status HttpParser::parse(char* buf, size_t len, HttpRequest& req) {
+    Status status = HEADERS_COMPLETE;
+    if (state != S_BODY) {
+        status = parseHeaders(buf, len);
+    }
+    if (status == HEADERS_COMPLETE) {
+        status = parseBody(buf, len);
+    }
+    if (status == COMPLETE) {
+        getRequest(buf, req);
+    }
+    return status;
+}
+
+void HttpParser::discardBody() {
+    rawPos -= decoded;
+    tokenStart -= decoded;
+    decoded = 0;
+}
+
+void HttpParser::getRequest(const char* buf, HttpRequest& req) const {
+    req.method = string_view(buf + method.off, method.len);
+    req.path = string_view(buf + path.off, path.len);
+    req.version = string_view(buf + version.off, version.len);
+    req.numHeaders = numHeaders;
+    for (int i = 0; i < numHeaders; ++i) {
+        req.headers[i].name = string_view(buf + headers[i].name.off, headers[i].name.len);
+        req.headers[i].value = string_view(buf + headers[i].value.off, headers[i].value.len);
+    }
+    req.contentType = contentTypeIndex >= 0 ? req.headers[contentTypeIndex].value : string_view();
+    req.contentLength = chunked ? bodyReceived : contentLength;
+    req.chunked = chunked;
+    req.body = string_view(buf + headerLen, decoded);
+}
@@ -0,0 +1,174 @@
+﻿#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+static const int HTTP_MAX_HEADERS = 64;
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// 파싱이 끝난 request. 모든 string_view 는 Client 의 수신 버퍼를 가리키므로
+// 버퍼 내용이 바뀌기 전까지만 유효하다.
+struct HttpRequest {
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int numHeaders;
+
+    std::string_view contentType;
+    size_t contentLength;  // chunked 인 경우 지금까지 디코딩한 body 의 전체 길이
+    bool chunked;
+
+    // 버퍼에 남아있는 (디코딩된) body. body 를 스트리밍으로 넘겨준 경우에는 마지막 조각만 남는다.
+    std::string_view body;
+
+    // 대소문자를 구분하지 않고 헤더를 찾는다. 없으면 NULL.
+    const HttpHeader* findHeader(std::string_view name) const;
+};
+
+// If-None-Match 헤더 값(ETag 목록 또는 "*")에 etag 가 있는지. 약한 비교라서 W/ 는 무시한다.
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag);
+
+// URL 경로(의 일부)의 퍼센트 인코딩을 풀어서 out 에 채운다. '%' 뒤에 16진수 두 자리가 없으면 false.
+bool percentDecode(std::string_view in, std::string& out);
+
+// 경로 구간 하나를 퍼센트 인코딩해서 out 뒤에 붙인다. unreserved 문자(A-Z a-z 0-9 - . _ ~)만 그대로 둔다.
+void appendPercentEncoded(std::string& out, std::string_view segment);
+
+// 이어서 호출할 수 있는 HTTP/1.1 request 파서.
+// recv() 로 받은 만큼씩 다시 호출하면 지난번에 멈춘 곳부터 이어서 본다.
+// 내부 상태는 버퍼 시작점으로부터의 offset 으로만 기억하므로, 요청이 어느 바이트에서 쪼개져 와도 되고
+// 그 사이에 버퍼가 재할당되어도 된다.
+//
+// 버퍼 배치: [헤더 headerLength()][디코딩된 body bodyBuffered()][이미 처리한 chunk 프레이밍][아직 안 본 바이트 ...]
+// chunked body 는 parseBody() 가 제자리에서 디코딩해서 헤더 바로 뒤에 이어 붙인다.
+class HttpParser {
+public:
+    enum Status {
+        INCOMPLETE,        // 더 받아야 한다.
+        HEADERS_COMPLETE,  // 헤더까지 완성되었다. 이제 parseBody() 를 부른다.
+        COMPLETE,          // request 하나가 완성되었다. consumed() 만큼이 이 request 의 길이다.
+        FAILED,            // 잘못된 request. errorStatus() 로 응답 코드를 알 수 있다.
+    };
+
+    HttpParser();
+
+    // 다음 request 를 위해 상태를 초기화한다.
+    void reset();
+
+    // body 전체 크기 제한. Content-Length 가 이보다 크면 헤더 단계에서 바로 413 으로 실패한다.
+    void setMaxBodyBytes(size_t n) { maxBodyBytes = n; }
+
+    // buf 는 request 의 첫 바이트부터 지금까지 받은 len 바이트를 가리켜야 한다.
+    Status parseHeaders(const char* buf, size_t len);
+
+    // HEADERS_COMPLETE 이후 body 를 파싱한다. chunked 인 경우 buf 를 제자리에서 디코딩한다.
+    Status parseBody(char* buf, size_t len);
+
+    // 헤더부터 body 끝까지 한 번에 파싱한다. body 전체가 버퍼에 있어야 COMPLETE 가 된다.
+    Status parse(char* buf, size_t len, HttpRequest& req);
+
+    // 현재까지 파싱한 내용으로 req 의 string_view 들을 채운다.
+    void getRequest(const char* buf, HttpRequest& req) const;
+
+    bool headersComplete() const { return state == S_BODY; }
+    bool isChunked() const { return chunked; }
+
+    // response 뒤에 연결을 유지해도 되는지. HTTP/1.1 은 Connection: close 가 없으면,
+    // HTTP/1.0 은 Connection: keep-alive 가 있을 때만 유지한다. 헤더가 완성된 뒤에 부른다.
+    bool keepAlive() const { return !connectionClose && (!http10 || connectionKeepAlive); }
+    size_t declaredContentLength() const { return contentLength; }
+    size_t headerLength() const { return headerLen; }
+    size_t bodyBuffered() const { return decoded; }
+    size_t bodyTotal() const { return bodyReceived; }
+
+    // 버퍼에 쌓인 디코딩된 body 를 넘겨준 뒤 호출한다.
+    // 호출자는 버퍼에서 [headerLength(), headerLength() + bodyBuffered()) 를 지워야 한다.
+    void discardBody();
+
+    size_t consumed() const { return rawPos; }
+    int errorStatus() const { return error; }
+
+private:
+    enum State {
+        S_METHOD,
+        S_PATH,
+        S_VERSION,
+        S_REQUEST_LINE_LF,
+        S_HEADER_START,
+        S_HEADER_NAME,
+        S_HEADER_VALUE_WS,
+        S_HEADER_VALUE,
+        S_HEADER_LF,
+        S_HEADERS_END_LF,
+        S_BODY,
+    };
+
+    enum BodyState {
+        B_CHUNK_SIZE,
+        B_CHUNK_EXT,
+        B_CHUNK_SIZE_LF,
+        B_CHUNK_DATA,
+        B_CHUNK_DATA_CR,
+        B_CHUNK_DATA_LF,
+        B_TRAILER_START,
+        B_TRAILER,
+        B_TRAILER_LF,
+        B_FINAL_LF,
+        B_DONE,
+    };
+
+    struct Range {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    struct HeaderRange {
+        Range name;
+        Range value;
+    };
+
+    Status fail(int status);
+    bool finishHeader(const char* buf);
+    bool finishHeaders();
+    Status parseChunked(char* buf, size_t len);
+
+    State state;
+    size_t pos;          // 헤더 단계에서 다음에 볼 바이트의 offset
+    size_t tokenStart;   // 현재 토큰이 시작된 offset
+
+    Range method;
+    Range path;
+    Range version;
+    HeaderRange headers[HTTP_MAX_HEADERS];
+    int numHeaders;
+    int contentTypeIndex;
+
+    bool hasContentLength;
+    bool chunked;
+    bool badTransferEncoding;
+    bool http10;               // HTTP/1.0 이하
+    bool connectionClose;      // Connection 헤더에 close 가 있다.
+    bool connectionKeepAlive;  // Connection 헤더에 keep-alive 가 있다.
+    size_t contentLength;
+    size_t maxBodyBytes;
+
+    size_t headerLen;
+    BodyState bodyState;
+    size_t rawPos;        // body 단계에서 다음에 볼 바이트의 offset
+    size_t decoded;       // 헤더 뒤에 쌓여있는 디코딩된 body 바이트 수
+    size_t bodyReceived;  // 지금까지 디코딩한 body 전체 바이트 수
+    size_t chunkRemaining;
+    bool chunkSizeDigits;
+    int error;
+};
+
+#endif
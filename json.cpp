@@ -0,0 +1,613 @@
+﻿#include "json.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSON_USE_SSE2 1
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// JsonDocument
+
+JsonDocument::JsonDocument(size_t maxTokens, int maxDepth)
+    : pos(0), maxTokens(maxTokens), maxDepth(maxDepth), errorPos(0), error(NULL) {
+}
+
+bool JsonDocument::fail(const char* message) {
+    if (!error) {
+        error = message;
+        errorPos = pos;
+    }
+    return false;
+}
+
+uint32_t JsonDocument::pushToken(JsonType type, size_t start) {
+    Token t;
+    t.type = (uint8_t)type;
+    t.escaped = false;
+    t.start = (uint32_t)start;
+    t.len = 0;
+    t.next = 0;
+    t.count = 0;
+    tokens.push_back(t);
+    return (uint32_t)(tokens.size() - 1);
+}
+
+bool JsonDocument::parse(string_view input) {
+    text = input;
+    pos = 0;
+    tokens.clear();
+    errorPos = 0;
+    error = NULL;
+
+    // offset 을 32비트로 저장한다.
+    if (text.size() >= 0xffffffffu) {
+        return fail("document too large");
+    }
+
+    skipWhitespace();
+    if (!parseValue(0)) {
+        return false;
+    }
+    skipWhitespace();
+    if (pos != text.size()) {
+        return fail("trailing characters");
+    }
+    return true;
+}
+
+JsonValue JsonDocument::root() const {
+    return tokens.empty() || error ? JsonValue() : JsonValue(this, 0);
+}
+
+void JsonDocument::skipWhitespace() {
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            break;
+        }
+        ++pos;
+    }
+}
+
+bool JsonDocument::parseValue(int depth) {
+    if (tokens.size() >= maxTokens) {
+        return fail("too many values");
+    }
+    if (pos >= text.size()) {
+        return fail("unexpected end");
+    }
+
+    char c = text[pos];
+    if (c == '{' || c == '[') {
+        if (depth >= maxDepth) {
+            return fail("nesting too deep");
+        }
+        bool object = c == '{';
+        char close = object ? '}' : ']';
+        uint32_t index = pushToken(object ? JSON_OBJECT : JSON_ARRAY, pos);
+        uint32_t count = 0;
+        ++pos;
+        skipWhitespace();
+        if (pos < text.size() && text[pos] == close) {
+            ++pos;
+        } else {
+            while (true) {
+                if (object) {
+                    if (pos >= text.size() || text[pos] != '"') {
+                        return fail("expected key");
+                    }
+                    if (!parseString()) {
+                        return false;
+                    }
+                    skipWhitespace();
+                    if (pos >= text.size() || text[pos] != ':') {
+                        return fail("expected ':'");
+                    }
+                    ++pos;
+                    skipWhitespace();
+                }
+                if (!parseValue(depth + 1)) {
+                    return false;
+                }
+                ++count;
+                skipWhitespace();
+                if (pos < text.size() && text[pos] == ',') {
+                    ++pos;
+                    skipWhitespace();
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == close) {
+                    ++pos;
+                    break;
+                }
+                return fail(object ? "expected ',' or '}'" : "expected ',' or ']'");
+            }
+        }
+
+        // 자식을 넣는 동안 vector 가 재할당될 수 있으므로 index 로 다시 찾는다.
+        Token& t = tokens[index];
+        t.len = (uint32_t)(pos - t.start);
+        t.count = count;
+        t.next = (uint32_t)tokens.size();
+        return true;
+    }
+
+    switch (c) {
+    case '"': return parseString();
+    case 't': return parseLiteral("true", 4, JSON_TRUE);
+    case 'f': return parseLiteral("false", 5, JSON_FALSE);
+    case 'n': return parseLiteral("null", 4, JSON_NULL);
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            return parseNumber();
+        }
+        return fail("unexpected character");
+    }
+}
+
+bool JsonDocument::parseLiteral(const char* literal, size_t len, JsonType type) {
+    if (text.compare(pos, len, literal) != 0) {
+        return fail("invalid literal");
+    }
+    uint32_t index = pushToken(type, pos);
+    tokens[index].len = (uint32_t)len;
+    tokens[index].next = index + 1;
+    pos += len;
+    return true;
+}
+
+bool JsonDocument::parseNumber() {
+    size_t start = pos;
+    const char* s = text.data();
+    size_t n = text.size();
+
+    if (s[pos] == '-') {
+        ++pos;
+    }
+    if (pos >= n || s[pos] < '0' || s[pos] > '9') {
+        return fail("invalid number");
+    }
+    if (s[pos] == '0') {
+        ++pos;
+    } else {
+        while (pos < n && s[pos] >= '0' && s[pos] <= '9') {
+            ++pos;
+        }
+    }
+    if (pos < n && s[pos] == '.') {
+        ++pos;
+        if (pos >= n || s[pos] < '0' || s[pos] > '9') {
+            return fail("invalid number");
+        }
+        while (pos < n && s[pos] >= '0' && s[pos] <= '9') {
+            ++pos;
+        }
+    }
+    if (pos < n && (s[pos] == 'e' || s[pos] == 'E')) {
+        ++pos;
+        if (pos < n && (s[pos] == '+' || s[pos] == '-')) {
+            ++pos;
+        }
+        if (pos >= n || s[pos] < '0' || s[pos] > '9') {
+            return fail("invalid number");
+        }
+        while (pos < n && s[pos] >= '0' && s[pos] <= '9') {
+            ++pos;
+        }
+    }
+
+    uint32_t index = pushToken(JSON_NUMBER, start);
+    tokens[index].len = (uint32_t)(pos - start);
+    tokens[index].next = index + 1;
+    return true;
+}
+
+// s[pos, n) 에서 처음 나오는 '"', '\\', 제어 문자(< 0x20)의 위치. 없으면 n.
+static size_t findStringSpecial(const char* s, size_t pos, size_t n) {
+#ifdef JSON_USE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while (pos + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + pos));
+        // v <= 0x1f 인 바이트는 max(v, 0x1f) == 0x1f 이다. (부호 없는 비교)
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+#if defined(_MSC_VER)
+            unsigned long bit;
+            _BitScanForward(&bit, (unsigned long)mask);
+            return pos + bit;
+#else
+            return pos + __builtin_ctz((unsigned int)mask);
+#endif
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < n) {
+        unsigned char c = (unsigned char)s[pos];
+        if (c == '"' || c == '\\' || c < 0x20) {
+            return pos;
+        }
+        ++pos;
+    }
+    return n;
+}
+
+static inline bool isHex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool JsonDocument::parseString() {
+    const char* s = text.data();
+    size_t n = text.size();
+    uint32_t index = pushToken(JSON_STRING, pos + 1);
+    bool escaped = false;
+    ++pos;
+
+    while (true) {
+        pos = findStringSpecial(s, pos, n);
+        if (pos >= n) {
+            return fail("unterminated string");
+        }
+        char c = s[pos];
+        if (c == '"') {
+            break;
+        }
+        if (c != '\\') {
+            return fail("control character in string");
+        }
+
+        // escape 는 형식만 확인하고, 푸는 것은 getString() 을 부를 때 한다.
+        escaped = true;
+        if (pos + 1 >= n) {
+            return fail("unterminated string");
+        }
+        switch (s[pos + 1]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            pos += 2;
+            break;
+        case 'u':
+            if (pos + 6 > n || !isHex(s[pos + 2]) || !isHex(s[pos + 3]) || !isHex(s[pos + 4]) || !isHex(s[pos + 5])) {
+                return fail("invalid \\u escape");
+            }
+            pos += 6;
+            break;
+        default:
+            return fail("invalid escape");
+        }
+    }
+
+    Token& t = tokens[index];
+    t.len = (uint32_t)(pos - t.start);
+    t.escaped = escaped;
+    t.next = index + 1;
+    ++pos;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// JsonValue
+
+JsonType JsonValue::type() const {
+    return (JsonType)doc->tokens[index].type;
+}
+
+size_t JsonValue::size() const {
+    return valid() ? doc->tokens[index].count : 0;
+}
+
+string_view JsonValue::raw() const {
+    if (!valid()) {
+        return string_view();
+    }
+    const JsonDocument::Token& t = doc->tokens[index];
+    return doc->text.substr(t.start, t.len);
+}
+
+bool JsonValue::hasEscapes() const {
+    return valid() && doc->tokens[index].escaped;
+}
+
+JsonValue JsonValue::at(size_t i) const {
+    if (!valid() || i >= size()) {
+        return JsonValue();
+    }
+    // 객체는 key, 값이 번갈아 들어있다.
+    bool object = type() == JSON_OBJECT;
+    uint32_t child = index + 1;
+    for (size_t k = 0; k < i; ++k) {
+        if (object) {
+            ++child;
+        }
+        child = doc->tokens[child].next;
+    }
+    return JsonValue(doc, object ? child + 1 : child);
+}
+
+JsonValue JsonValue::keyAt(size_t i) const {
+    if (!isObject() || i >= size()) {
+        return JsonValue();
+    }
+    uint32_t child = index + 1;
+    for (size_t k = 0; k < i; ++k) {
+        child = doc->tokens[child + 1].next;
+    }
+    return JsonValue(doc, child);
+}
+
+JsonValue JsonValue::operator[](string_view key) const {
+    if (!isObject()) {
+        return JsonValue();
+    }
+    uint32_t child = index + 1;
+    size_t count = size();
+    for (size_t k = 0; k < count; ++k) {
+        JsonValue keyValue(doc, child);
+        if (keyValue.equals(key)) {
+            return JsonValue(doc, child + 1);
+        }
+        child = doc->tokens[child + 1].next;
+    }
+    return JsonValue();
+}
+
+bool JsonValue::equals(string_view s) const {
+    if (!isString()) {
+        return false;
+    }
+    if (!hasEscapes()) {
+        return raw() == s;
+    }
+    string decoded;
+    return getString(decoded) && decoded == s;
+}
+
+static void appendUtf8(string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back((char)cp);
+    } else if (cp < 0x800) {
+        out.push_back((char)(0xc0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out.push_back((char)(0xe0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back((char)(0xf0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+}
+
+static uint32_t parseHex4(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v |= c - 'a' + 10;
+        } else {
+            v |= c - 'A' + 10;
+        }
+    }
+    return v;
+}
+
+bool JsonValue::getString(string& out) const {
+    if (!isString()) {
+        return false;
+    }
+    string_view s = raw();
+    out.clear();
+    if (!hasEscapes()) {
+        out.assign(s.data(), s.size());
+        return true;
+    }
+
+    // 형식은 parse() 에서 이미 확인했다.
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\') {
+            out.push_back(s[i]);
+            continue;
+        }
+        char e = s[++i];
+        switch (e) {
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u': {
+            uint32_t cp = parseHex4(s.data() + i + 1);
+            i += 4;
+            // UTF-16 surrogate pair 는 하나의 code point 로 합친다. 짝이 맞지 않으면 U+FFFD 로 바꾼다.
+            if (cp >= 0xd800 && cp < 0xdc00) {
+                if (i + 6 < s.size() && s[i + 1] == '\\' && s[i + 2] == 'u') {
+                    uint32_t low = parseHex4(s.data() + i + 3);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                        i += 6;
+                    } else {
+                        cp = 0xfffd;
+                    }
+                } else {
+                    cp = 0xfffd;
+                }
+            } else if (cp >= 0xdc00 && cp < 0xe000) {
+                cp = 0xfffd;
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default: out.push_back(e); break;  // '"', '\\', '/'
+        }
+    }
+    return true;
+}
+
+bool JsonValue::getBool(bool& out) const {
+    if (!isBool()) {
+        return false;
+    }
+    out = type() == JSON_TRUE;
+    return true;
+}
+
+bool JsonValue::getInt64(int64_t& out) const {
+    if (!isNumber()) {
+        return false;
+    }
+    string_view s = raw();
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), out);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool JsonValue::getDouble(double& out) const {
+    if (!isNumber()) {
+        return false;
+    }
+    // strtod 는 NUL 로 끝나는 문자열이 필요하므로 복사한다. JSON 숫자는 보통 아주 짧다.
+    string_view s = raw();
+    char buf[64];
+    if (s.size() >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    out = strtod(buf, NULL);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// JsonWriter
+
+JsonWriter::JsonWriter(string& out) : out(out), depth(0), hasItems(0), afterKey(false) {
+}
+
+// 같은 객체/배열 안에서 두 번째 값부터는 앞에 ',' 를 붙인다.
+void JsonWriter::separator() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (depth > 0 && depth <= 64) {
+        uint64_t bit = (uint64_t)1 << (depth - 1);
+        if (hasItems & bit) {
+            out.push_back(',');
+        }
+        hasItems |= bit;
+    }
+}
+
+void JsonWriter::beginObject() {
+    separator();
+    out.push_back('{');
+    ++depth;
+    if (depth <= 64) {
+        hasItems &= ~((uint64_t)1 << (depth - 1));
+    }
+}
+
+void JsonWriter::endObject() {
+    out.push_back('}');
+    --depth;
+}
+
+void JsonWriter::beginArray() {
+    separator();
+    out.push_back('[');
+    ++depth;
+    if (depth <= 64) {
+        hasItems &= ~((uint64_t)1 << (depth - 1));
+    }
+}
+
+void JsonWriter::endArray() {
+    out.push_back(']');
+    --depth;
+}
+
+void JsonWriter::key(string_view name) {
+    separator();
+    appendEscaped(name);
+    out.push_back(':');
+    afterKey = true;
+}
+
+void JsonWriter::value(string_view s) {
+    separator();
+    appendEscaped(s);
+}
+
+void JsonWriter::value(int64_t n) {
+    separator();
+    char buf[24];
+    to_chars_result r = to_chars(buf, buf + sizeof(buf), n);
+    out.append(buf, r.ptr - buf);
+}
+
+void JsonWriter::value(double d) {
+    separator();
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.17g", d);
+    // JSON 에는 NaN, Infinity 가 없다.
+    if (len <= 0 || strpbrk(buf, "ni") != NULL) {
+        out.append("null");
+        return;
+    }
+    out.append(buf, len);
+}
+
+void JsonWriter::value(bool b) {
+    separator();
+    out.append(b ? "true" : "false");
+}
+
+void JsonWriter::null() {
+    separator();
+    out.append("null");
+}
+
+// 특수 문자가 없는 구간은 통째로 붙이고, 특수 문자만 escape 한다.
+void JsonWriter::appendEscaped(string_view s) {
+    static const char HEX[] = "0123456789abcdef";
+    out.push_back('"');
+    size_t i = 0;
+    while (i < s.size()) {
+        size_t j = findStringSpecial(s.data(), i, s.size());
+        out.append(s.data() + i, j - i);
+        if (j >= s.size()) {
+            break;
+        }
+        unsigned char c = (unsigned char)s[j];
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default: {
+            char esc[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf] };
+            out.append(esc, 6);
+            break;
+        }
+        }
+        i = j + 1;
+    }
+    out.push_back('"');
+}
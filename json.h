@@ -0,0 +1,155 @@
+﻿#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum JsonType {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+class JsonDocument;
+
+// 문서 안의 값 하나. 문서가 살아있고 원본 텍스트가 바뀌지 않는 동안만 쓸 수 있다.
+// 없는 key 나 범위를 벗어난 index 로 찾으면 valid() 가 false 인 값이 나오고, 그 값에서 다시 찾아도 안전하다.
+class JsonValue {
+public:
+    JsonValue() : doc(NULL), index(0) {}
+
+    bool valid() const { return doc != NULL; }
+    JsonType type() const;
+    bool isNull() const { return valid() && type() == JSON_NULL; }
+    bool isBool() const { return valid() && (type() == JSON_TRUE || type() == JSON_FALSE); }
+    bool isNumber() const { return valid() && type() == JSON_NUMBER; }
+    bool isString() const { return valid() && type() == JSON_STRING; }
+    bool isArray() const { return valid() && type() == JSON_ARRAY; }
+    bool isObject() const { return valid() && type() == JSON_OBJECT; }
+
+    // 배열의 원소 수, 객체의 member 수. 그 외에는 0.
+    size_t size() const;
+
+    // 객체에서 key 로 찾는다.
+    JsonValue operator[](std::string_view key) const;
+
+    // 배열의 i 번째 원소, 객체의 i 번째 member 의 값
+    JsonValue at(size_t i) const;
+
+    // 객체의 i 번째 member 의 key
+    JsonValue keyAt(size_t i) const;
+
+    // 원본 텍스트. 문자열은 따옴표를 뺀 내용이며 escape 는 풀지 않는다.
+    std::string_view raw() const;
+
+    // 문자열에 escape(\n, \uXXXX 등)가 들어있는지. 없으면 raw() 가 곧 값이다.
+    bool hasEscapes() const;
+
+    // 문자열 값이 s 와 같은지. escape 가 없으면 복사 없이 비교한다.
+    bool equals(std::string_view s) const;
+
+    // 값을 꺼낸다. 타입이 맞지 않거나 범위를 벗어나면 false.
+    bool getString(std::string& out) const;
+    bool getBool(bool& out) const;
+    bool getInt64(int64_t& out) const;
+    bool getDouble(double& out) const;
+
+private:
+    friend class JsonDocument;
+
+    JsonValue(const JsonDocument* doc, uint32_t index) : doc(doc), index(index) {}
+
+    const JsonDocument* doc;
+    uint32_t index;
+};
+
+// 텍스트를 복사하지 않고 그 자리에서 파싱하는 JSON reader.
+// 결과는 (타입, 원본에서의 위치, 하위 값들을 건너뛸 곳) 으로 된 token 배열이며, 값은 모두 원본을 가리킨다.
+// 문자열 안을 훑을 때는 SSE2 가 있으면 16바이트씩 '"', '\\', 제어 문자를 한 번에 찾는다.
+//
+// token 배열은 재사용되므로 한 문서 객체로 여러 번 parse() 하면 할당이 다시 일어나지 않는다.
+class JsonDocument {
+public:
+    explicit JsonDocument(size_t maxTokens = 4096, int maxDepth = 64);
+
+    // text 전체가 JSON 값 하나여야 한다. (앞뒤 공백은 괜찮다) 실패하면 false.
+    bool parse(std::string_view text);
+
+    JsonValue root() const;
+
+    // 실패한 위치와 이유
+    size_t errorOffset() const { return errorPos; }
+    const char* errorMessage() const { return error; }
+
+private:
+    friend class JsonValue;
+
+    struct Token {
+        uint8_t type;
+        bool escaped;    // 문자열 안에 '\\' 가 있다.
+        uint32_t start;  // 원본에서의 offset. 문자열은 여는 따옴표 다음.
+        uint32_t len;
+        uint32_t next;   // 이 값과 하위 값들 다음 token 의 index
+        uint32_t count;  // 배열 원소 수, 객체 member 수
+    };
+
+    bool parseValue(int depth);
+    bool parseString();
+    bool parseNumber();
+    bool parseLiteral(const char* literal, size_t len, JsonType type);
+    bool fail(const char* message);
+    void skipWhitespace();
+    uint32_t pushToken(JsonType type, size_t start);
+
+    std::string_view text;
+    size_t pos;
+    std::vector<Token> tokens;
+    size_t maxTokens;
+    int maxDepth;
+
+    size_t errorPos;
+    const char* error;
+};
+
+// 결과를 out 뒤에 바로 덧붙이는 JSON writer. 중간 문자열을 만들지 않는다.
+// 객체 안에서는 key() 다음에 값 하나를 쓴다. ','와 ':' 는 알아서 넣는다.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(std::string_view name);
+
+    void value(std::string_view s);
+    void value(const char* s) { value(std::string_view(s)); }
+    void value(int64_t n);
+    void value(int n) { value((int64_t)n); }
+    void value(double d);
+    void value(bool b);
+    void null();
+
+    // 지금까지 열어둔 객체/배열이 모두 닫혔는지
+    bool complete() const { return depth == 0; }
+
+private:
+    void separator();
+    void appendEscaped(std::string_view s);
+
+    std::string& out;
+    int depth;
+    uint64_t hasItems;  // depth 별로 이미 값이 하나 이상 있는지 (64단계까지)
+    bool afterKey;
+};
+
+#endif
@@ -0,0 +1,282 @@
+﻿#include "logger.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+atomic<int> logLevel(LOG_LEVEL_INFO);
+atomic<bool> accessLogEnabled(false);
+
+// record 하나의 크기와 쓰레드별 ring 의 record 수
+static const size_t LOG_RECORD_SIZE = 256;
+static const size_t LOG_RING_RECORDS = 1024;
+
+// background 쓰레드가 ring 들을 확인하는 간격. producer 는 깨우지 않으므로 로그는 최대 이만큼 늦게 찍힌다.
+static const int LOG_DRAIN_INTERVAL_MS = 10;
+
+// access log record 의 level 값
+static const uint8_t LOG_ACCESS = 0xff;
+
+struct LogRecord {
+    uint64_t timeUs;  // epoch 로부터의 microsecond
+    uint8_t level;
+    uint16_t len;
+    char text[LOG_RECORD_SIZE - 12];
+};
+
+// 쓰레드 하나가 쓰고 background 쓰레드 하나가 읽는 ring (single producer, single consumer)
+struct LogRing {
+    LogRing(int threadId) : records(new LogRecord[LOG_RING_RECORDS]), threadId(threadId),
+        head(0), tail(0), dropped(0), orphaned(false) {}
+    ~LogRing() { delete[] records; }
+
+    LogRecord* records;
+    int threadId;
+
+    alignas(64) atomic<size_t> head;  // 다음에 쓸 위치. producer 만 바꾼다.
+    alignas(64) atomic<size_t> tail;  // 다음에 읽을 위치. background 쓰레드만 바꾼다.
+    atomic<uint64_t> dropped;
+    atomic<bool> orphaned;            // 쓰레드가 끝나서 더 쓰지 않는다. 다 비우면 지운다.
+};
+
+static mutex ringsMutex;
+static vector<LogRing*> rings;
+static int nextThreadId = 0;
+static uint64_t droppedFromFreedRings = 0;
+
+static thread* drainThread = NULL;
+static mutex drainMutex;
+static condition_variable drainCv;
+static bool drainStop = false;
+static atomic<bool> running(false);
+
+// 쓰레드가 끝날 때 ring 을 orphaned 로 표시한다. ring 자체는 background 쓰레드가 다 비운 뒤 지운다.
+struct LogRingOwner {
+    LogRingOwner() : ring(NULL) {}
+    ~LogRingOwner() {
+        if (ring) {
+            ring->orphaned.store(true, memory_order_release);
+        }
+    }
+    LogRing* ring;
+};
+
+static thread_local LogRingOwner ringOwner;
+
+static LogRing* currentRing() {
+    if (!ringOwner.ring) {
+        lock_guard<mutex> lg(ringsMutex);
+        ringOwner.ring = new LogRing(nextThreadId++);
+        rings.push_back(ringOwner.ring);
+    }
+    return ringOwner.ring;
+}
+
+static uint64_t nowUs() {
+    return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const char* levelName(uint8_t level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG: return "DEBUG";
+    case LOG_LEVEL_INFO: return "INFO ";
+    case LOG_LEVEL_WARN: return "WARN ";
+    case LOG_LEVEL_ERROR: return "ERROR";
+    default: return "ACCESS";
+    }
+}
+
+// "2026-01-02 03:04:05.678901 INFO  [t2] message\n" 형태로 out 에 쓴다.
+static void writeRecord(FILE* out, const LogRecord& rec, int threadId) {
+    time_t seconds = (time_t)(rec.timeUs / 1000000);
+    struct tm t;
+#ifdef _WIN32
+    localtime_s(&t, &seconds);
+#else
+    localtime_r(&seconds, &t);
+#endif
+    fprintf(out, "%04d-%02d-%02d %02d:%02d:%02d.%06u %s [t%d] %.*s\n",
+        t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, (unsigned)(rec.timeUs % 1000000),
+        levelName(rec.level), threadId, (int)rec.len, rec.text);
+}
+
+// ring 에 record 하나를 채운다. 가득 차 있으면 버린다.
+static void pushRecord(uint8_t level, const char* format, va_list args) {
+    if (!running.load(memory_order_acquire)) {
+        // background 쓰레드가 없으면 바로 쓴다. (시작 전, 종료 후)
+        LogRecord rec;
+        rec.timeUs = nowUs();
+        rec.level = level;
+        int n = vsnprintf(rec.text, sizeof(rec.text), format, args);
+        rec.len = (uint16_t)(n < 0 ? 0 : (n >= (int)sizeof(rec.text) ? sizeof(rec.text) - 1 : n));
+        writeRecord(stderr, rec, -1);
+        return;
+    }
+
+    LogRing* ring = currentRing();
+    size_t head = ring->head.load(memory_order_relaxed);
+    if (head - ring->tail.load(memory_order_acquire) >= LOG_RING_RECORDS) {
+        ring->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord& rec = ring->records[head % LOG_RING_RECORDS];
+    rec.timeUs = nowUs();
+    rec.level = level;
+    int n = vsnprintf(rec.text, sizeof(rec.text), format, args);
+    rec.len = (uint16_t)(n < 0 ? 0 : (n >= (int)sizeof(rec.text) ? sizeof(rec.text) - 1 : n));
+    ring->head.store(head + 1, memory_order_release);
+}
+
+void logWrite(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pushRecord((uint8_t)level, format, args);
+    va_end(args);
+}
+
+static void pushFormatted(uint8_t level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pushRecord(level, format, args);
+    va_end(args);
+}
+
+void logAccess(const char* peer, const char* method, size_t methodLen, const char* path, size_t pathLen,
+    int status, size_t bytes, uint64_t elapsedUs) {
+    if (!accessLogEnabled.load(memory_order_relaxed)) {
+        return;
+    }
+    pushFormatted(LOG_ACCESS, "%s \"%.*s %.*s\" %d %llu %lluus", peer, (int)methodLen, method, (int)pathLen, path,
+        status, (unsigned long long)bytes, (unsigned long long)elapsedUs);
+}
+
+// 모든 ring 을 한 번 비운다. 다 비운 orphaned ring 은 지운다. 무언가 썼으면 true.
+// 출력하는 동안 ringsMutex 를 잡고 있으면 새 쓰레드의 첫 로그(currentRing)가 기다리게 되므로,
+// ring 목록만 복사해두고 lock 없이 비운다. ring 을 지우는 것은 이 쓰레드뿐이라 복사한 포인터는 그동안 유효하다.
+static bool drainOnce(FILE* out, uint64_t& reportedDropped) {
+    static vector<LogRing*> snapshot;
+    static vector<LogRing*> finished;
+    bool wrote = false;
+
+    {
+        lock_guard<mutex> lg(ringsMutex);
+        snapshot = rings;
+    }
+    finished.clear();
+    for (LogRing* ring : snapshot) {
+        // orphaned 를 먼저 읽어야 그 이후에 head 를 읽었을 때 마지막 record 까지 보인다.
+        bool orphaned = ring->orphaned.load(memory_order_acquire);
+        size_t tail = ring->tail.load(memory_order_relaxed);
+        size_t head = ring->head.load(memory_order_acquire);
+        for (; tail != head; ++tail) {
+            writeRecord(out, ring->records[tail % LOG_RING_RECORDS], ring->threadId);
+            wrote = true;
+        }
+        ring->tail.store(tail, memory_order_release);
+        if (orphaned) {
+            finished.push_back(ring);
+        }
+    }
+
+    uint64_t dropped = 0;
+    {
+        lock_guard<mutex> lg(ringsMutex);
+        for (LogRing* ring : finished) {
+            droppedFromFreedRings += ring->dropped.load(memory_order_relaxed);
+            for (size_t i = 0; i < rings.size(); ++i) {
+                if (rings[i] == ring) {
+                    rings[i] = rings.back();
+                    rings.pop_back();
+                    break;
+                }
+            }
+        }
+        dropped = droppedFromFreedRings;
+        for (LogRing* ring : rings) {
+            dropped += ring->dropped.load(memory_order_relaxed);
+        }
+    }
+    for (LogRing* ring : finished) {
+        delete ring;
+    }
+
+    // 새로 버려진 로그가 있으면 알린다.
+    if (dropped != reportedDropped) {
+        fprintf(out, "Logger dropped %llu records (total %llu)\n",
+            (unsigned long long)(dropped - reportedDropped), (unsigned long long)dropped);
+        reportedDropped = dropped;
+        wrote = true;
+    }
+    return wrote;
+}
+
+static void drainThreadProc() {
+    uint64_t reportedDropped = 0;
+    unique_lock<mutex> ul(drainMutex);
+    while (!drainStop) {
+        ul.unlock();
+        if (drainOnce(stdout, reportedDropped)) {
+            fflush(stdout);
+        }
+        ul.lock();
+        drainCv.wait_for(ul, chrono::milliseconds(LOG_DRAIN_INTERVAL_MS));
+    }
+    ul.unlock();
+
+    drainOnce(stdout, reportedDropped);
+    fflush(stdout);
+}
+
+void startLogger() {
+    if (drainThread) {
+        return;
+    }
+    drainStop = false;
+    running.store(true, memory_order_release);
+    drainThread = new thread(drainThreadProc);
+}
+
+void stopLogger() {
+    if (!drainThread) {
+        return;
+    }
+    // 이후의 로그는 바로 쓰고, 그 전에 ring 에 들어간 로그는 background 쓰레드가 마지막으로 비운다.
+    running.store(false, memory_order_release);
+    {
+        lock_guard<mutex> lg(drainMutex);
+        drainStop = true;
+    }
+    drainCv.notify_one();
+    drainThread->join();
+    delete drainThread;
+    drainThread = NULL;
+}
+
+uint64_t logDropped() {
+    lock_guard<mutex> lg(ringsMutex);
+    uint64_t dropped = droppedFromFreedRings;
+    for (LogRing* ring : rings) {
+        dropped += ring->dropped.load(memory_order_relaxed);
+    }
+    return dropped;
+}
+
+bool parseLogLevel(const char* s, LogLevel& level) {
+    static const char* NAMES[] = { "debug", "info", "warn", "error", "off" };
+    for (int i = 0; i <= LOG_LEVEL_OFF; ++i) {
+        if (strcmp(s, NAMES[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
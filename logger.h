@@ -0,0 +1,57 @@
+﻿#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+};
+
+// 현재 log level. 이보다 낮은 level 의 로그는 인자를 계산하지도 않고 버린다.
+extern std::atomic<int> logLevel;
+
+// access log (request 하나에 한 줄) 를 남길지
+extern std::atomic<bool> accessLogEnabled;
+
+inline bool logEnabled(LogLevel level) {
+    return (int)level >= logLevel.load(std::memory_order_relaxed);
+}
+
+// "debug", "info", "warn", "error", "off" 를 읽는다.
+bool parseLogLevel(const char* s, LogLevel& level);
+
+// 로그를 파일(stdout)로 써주는 background 쓰레드를 시작/종료한다.
+// 시작하기 전이나 종료한 뒤에 남긴 로그는 stderr 로 바로 쓴다.
+void startLogger();
+void stopLogger();
+
+// printf 형식으로 로그를 남긴다. 보통은 아래의 LOG_* 매크로를 쓴다.
+//
+// 쓰레드마다 고정 크기 record 들로 된 lock-free ring 을 하나씩 가지며, 여기서는 그 ring 에 record 하나를 채우기만 한다.
+// 시간 포맷팅과 파일 쓰기는 background 쓰레드가 한다. ring 이 가득 차면 기다리지 않고 버리며 버린 개수를 센다.
+// record 하나에 들어가지 않는 긴 메시지는 잘린다.
+#if defined(__GNUC__)
+void logWrite(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+#else
+void logWrite(LogLevel level, const char* format, ...);
+#endif
+
+// access log 한 줄. level 과 상관없이 accessLogEnabled 일 때만 남는다.
+void logAccess(const char* peer, const char* method, size_t methodLen, const char* path, size_t pathLen,
+    int status, size_t bytes, uint64_t elapsedUs);
+
+// 버려진 로그 record 수 (모든 쓰레드 합계)
+uint64_t logDropped();
+
+#define LOG_DEBUG(...) do { if (logEnabled(LOG_LEVEL_DEBUG)) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0)
+#define LOG_INFO(...) do { if (logEnabled(LOG_LEVEL_INFO)) logWrite(LOG_LEVEL_INFO, __VA_ARGS__); } while (0)
+#define LOG_WARN(...) do { if (logEnabled(LOG_LEVEL_WARN)) logWrite(LOG_LEVEL_WARN, __VA_ARGS__); } while (0)
+#define LOG_ERROR(...) do { if (logEnabled(LOG_LEVEL_ERROR)) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__); } while (0)
+
+#endif
@@ -0,0 +1,279 @@
+﻿#include "metrics.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+atomic<bool> metricsEnabled(false);
+
+uint64_t metricsNowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 가장 높은 1 비트의 위치. v 는 0 이 아니어야 한다.
+static int highestBit(uint64_t v) {
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#elif defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int bit = 0;
+    while (v >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() : total(0), sumNs(0), maxNs(0) {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i].store(0, memory_order_relaxed);
+    }
+}
+
+// 값이 SUB_BUCKETS 보다 작으면 그대로 index 이다.
+// 그보다 크면 [2^k, 2^(k+1)) 구간을 SUB_BUCKETS 등분한다. shift = k - SUB_BUCKET_BITS 일 때
+// (ns >> shift) 는 [SUB_BUCKETS, 2 * SUB_BUCKETS) 에 들어가므로 index 가 구간 사이에서 이어진다.
+int LatencyHistogram::bucketIndex(uint64_t ns) {
+    if (ns < (uint64_t)SUB_BUCKETS) {
+        return (int)ns;
+    }
+    int bit = highestBit(ns);
+    if (bit >= MAX_VALUE_BITS) {
+        return NUM_BUCKETS - 1;
+    }
+    int shift = bit - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKETS + (int)(ns >> shift);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index) {
+    if (index < SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    uint64_t mantissa = (uint64_t)(index - shift * SUB_BUCKETS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+// 쓰는 쓰레드가 하나이므로 lock 이 붙는 fetch_add 대신 읽고 쓰기만 한다.
+void LatencyHistogram::record(uint64_t ns) {
+    atomic<uint64_t>& bucket = buckets[bucketIndex(ns)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    total.store(total.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    sumNs.store(sumNs.load(memory_order_relaxed) + ns, memory_order_relaxed);
+    if (ns > maxNs.load(memory_order_relaxed)) {
+        maxNs.store(ns, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::mergeInto(LatencyHistogram& other) const {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        uint64_t n = buckets[i].load(memory_order_relaxed);
+        if (n) {
+            other.buckets[i].fetch_add(n, memory_order_relaxed);
+        }
+    }
+    other.total.fetch_add(count(), memory_order_relaxed);
+    other.sumNs.fetch_add(sum(), memory_order_relaxed);
+    if (max() > other.max()) {
+        other.maxNs.store(max(), memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    // 쓰는 중에 읽으면 bucket 합과 total 이 조금 다를 수 있으므로 bucket 을 직접 센다.
+    uint64_t n = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        n += buckets[i].load(memory_order_relaxed);
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(q * (double)n + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets[i].load(memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            return bound < max() ? bound : max();
+        }
+    }
+    return max();
+}
+
+// 쓰레드 하나의 값들. 쓰레드가 처음 기록할 때 만들어서 목록에 넣는다.
+// 쓰레드가 끝나도 합계가 줄지 않도록 지우지 않는다. (worker 와 shard 쓰레드는 서버가 끝날 때까지 산다)
+struct ThreadMetrics {
+    ThreadMetrics() {
+        for (int i = 0; i < NUM_METRIC_COUNTERS; ++i) {
+            counters[i].store(0, memory_order_relaxed);
+        }
+    }
+
+    alignas(64) atomic<uint64_t> counters[NUM_METRIC_COUNTERS];
+    LatencyHistogram stages[NUM_METRIC_STAGES];
+};
+
+static mutex threadMetricsMutex;
+static vector<ThreadMetrics*> threadMetrics;
+static thread_local ThreadMetrics* currentMetrics = NULL;
+
+static ThreadMetrics* metricsForThisThread() {
+    if (!currentMetrics) {
+        currentMetrics = new ThreadMetrics();
+        lock_guard<mutex> lg(threadMetricsMutex);
+        threadMetrics.push_back(currentMetrics);
+    }
+    return currentMetrics;
+}
+
+void metricsAdd(MetricCounter counter, uint64_t n) {
+    atomic<uint64_t>& c = metricsForThisThread()->counters[counter];
+    c.store(c.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void metricsRecord(MetricStage stage, uint64_t ns) {
+    metricsForThisThread()->stages[stage].record(ns);
+}
+
+uint64_t metricsCounter(MetricCounter counter) {
+    uint64_t total = 0;
+    lock_guard<mutex> lg(threadMetricsMutex);
+    for (ThreadMetrics* m : threadMetrics) {
+        total += m->counters[counter].load(memory_order_relaxed);
+    }
+    return total;
+}
+
+static const char* STAGE_NAMES[NUM_METRIC_STAGES] = {
+    "queue_wait", "header_parse", "body_read", "handler", "send", "request",
+};
+
+struct CounterInfo {
+    const char* name;
+    const char* label;  // 같은 이름을 label 로 나누는 경우 (없으면 NULL)
+    const char* help;
+};
+
+// MetricCounter 순서와 같다. 같은 이름은 이어져 있어야 HELP/TYPE 을 한 번만 쓴다.
+static const CounterInfo COUNTERS[NUM_METRIC_COUNTERS] = {
+    { "rest_connections_accepted_total", NULL, "Accepted connections" },
+    { "rest_connections_closed_total", NULL, "Closed connections" },
+    { "rest_connections_rejected_total", NULL, "Connections refused with 503 because of --max-connections or a full connection table" },
+    { "rest_requests_total", NULL, "Parsed requests" },
+    { "rest_responses_total", "class=\"2xx\"", "Responses by status class" },
+    { "rest_responses_total", "class=\"3xx\"", "Responses by status class" },
+    { "rest_responses_total", "class=\"4xx\"", "Responses by status class" },
+    { "rest_responses_total", "class=\"5xx\"", "Responses by status class" },
+    { "rest_received_bytes_total", NULL, "Bytes received from clients" },
+    { "rest_sent_bytes_total", NULL, "Bytes sent to clients" },
+    { "rest_parse_errors_total", NULL, "Requests rejected by the HTTP parser" },
+    { "rest_recv_errors_total", NULL, "Failed recv calls" },
+    { "rest_send_errors_total", NULL, "Failed send calls" },
+    { "rest_accept_errors_total", NULL, "Failed accept calls" },
+    { "rest_accept_batches_total", NULL, "Listener wakeups that accepted at least one connection" },
+    { "rest_timeouts_total", "kind=\"idle\"", "Connections closed by a timeout" },
+    { "rest_timeouts_total", "kind=\"header\"", "Connections closed by a timeout" },
+    { "rest_timeouts_total", "kind=\"body\"", "Connections closed by a timeout" },
+    { "rest_timeouts_total", "kind=\"send\"", "Connections closed by a timeout" },
+    { "rest_response_cache_total", "result=\"hit\"", "Cacheable requests by response cache result" },
+    { "rest_response_cache_total", "result=\"miss\"", "Cacheable requests by response cache result" },
+    { "rest_shed_total", "reason=\"queue\"", "Requests refused with 503 because the server was overloaded" },
+    { "rest_shed_total", "reason=\"delay\"", "Requests refused with 503 because the server was overloaded" },
+    { "rest_shed_total", "reason=\"inflight\"", "Requests refused with 503 because the server was overloaded" },
+};
+
+// printf 형식으로 out 뒤에 붙인다. 한 줄이 256 바이트를 넘지 않는 곳에만 쓴다.
+#if defined(__GNUC__)
+static void appendf(string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+#endif
+
+static void appendf(string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len > 0) {
+        out.append(buffer, (size_t)len < sizeof(buffer) ? (size_t)len : sizeof(buffer) - 1);
+    }
+}
+
+void writeMetricsGauge(string& out, const char* name, const char* help, uint64_t value) {
+    appendf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+void writeMetricsCounter(string& out, const char* name, const char* help, uint64_t value) {
+    appendf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+void writeMetrics(string& out) {
+    // 쓰레드별 값을 합친다. 쓰는 쪽을 멈추지 않으므로 값들 사이가 완전히 일관되지는 않는다.
+    uint64_t counters[NUM_METRIC_COUNTERS] = {};
+    vector<LatencyHistogram*> stages;
+    for (int s = 0; s < NUM_METRIC_STAGES; ++s) {
+        stages.push_back(new LatencyHistogram());
+    }
+    {
+        lock_guard<mutex> lg(threadMetricsMutex);
+        for (ThreadMetrics* m : threadMetrics) {
+            for (int i = 0; i < NUM_METRIC_COUNTERS; ++i) {
+                counters[i] += m->counters[i].load(memory_order_relaxed);
+            }
+            for (int s = 0; s < NUM_METRIC_STAGES; ++s) {
+                m->stages[s].mergeInto(*stages[s]);
+            }
+        }
+    }
+
+    for (int i = 0; i < NUM_METRIC_COUNTERS; ++i) {
+        const CounterInfo& c = COUNTERS[i];
+        if (i == 0 || strcmp(c.name, COUNTERS[i - 1].name) != 0) {
+            appendf(out, "# HELP %s %s\n# TYPE %s counter\n", c.name, c.help, c.name);
+        }
+        if (c.label) {
+            appendf(out, "%s{%s} %llu\n", c.name, c.label, (unsigned long long)counters[i]);
+        } else {
+            appendf(out, "%s %llu\n", c.name, (unsigned long long)counters[i]);
+        }
+    }
+    writeMetricsGauge(out, "rest_connections_active", "Open connections",
+        counters[COUNTER_CONNECTIONS_ACCEPTED] - counters[COUNTER_CONNECTIONS_CLOSED] - counters[COUNTER_CONNECTIONS_REJECTED]);
+
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    out.append("# HELP rest_stage_latency_seconds Time spent in each stage of a request\n"
+        "# TYPE rest_stage_latency_seconds summary\n");
+    for (int s = 0; s < NUM_METRIC_STAGES; ++s) {
+        const LatencyHistogram& h = *stages[s];
+        for (double q : QUANTILES) {
+            appendf(out, "rest_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                STAGE_NAMES[s], q, h.percentile(q) / 1e9);
+        }
+        appendf(out, "rest_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n", STAGE_NAMES[s], h.sum() / 1e9);
+        appendf(out, "rest_stage_latency_seconds_count{stage=\"%s\"} %llu\n", STAGE_NAMES[s], (unsigned long long)h.count());
+    }
+    out.append("# HELP rest_stage_latency_max_seconds Longest time spent in each stage\n"
+        "# TYPE rest_stage_latency_max_seconds gauge\n");
+    for (int s = 0; s < NUM_METRIC_STAGES; ++s) {
+        appendf(out, "rest_stage_latency_max_seconds{stage=\"%s\"} %.9f\n", STAGE_NAMES[s], stages[s]->max() / 1e9);
+    }
+
+    for (LatencyHistogram* h : stages) {
+        delete h;
+    }
+}
@@ -0,0 +1,112 @@
+﻿#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 단계별 지연 시간. 하나의 request 가 지나가는 순서대로다.
+enum MetricStage {
+    STAGE_QUEUE_WAIT,    // poller 가 이벤트를 받고 worker 가 꺼내갈 때까지 (handoff 모드)
+    STAGE_HEADER_PARSE,  // 헤더를 파싱하는 데 쓴 CPU 시간 (여러 번의 recv 에 나뉘었으면 합계)
+    STAGE_BODY_READ,     // 헤더를 다 받은 뒤 body 를 다 받을 때까지 (body 가 있는 request 만)
+    STAGE_HANDLER,       // handler 가 response 를 만드는 시간
+    STAGE_SEND,          // 출력 큐를 한 번 보내는 시간
+    STAGE_REQUEST,       // request 의 첫 바이트를 받은 뒤 response 를 출력 큐에 넣을 때까지
+    NUM_METRIC_STAGES,
+};
+
+enum MetricCounter {
+    COUNTER_CONNECTIONS_ACCEPTED,
+    COUNTER_CONNECTIONS_CLOSED,
+    COUNTER_CONNECTIONS_REJECTED,  // --max-connections 를 넘었거나 연결 테이블이 가득 차서 503 을 보내고 닫은 연결
+    COUNTER_REQUESTS,
+    COUNTER_RESPONSES_2XX,
+    COUNTER_RESPONSES_3XX,
+    COUNTER_RESPONSES_4XX,
+    COUNTER_RESPONSES_5XX,
+    COUNTER_BYTES_IN,
+    COUNTER_BYTES_OUT,
+    COUNTER_PARSE_ERRORS,
+    COUNTER_RECV_ERRORS,
+    COUNTER_SEND_ERRORS,
+    COUNTER_ACCEPT_ERRORS,
+    COUNTER_ACCEPT_BATCHES,  // listener 가 깨어나서 연결을 하나 이상 받은 횟수. 받은 연결 수를 이것으로 나누면 한 번에 받은 평균이다.
+    COUNTER_TIMEOUTS_IDLE,
+    COUNTER_TIMEOUTS_HEADER,
+    COUNTER_TIMEOUTS_BODY,
+    COUNTER_TIMEOUTS_SEND,
+    COUNTER_CACHE_HITS,    // response cache 에서 보낸 응답 (304 포함)
+    COUNTER_CACHE_MISSES,  // handler 를 돌려서 만든 응답
+    COUNTER_SHED_QUEUE,     // job queue 가 --max-queue 만큼 차서 503 으로 돌려보낸 request
+    COUNTER_SHED_DELAY,     // CoDel 이 job queue 대기 시간을 보고 버린 request
+    COUNTER_SHED_INFLIGHT,  // 보내지 못한 response 가 --max-inflight 만큼 쌓인 연결의 request
+    NUM_METRIC_COUNTERS,
+};
+
+// 수집 여부. 꺼져 있으면 계측 지점은 이 값 하나만 읽고 지나가며, 시각도 재지 않는다.
+extern std::atomic<bool> metricsEnabled;
+
+inline bool metricsOn() {
+    return metricsEnabled.load(std::memory_order_relaxed);
+}
+
+// 단조 증가하는 시각 (nanosecond)
+uint64_t metricsNowNs();
+
+// HDR 방식의 지연 시간 히스토그램. 값은 nanosecond 이다.
+// 2의 거듭제곱 구간마다 32개의 같은 폭 bucket 을 두므로 어느 크기의 값이든 상대 오차가 1/32 이하다.
+// 쓰는 쓰레드는 하나여야 한다. 다른 쓰레드는 쓰는 중에도 mergeInto() 로 읽을 수 있다.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_VALUE_BITS = 40;  // 약 18분. 더 큰 값은 마지막 bucket 에 넣는다.
+    static const int NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+
+    // 다른 히스토그램에 이 히스토그램의 값들을 더한다.
+    void mergeInto(LatencyHistogram& other) const;
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sumNs.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxNs.load(std::memory_order_relaxed); }
+
+    // q (0 ~ 1) 분위수. 그 값이 들어있는 bucket 의 상한을 돌려준다.
+    uint64_t percentile(double q) const;
+
+    static int bucketIndex(uint64_t ns);
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sumNs;
+    std::atomic<uint64_t> maxNs;
+};
+
+// 지금 쓰레드의 counter/히스토그램에 더한다. 쓰레드마다 따로 가지므로 공유 cache line 에 쓰지 않는다.
+// 부르는 쪽에서 metricsOn() 을 먼저 확인한다.
+void metricsAdd(MetricCounter counter, uint64_t n = 1);
+void metricsRecord(MetricStage stage, uint64_t ns);
+
+// 모든 쓰레드의 값을 합친 counter
+uint64_t metricsCounter(MetricCounter counter);
+
+// 모든 쓰레드의 값을 합쳐 Prometheus text format 으로 out 뒤에 쓴다.
+void writeMetrics(std::string& out);
+
+// 호출하는 쪽이 가진 gauge 하나를 Prometheus text format 으로 쓴다.
+void writeMetricsGauge(std::string& out, const char* name, const char* help, uint64_t value);
+
+// 호출하는 쪽이 세는 counter 하나를 Prometheus text format 으로 쓴다. (예: scheduler 통계)
+void writeMetricsCounter(std::string& out, const char* name, const char* help, uint64_t value);
+
+#endif
@@ -0,0 +1,51 @@
+﻿#include "overload.h"
+
+using namespace std;
+
+const char OVERLOAD_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+const size_t OVERLOAD_RESPONSE_LEN = sizeof(OVERLOAD_RESPONSE) - 1;
+
+void sendOverloadResponse(SOCKET sock) {
+    // 버리는 request 이므로 읽기만 한다. 너무 오래 붙잡지 않도록 몇 번만 읽는다.
+    char discard[4096];
+    for (int i = 0; i < 16; ++i) {
+        int r = recv(sock, discard, (int)sizeof(discard), 0);
+        if (r <= 0) {
+            break;
+        }
+    }
+    send(sock, OVERLOAD_RESPONSE, (int)OVERLOAD_RESPONSE_LEN, MSG_NOSIGNAL);
+}
+
+CoDel::CoDel() : targetNs(0), intervalNs(0), intervalEndNs(0), minDelayNs(0), overloadedFlag(false) {
+}
+
+void CoDel::configure(uint64_t targetMs, uint64_t intervalMs) {
+    targetNs = targetMs * 1000000;
+    intervalNs = intervalMs * 1000000;
+}
+
+bool CoDel::shouldShed(uint64_t delayNs, uint64_t nowNs) {
+    if (targetNs == 0) {
+        return false;
+    }
+
+    uint64_t end = intervalEndNs.load(memory_order_relaxed);
+    if (nowNs >= end) {
+        // 구간이 끝났다. 한 쓰레드만 구간을 넘기고 지난 구간의 최소값으로 과부하 여부를 정한다.
+        if (intervalEndNs.compare_exchange_strong(end, nowNs + intervalNs, memory_order_relaxed)) {
+            uint64_t minDelay = minDelayNs.exchange(delayNs, memory_order_relaxed);
+            overloadedFlag.store(minDelay > targetNs, memory_order_relaxed);
+        }
+    } else {
+        uint64_t current = minDelayNs.load(memory_order_relaxed);
+        while (delayNs < current && !minDelayNs.compare_exchange_weak(current, delayNs, memory_order_relaxed)) {
+        }
+    }
+    return overloadedFlag.load(memory_order_relaxed) && delayNs > 2 * targetNs;
+}
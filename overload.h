@@ -0,0 +1,51 @@
+﻿#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "platform.h"
+
+// 부하를 덜어낼 때 보내는 503 응답. 1초 뒤에 다시 시도하라고(Retry-After) 알려주고 연결은 닫는다.
+extern const char OVERLOAD_RESPONSE[];
+extern const size_t OVERLOAD_RESPONSE_LEN;
+
+// request 를 파싱하지 않고 끊을 소켓에 OVERLOAD_RESPONSE 를 보낸다. non-blocking 소켓이어야 한다.
+// 받은 바이트를 읽지 않고 닫으면 RST 가 나가서 상대가 503 을 못 읽을 수 있으므로, 받을 수 있는 만큼 읽어서 버린다.
+// 보내기는 한 번만 시도한다. 호출한 뒤에 소켓을 닫는다.
+void sendOverloadResponse(SOCKET sock);
+
+// CoDel 방식의 admission control. (Nichols & Jacobson, 그리고 큐에 쌓인 request 에 적용한 folly 의 변형)
+// 큐 길이 대신 큐에서 기다린 시간을 본다. 한 구간(interval) 동안 가장 짧게 기다린 작업조차 target 보다 오래 기다렸다면
+// 잠깐 몰린 것이 아니라 큐가 줄지 않고 있는 것이므로, 다음 구간 동안은 target 의 두 배보다 오래 기다린 작업을 버린다.
+// 순간적인 burst 는 구간 안의 최소값이 낮으므로 버리지 않는다.
+//
+// 여러 쓰레드가 같이 부른다.
+class CoDel {
+public:
+    CoDel();
+
+    // targetMs 가 0 이면 아무것도 버리지 않는다.
+    void configure(uint64_t targetMs, uint64_t intervalMs);
+
+    bool enabled() const { return targetNs > 0; }
+
+    // 큐에서 delayNs 동안 기다린 작업을 꺼냈다. 버려야 하면 true.
+    bool shouldShed(uint64_t delayNs, uint64_t nowNs);
+
+    // 지금 과부하 상태로 보고 있는지 (metrics 용)
+    bool overloaded() const { return overloadedFlag.load(std::memory_order_relaxed); }
+
+private:
+    CoDel(const CoDel&);
+    CoDel& operator=(const CoDel&);
+
+    uint64_t targetNs;
+    uint64_t intervalNs;
+    std::atomic<uint64_t> intervalEndNs;
+    std::atomic<uint64_t> minDelayNs;  // 지금 구간에서 가장 짧게 기다린 시간
+    std::atomic<bool> overloadedFlag;
+};
+
+#endif
@@ -0,0 +1,114 @@
+﻿#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Winsock 과 POSIX socket API 의 차이를 흡수한다.
+// 서버 코드는 Winsock 이름(SOCKET, INVALID_SOCKET, closesocket 등)을 그대로 쓰고,
+// Linux 에서는 아래 정의들이 그것을 POSIX 함수로 바꿔준다.
+
+#ifdef _WIN32
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+// ws2_32.lib 를 링크한다.
+#pragma comment(lib, "Ws2_32.lib")
+
+// Winsock 의 send() 는 SIGPIPE 를 내지 않는다.
+#define MSG_NOSIGNAL 0
+
+#else
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket(s) ::close(s)
+#define SD_BOTH SHUT_RDWR
+#define WSAGetLastError() (errno)
+#define sprintf_s snprintf
+
+#endif
+
+// gathered write 에 쓰는 버퍼 조각. (Windows: WSABUF, POSIX: iovec)
+#ifdef _WIN32
+typedef WSABUF IoBuf;
+
+inline void setIoBuf(IoBuf& b, const char* data, size_t len) {
+    b.buf = (CHAR*)data;
+    b.len = (ULONG)len;
+}
+inline size_t ioBufLen(const IoBuf& b) { return b.len; }
+
+#else
+typedef struct iovec IoBuf;
+
+inline void setIoBuf(IoBuf& b, const char* data, size_t len) {
+    b.iov_base = (void*)data;
+    b.iov_len = len;
+}
+inline size_t ioBufLen(const IoBuf& b) { return b.iov_len; }
+#endif
+
+// 동시에 넘길 수 있는 IoBuf 최대 개수. (POSIX 의 IOV_MAX 는 보통 1024)
+static const int IOBUF_MAX = 1024;
+
+// count 개의 버퍼를 한 번의 syscall 로 보낸다. 보낸 바이트 수나 SOCKET_ERROR 를 반환한다.
+inline long long sendGathered(SOCKET sock, IoBuf* bufs, int count) {
+#ifdef _WIN32
+    DWORD sent = 0;
+    if (WSASend(sock, bufs, (DWORD)count, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return sent;
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = bufs;
+    msg.msg_iovlen = count;
+    return sendmsg(sock, &msg, MSG_NOSIGNAL);
+#endif
+}
+
+// non-blocking 소켓 호출이 지금은 할 수 없어서 실패한 것인지. 나중에 다시 시도하면 된다.
+inline bool socketWouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// 소켓 호출이 fd 나 메모리 같은 자원이 모자라서 실패했는지. 자원이 풀릴 때까지 잠시 기다렸다가 다시 시도해야 한다.
+inline bool socketOutOfResources(int error) {
+#ifdef _WIN32
+    return error == WSAEMFILE || error == WSAENOBUFS;
+#else
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+#endif
+}
+
+// 소켓을 non-blocking 모드로 바꾼다.
+inline bool setSocketNonBlocking(SOCKET sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+#endif
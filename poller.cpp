@@ -0,0 +1,256 @@
+﻿#include "poller.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "logger.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+using namespace std;
+
+Poller* Poller::create() {
+#ifdef __linux__
+    EpollPoller* epoller = new EpollPoller();
+    if (epoller->valid()) {
+        return epoller;
+    }
+    LOG_WARN("epoll_create1 failed with error %d. Falling back to select", WSAGetLastError());
+    delete epoller;
+#endif
+    return new SelectPoller();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SelectPoller
+
+SelectPoller::SelectPoller() : wakeSock(INVALID_SOCKET) {
+    // 127.0.0.1 의 임의 포트에 UDP 소켓을 bind 하고 자기 자신에게 connect 한다.
+    wakeSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wakeSock == INVALID_SOCKET) {
+        LOG_ERROR("socket(wakeup) failed with error %d", WSAGetLastError());
+        return;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr.s_addr);
+
+    socklen_t addrLen = sizeof(addr);
+    if (::bind(wakeSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+        || getsockname(wakeSock, (sockaddr*)&addr, &addrLen) == SOCKET_ERROR
+        || connect(wakeSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        LOG_ERROR("wakeup socket setup failed with error %d", WSAGetLastError());
+        closesocket(wakeSock);
+        wakeSock = INVALID_SOCKET;
+        return;
+    }
+
+    // 쌓인 wakeup 바이트를 비울 때 blocking 되지 않도록 한다.
+    setSocketNonBlocking(wakeSock);
+}
+
+SelectPoller::~SelectPoller() {
+    if (wakeSock != INVALID_SOCKET) {
+        closesocket(wakeSock);
+    }
+}
+
+void SelectPoller::wakeup() {
+    if (wakeSock != INVALID_SOCKET) {
+        char b = 0;
+        send(wakeSock, &b, 1, 0);
+    }
+}
+
+bool SelectPoller::add(SOCKET sock, uint64_t token, int interest) {
+    {
+        lock_guard<mutex> lg(entriesMutex);
+        Entry entry = { token, interest, true };
+        entries[sock] = entry;
+    }
+    wakeup();
+    return true;
+}
+
+bool SelectPoller::rearm(SOCKET sock, uint64_t token, int interest) {
+    {
+        lock_guard<mutex> lg(entriesMutex);
+        auto it = entries.find(sock);
+        if (it == entries.end()) {
+            return false;
+        }
+        it->second.token = token;
+        it->second.interest = interest;
+        it->second.armed = true;
+    }
+    wakeup();
+    return true;
+}
+
+void SelectPoller::remove(SOCKET sock) {
+    lock_guard<mutex> lg(entriesMutex);
+    entries.erase(sock);
+}
+
+int SelectPoller::wait(PollEvent* events, int maxEvents, int timeoutMs) {
+    fd_set readSet, writeSet, exceptionSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    FD_ZERO(&exceptionSet);
+
+    // select 의 첫번째 인자는 max socket 번호에 1을 더한 값이다. (Windows 에서는 무시된다)
+    SOCKET maxSock = 0;
+    if (wakeSock != INVALID_SOCKET) {
+        FD_SET(wakeSock, &readSet);
+        maxSock = wakeSock;
+    }
+
+    // armed 상태인 소켓만 select 대상으로 한다.
+    {
+        lock_guard<mutex> lg(entriesMutex);
+        for (auto& entry : entries) {
+            if (entry.second.armed) {
+                if (entry.second.interest & POLL_READ) {
+                    FD_SET(entry.first, &readSet);
+                }
+                if (entry.second.interest & POLL_WRITE) {
+                    FD_SET(entry.first, &writeSet);
+                }
+                FD_SET(entry.first, &exceptionSet);
+                maxSock = max(maxSock, entry.first);
+            }
+        }
+    }
+
+    struct timeval timeout;
+    struct timeval* timeoutPtr = NULL;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_usec = (timeoutMs % 1000) * 1000;
+        timeoutPtr = &timeout;
+    }
+
+    int r = select((int)maxSock + 1, &readSet, &writeSet, &exceptionSet, timeoutPtr);
+    if (r == SOCKET_ERROR) {
+        // 시그널로 깨어난 경우는 오류가 아니다.
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEINTR ? 0 : -1;
+#else
+        return errno == EINTR ? 0 : -1;
+#endif
+    } else if (r == 0) {
+        return 0;
+    }
+
+    // 깨우기용으로 들어온 바이트는 모두 버린다.
+    if (wakeSock != INVALID_SOCKET && FD_ISSET(wakeSock, &readSet)) {
+        char drain[64];
+        while (recv(wakeSock, drain, sizeof(drain), 0) > 0) {
+        }
+    }
+
+    // 이벤트가 발생한 소켓은 armed 를 꺼서 one-shot 으로 동작하게 한다.
+    // select 도중 remove() 된 소켓은 entries 에 없으므로 자연스럽게 걸러진다.
+    int n = 0;
+    lock_guard<mutex> lg(entriesMutex);
+    for (auto& entry : entries) {
+        if (n >= maxEvents) {
+            break;
+        }
+        if (!entry.second.armed) {
+            continue;
+        }
+
+        bool readable = FD_ISSET(entry.first, &readSet) != 0;
+        bool writable = FD_ISSET(entry.first, &writeSet) != 0;
+        bool error = FD_ISSET(entry.first, &exceptionSet) != 0;
+        if (readable || writable || error) {
+            entry.second.armed = false;
+            events[n].token = entry.second.token;
+            events[n].readable = readable;
+            events[n].writable = writable;
+            events[n].error = error;
+            ++n;
+        }
+    }
+    return n;
+}
+
+#ifdef __linux__
+///////////////////////////////////////////////////////////////////////////////
+// EpollPoller
+
+// edge-triggered + one-shot. EPOLL_CTL_MOD 로 rearm 하면 커널이 readiness 를 다시 확인하므로
+// worker 가 버퍼를 다 비우지 못하고 돌려놓더라도 이벤트를 잃어버리지 않는다.
+// EPOLLRDHUP 은 읽기를 원할 때만 건다. 읽기를 멈춘 동안 상대가 반쯤 닫으면 rearm 할 때마다 다시 보고되기 때문이다.
+static uint32_t epollFlags(int interest) {
+    uint32_t flags = EPOLLET | EPOLLONESHOT;
+    if (interest & POLL_READ) {
+        flags |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (interest & POLL_WRITE) {
+        flags |= EPOLLOUT;
+    }
+    return flags;
+}
+
+EpollPoller::EpollPoller() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EpollPoller::~EpollPoller() {
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+bool EpollPoller::add(SOCKET sock, uint64_t token, int interest) {
+    struct epoll_event ev;
+    ev.events = epollFlags(interest);
+    ev.data.u64 = token;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev) == 0;
+}
+
+bool EpollPoller::rearm(SOCKET sock, uint64_t token, int interest) {
+    struct epoll_event ev;
+    ev.events = epollFlags(interest);
+    ev.data.u64 = token;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, sock, &ev) == 0;
+}
+
+void EpollPoller::remove(SOCKET sock) {
+    // 커널 2.6.9 이전에는 event 인자가 NULL 이면 안 되므로 빈 구조체를 넘긴다.
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, sock, &ev);
+}
+
+int EpollPoller::wait(PollEvent* events, int maxEvents, int timeoutMs) {
+    struct epoll_event evs[256];
+    if (maxEvents > 256) {
+        maxEvents = 256;
+    }
+
+    int r = epoll_wait(epollFd, evs, maxEvents, timeoutMs);
+    if (r < 0) {
+        // 시그널로 깨어난 경우는 오류가 아니다.
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < r; ++i) {
+        events[i].token = evs[i].data.u64;
+        // 상대가 연결을 끊은 경우(EPOLLRDHUP/EPOLLHUP)는 readable 로 보고한다.
+        // worker 의 recv() 가 0 을 반환하면서 정상적인 종료 처리를 하게 된다.
+        events[i].readable = (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0;
+        events[i].writable = (evs[i].events & EPOLLOUT) != 0;
+        events[i].error = (evs[i].events & EPOLLERR) != 0;
+    }
+    return r;
+}
+#endif
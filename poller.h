@@ -0,0 +1,104 @@
+﻿#ifndef POLLER_H
+#define POLLER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "platform.h"
+
+// poller 가 돌려주는 이벤트 하나.
+// token 은 add() 할 때 넘겨준 값으로, 어떤 연결의 이벤트인지 구분하는 데 쓴다.
+struct PollEvent {
+    uint64_t token;
+    bool readable;
+    bool writable;
+    bool error;
+};
+
+// add()/rearm() 에 넘기는 관심 이벤트. 오류는 항상 보고된다.
+enum PollInterest {
+    POLL_READ = 1,
+    POLL_WRITE = 2,
+};
+
+// 소켓 readiness 를 기다리는 방식을 감춘 인터페이스.
+// 모든 등록은 one-shot 이다. 이벤트가 한 번 보고되면 그 소켓은 rearm() 을 호출할 때까지
+// 다시 보고되지 않는다. 따라서 이벤트를 받은 쓰레드가 그 소켓을 독점하게 되고,
+// 작업이 끝난 worker 가 직접 rearm() 을 호출해서 다시 감시 대상으로 돌려놓는다.
+class Poller {
+public:
+    virtual ~Poller() {}
+
+    virtual const char* name() const = 0;
+
+    // 소켓을 등록하고 바로 감시를 시작한다. interest 는 PollInterest 를 OR 한 값이다.
+    virtual bool add(SOCKET sock, uint64_t token, int interest = POLL_READ) = 0;
+
+    // 이벤트가 보고된 뒤 꺼져있는 소켓을 다시 감시 대상으로 만든다. 어느 쓰레드에서 불러도 된다.
+    // 보낼 response 가 밀려있으면 POLL_WRITE 를 같이 넘긴다.
+    virtual bool rearm(SOCKET sock, uint64_t token, int interest = POLL_READ) = 0;
+
+    // 소켓을 감시 대상에서 완전히 뺀다. closesocket() 전에 호출해야 한다.
+    virtual void remove(SOCKET sock) = 0;
+
+    // 이벤트를 최대 maxEvents 개까지 채운다. timeoutMs 가 음수면 무한정 기다린다.
+    // 반환값은 채운 이벤트 수이며, 오류인 경우 -1 이다.
+    virtual int wait(PollEvent* events, int maxEvents, int timeoutMs) = 0;
+
+    // 현재 플랫폼에서 쓸 수 있는 가장 좋은 poller 를 만든다. (Linux: epoll, 그 외: select)
+    static Poller* create();
+};
+
+// select() 기반 구현. epoll 이 없는 플랫폼(Windows)을 위한 fallback 이다.
+// 다른 쓰레드에서 rearm() 이 불리면 loopback UDP 소켓으로 select() 를 깨운다.
+// 그래서 예전처럼 짧은 timeout 으로 doingRecv 플래그를 계속 확인할 필요가 없다.
+class SelectPoller : public Poller {
+public:
+    SelectPoller();
+    ~SelectPoller();
+
+    const char* name() const { return "select"; }
+    bool add(SOCKET sock, uint64_t token, int interest = POLL_READ);
+    bool rearm(SOCKET sock, uint64_t token, int interest = POLL_READ);
+    void remove(SOCKET sock);
+    int wait(PollEvent* events, int maxEvents, int timeoutMs);
+
+private:
+    struct Entry {
+        uint64_t token;
+        int interest;
+        bool armed;
+    };
+
+    void wakeup();
+
+    std::map<SOCKET, Entry> entries;
+    std::mutex entriesMutex;
+
+    // 자기 자신에게 connect 된 UDP 소켓. 1바이트를 보내면 select() 가 깨어난다.
+    SOCKET wakeSock;
+};
+
+#ifdef __linux__
+// epoll 기반 구현. EPOLLET | EPOLLONESHOT 으로 등록하므로 연결 수와 무관하게
+// 준비된 소켓만 보고되고, 한 소켓의 이벤트는 한 번에 한 쓰레드에게만 전달된다.
+class EpollPoller : public Poller {
+public:
+    EpollPoller();
+    ~EpollPoller();
+
+    bool valid() const { return epollFd >= 0; }
+
+    const char* name() const { return "epoll"; }
+    bool add(SOCKET sock, uint64_t token, int interest = POLL_READ);
+    bool rearm(SOCKET sock, uint64_t token, int interest = POLL_READ);
+    void remove(SOCKET sock);
+    int wait(PollEvent* events, int maxEvents, int timeoutMs);
+
+private:
+    int epollFd;
+};
+#endif
+
+#endif
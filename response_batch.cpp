@@ -0,0 +1,153 @@
+﻿#include "response_batch.h"
+
+#include <algorithm>
+
+#include "logger.h"
+
+using namespace std;
+
+// 출력 큐가 다 비워졌을 때 이보다 큰 버퍼는 돌려준다. 쉬고 있는 연결이 큰 버퍼를 계속 쥐고 있지 않게 한다.
+static const size_t MAX_IDLE_STORAGE = 16 * 1024;
+
+void ResponseBatch::addSlice(const char* ref, size_t off, size_t len) {
+    pending += len;
+
+    // 바로 앞 조각도 내부 버퍼에 있다면 이어 붙여서 조각 수를 늘리지 않는다.
+    if (ref == NULL && head < slices.size() && slices.back().ref == NULL && slices.back().off + slices.back().len == off) {
+        slices.back().len += len;
+        return;
+    }
+    Slice slice = { ref, off, len };
+    slices.push_back(slice);
+}
+
+void ResponseBatch::append(const char* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    size_t off = storage.size();
+    storage.append(data, len);
+    addSlice(NULL, off, len);
+}
+
+void ResponseBatch::commitWrite(size_t from) {
+    if (storage.size() > from) {
+        addSlice(NULL, from, storage.size() - from);
+    }
+}
+
+void ResponseBatch::appendRef(const char* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    addSlice(data, 0, len);
+}
+
+void ResponseBatch::appendRef(const char* data, size_t len, const shared_ptr<const void>& owner) {
+    if (len == 0) {
+        return;
+    }
+    owners.push_back(owner);
+    addSlice(data, 0, len);
+}
+
+void ResponseBatch::clear() {
+    if (storage.capacity() > MAX_IDLE_STORAGE) {
+        std::string().swap(storage);
+    } else {
+        storage.clear();
+    }
+    slices.clear();
+    owners.clear();
+    head = 0;
+    headOffset = 0;
+    pending = 0;
+    numResponses = 0;
+}
+
+// 보낸 n 바이트만큼 앞에서부터 조각들을 넘긴다.
+void ResponseBatch::consume(size_t n) {
+    pending -= n;
+    while (n > 0) {
+        size_t left = slices[head].len - headOffset;
+        if (n < left) {
+            headOffset += n;
+            return;
+        }
+        n -= left;
+        ++head;
+        headOffset = 0;
+    }
+}
+
+IoBuf* ResponseBatch::gather(int& count) {
+    // storage 는 append 도중 재할당될 수 있으므로 보내기 직전에 주소를 계산한다.
+    size_t n = min(slices.size() - head, (size_t)IOBUF_MAX);
+    bufs.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const Slice& slice = slices[head + i];
+        const char* base = slice.ref ? slice.ref : storage.data() + slice.off;
+        size_t skip = i == 0 ? headOffset : 0;
+        setIoBuf(bufs[i], base + skip, slice.len - skip);
+    }
+    count = (int)n;
+    return bufs.data();
+}
+
+void ResponseBatch::sent(size_t n) {
+    consume(n);
+    if (pending == 0) {
+        clear();
+    }
+}
+
+void ResponseBatch::appendTo(string& out) const {
+    for (size_t i = head; i < slices.size(); ++i) {
+        const Slice& slice = slices[i];
+        const char* base = slice.ref ? slice.ref : storage.data() + slice.off;
+        size_t skip = i == head ? headOffset : 0;
+        out.append(base + skip, slice.len - skip);
+    }
+}
+
+void ResponseBatch::appendResponses(const ResponseBatch& other) {
+    size_t from = storage.size();
+    other.appendTo(storage);
+    commitWrite(from);
+    numResponses += other.numResponses;
+    if (other.numResponses > 0) {
+        lastResponseStatus = other.lastResponseStatus;
+    }
+}
+
+void ResponseBatch::swap(ResponseBatch& other) {
+    storage.swap(other.storage);
+    slices.swap(other.slices);
+    owners.swap(other.owners);
+    std::swap(head, other.head);
+    std::swap(headOffset, other.headOffset);
+    std::swap(pending, other.pending);
+    std::swap(numResponses, other.numResponses);
+    std::swap(lastResponseStatus, other.lastResponseStatus);
+    bufs.swap(other.bufs);
+}
+
+bool ResponseBatch::flush(SOCKET sock) {
+    while (head < slices.size()) {
+        int count = 0;
+        IoBuf* gathered = gather(count);
+        long long r = sendGathered(sock, gathered, count);
+        if (r == SOCKET_ERROR) {
+            if (socketWouldBlock()) {
+                return true;
+            }
+            LOG_WARN("send failed with error %d", WSAGetLastError());
+            clear();
+            return false;
+        }
+        consume((size_t)r);
+    }
+
+    clear();
+    return true;
+}
@@ -0,0 +1,91 @@
+﻿#ifndef RESPONSE_BATCH_H
+#define RESPONSE_BATCH_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "platform.h"
+
+// 연결 하나의 출력 큐. response 들을 순서대로 모아두었다가 writev / WSASend 한 번(부분 전송이면 몇 번)으로 내보낸다.
+// non-blocking 소켓의 송신 버퍼가 가득 차면 남은 부분은 큐에 그대로 두고, 소켓이 writable 해지면 flush() 로 마저 보낸다.
+class ResponseBatch {
+public:
+    ResponseBatch() : head(0), headOffset(0), pending(0), numResponses(0), lastResponseStatus(0) {}
+
+    // data 를 내부 버퍼에 복사해서 덧붙인다.
+    void append(const char* data, size_t len);
+    void append(const std::string& data) { append(data.data(), data.size()); }
+
+    // data 를 복사하지 않고 참조만 한다. flush() 가 끝날 때까지 data 가 살아있어야 한다.
+    void appendRef(const char* data, size_t len);
+
+    // owner 가 data 를 갖고 있는 경우. 큐가 다 비워질 때까지 owner 를 잡아둔다. (mmap 한 정적 파일 등)
+    void appendRef(const char* data, size_t len, const std::shared_ptr<const void>& owner);
+
+    // 복사 없이 내부 버퍼 끝에 바로 쓸 때 쓴다. (JsonWriter 등)
+    // writeBuffer() 뒤에 덧붙인 다음, 덧붙이기 전의 writeBuffer().size() 를 commitWrite() 에 넘긴다.
+    std::string& writeBuffer() { return storage; }
+    void commitWrite(size_t from);
+
+    // response 하나를 다 붙였음을 알린다. status 는 그 response 의 상태 코드다. (로그용)
+    void endResponse(int status) {
+        ++numResponses;
+        lastResponseStatus = status;
+    }
+
+    // 보낼 수 있는 만큼 보낸다. 소켓이 더 받지 못하면 나머지는 남겨두고 true 를 반환한다.
+    // 연결 오류인 경우에만 false 이며, 이때는 큐를 비운다.
+    bool flush(SOCKET sock);
+
+    // flush() 대신 다른 곳(io_uring)에서 보낼 때 쓴다. 아직 보내지 않은 부분을 가리키는 버퍼 조각들을 돌려준다.
+    // 조각들은 보내기가 끝날 때까지 유효해야 하므로 그동안에는 이 batch 에 덧붙이면 안 된다.
+    IoBuf* gather(int& count);
+
+    // gather() 로 넘긴 것 중 n 바이트를 보냈다. 다 보냈으면 큐를 비운다.
+    void sent(size_t n);
+
+    // 보내는 중인 batch 와 새 response 를 쌓을 batch 를 맞바꿀 때 쓴다. 버퍼는 복사하지 않는다.
+    void swap(ResponseBatch& other);
+
+    // 아직 보내지 않은 내용을 out 뒤에 복사한다. (response cache 가 handler 의 응답을 저장할 때)
+    void appendTo(std::string& out) const;
+
+    // other 에 쌓인 response 들을 복사해서 덧붙인다. response 수와 마지막 상태 코드도 같이 옮긴다.
+    void appendResponses(const ResponseBatch& other);
+
+    bool empty() const { return pending == 0; }
+
+    // 아직 보내지 못한 바이트 수
+    size_t size() const { return pending; }
+
+    // 큐에 있는 response 수 (로그용). 큐가 다 비워질 때 0 으로 돌아간다.
+    size_t responses() const { return numResponses; }
+    int lastStatus() const { return lastResponseStatus; }
+    void clear();
+
+private:
+    struct Slice {
+        const char* ref;  // NULL 이면 storage 의 [off, off + len) 이다.
+        size_t off;
+        size_t len;
+    };
+
+    void addSlice(const char* ref, size_t off, size_t len);
+    void consume(size_t n);
+
+    std::string storage;
+    std::vector<Slice> slices;
+    size_t head;        // 아직 다 보내지 못한 첫 조각
+    size_t headOffset;  // 그 조각에서 이미 보낸 바이트 수
+    size_t pending;
+    size_t numResponses;
+    int lastResponseStatus;
+
+    std::vector<std::shared_ptr<const void> > owners;
+
+    std::vector<IoBuf> bufs;  // flush() 할 때마다 새로 할당하지 않도록 재사용한다.
+};
+
+#endif
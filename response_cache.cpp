@@ -0,0 +1,226 @@
+﻿#include "response_cache.h"
+
+#include <cstdio>
+#include <functional>
+
+#include "platform.h"
+#include "timer_wheel.h"
+
+using namespace std;
+
+// 항목마다 들어가는 key, list/map 노드 등의 대략적인 크기
+static const size_t ENTRY_OVERHEAD = 128;
+
+// FNV-1a 64비트
+static uint64_t hashBytes(string_view data) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : data) {
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// key 에서 method 와 query string 을 뺀 경로까지. 같은 경로는 같은 shard 에 들어가야 invalidate() 가 한 shard 만 본다.
+static string_view keyBase(string_view key) {
+    size_t end = key.find_first_of("?\n");
+    return end == string_view::npos ? key : key.substr(0, end);
+}
+
+// 같은 경로를 다르게 퍼센트 인코딩한 request 들이 같은 key 를 쓰도록 구간마다 디코딩했다가 다시 인코딩한다.
+// (/users/%61b 와 /users/ab 는 같은 key) 인코딩이 틀린 구간과 query string 은 그대로 둔다.
+static void appendCanonicalPath(string& out, string_view path) {
+    size_t query = path.find('?');
+    string_view rest = query == string_view::npos ? string_view() : path.substr(query);
+    path = path.substr(0, query);
+
+    thread_local string decoded;
+    size_t start = 0;
+    while (true) {
+        size_t end = path.find('/', start);
+        if (end == string_view::npos) {
+            end = path.size();
+        }
+        string_view segment = path.substr(start, end - start);
+        if (percentDecode(segment, decoded)) {
+            appendPercentEncoded(out, decoded);
+        } else {
+            out.append(segment.data(), segment.size());
+        }
+        if (end == path.size()) {
+            break;
+        }
+        out += '/';
+        start = end + 1;
+    }
+    out.append(rest.data(), rest.size());
+}
+
+ResponseCache::ResponseCache() : budgetPerShard(0) {
+}
+
+void ResponseCache::setBudget(size_t bytes) {
+    budgetPerShard = bytes / NUM_SHARDS;
+}
+
+void ResponseCache::makeKey(const HttpRequest& req, const vector<string>& varyHeaders, string& key) {
+    // HEAD 는 GET 과 같은 response 를 쓴다. (body 는 보낼 때 버린다)
+    if (req.method == "HEAD") {
+        key.assign("GET");
+    } else {
+        key.assign(req.method.data(), req.method.size());
+    }
+    key += ' ';
+    appendCanonicalPath(key, req.path);
+    for (size_t i = 0; i < varyHeaders.size(); ++i) {
+        key += '\n';
+        const HttpHeader* h = req.findHeader(varyHeaders[i]);
+        if (h) {
+            key.append(h->value.data(), h->value.size());
+        }
+    }
+}
+
+ResponseCache::Shard& ResponseCache::shardOf(string_view key) {
+    return shards[hash<string_view>()(keyBase(key)) % NUM_SHARDS];
+}
+
+void ResponseCache::erase(Shard& shard, list<Entry>::iterator it) {
+    unordered_map<string, size_t>::iterator base = shard.bases.find(string(keyBase(it->key)));
+    if (--base->second == 0) {
+        shard.bases.erase(base);
+    }
+    shard.bytes -= it->bytes;
+    shard.index.erase(it->key);
+    shard.lru.erase(it);
+}
+
+shared_ptr<const CachedResponse> ResponseCache::lookup(const string& key, bool wait, bool& fill) {
+    Shard& shard = shardOf(key);
+    unique_lock<mutex> guard(shard.lock);
+    fill = false;
+    while (true) {
+        // 만료된 response 는 새것으로 바뀔 때까지 남겨두고, 기다릴 수 없는 쓰레드가 그동안 쓴다.
+        shared_ptr<const CachedResponse> expired;
+        unordered_map<string, list<Entry>::iterator>::iterator found = shard.index.find(key);
+        if (found != shard.index.end()) {
+            list<Entry>::iterator it = found->second;
+            if (it->response->expireMs > timerNowMs()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it);
+                return it->response;
+            }
+            expired = it->response;
+        }
+
+        // 아무도 채우고 있지 않으면 이 쓰레드가 채운다.
+        if (shard.filling.insert(key).second) {
+            fill = true;
+            return shared_ptr<const CachedResponse>();
+        }
+        if (!wait) {
+            return expired;
+        }
+        shard.filled.wait(guard);
+    }
+}
+
+shared_ptr<const CachedResponse> ResponseCache::insert(const string& key, const string& response, uint64_t ttlMs) {
+    shared_ptr<CachedResponse> entry(new CachedResponse());
+
+    // ETag 는 body 로 만든다. 헤더 끝 바로 앞에 ETag 줄을 끼워 넣는다.
+    size_t headerEnd = response.find("\r\n\r\n");
+    size_t bodyStart = headerEnd == string::npos ? response.size() : headerEnd + 4;
+    char buffer[64];
+    sprintf_s(buffer, sizeof(buffer), "\"%016llx\"", (unsigned long long)hashBytes(string_view(response).substr(bodyStart)));
+    entry->etag = buffer;
+    if (headerEnd == string::npos) {
+        entry->response = response;
+    } else {
+        entry->response.reserve(response.size() + entry->etag.size() + 8);
+        entry->response.append(response, 0, headerEnd + 2);
+        entry->response += "ETag: " + entry->etag + "\r\n";
+        entry->response.append(response, headerEnd + 2, string::npos);
+    }
+    entry->notModified = "HTTP/1.1 304 Not Modified\r\nETag: " + entry->etag + "\r\n\r\n";
+    entry->expireMs = timerNowMs() + ttlMs;
+
+    size_t size = key.size() + entry->response.size() + entry->notModified.size() + ENTRY_OVERHEAD;
+    Shard& shard = shardOf(key);
+    {
+        lock_guard<mutex> guard(shard.lock);
+        shard.filling.erase(key);
+        bool stale = shard.stale.erase(key) > 0;
+        if (!stale && size <= budgetPerShard) {
+            unordered_map<string, list<Entry>::iterator>::iterator found = shard.index.find(key);
+            if (found != shard.index.end()) {
+                erase(shard, found->second);
+            }
+            // 오래 쓰지 않은 것부터 밀어낸다.
+            while (!shard.lru.empty() && shard.bytes + size > budgetPerShard) {
+                erase(shard, --shard.lru.end());
+            }
+            Entry e = { key, entry, size };
+            shard.lru.push_front(e);
+            shard.index[key] = shard.lru.begin();
+            ++shard.bases[string(keyBase(key))];
+            shard.bytes += size;
+        }
+    }
+    shard.filled.notify_all();
+    return entry;
+}
+
+void ResponseCache::abandon(const string& key) {
+    Shard& shard = shardOf(key);
+    {
+        lock_guard<mutex> guard(shard.lock);
+        shard.filling.erase(key);
+        shard.stale.erase(key);
+    }
+    shard.filled.notify_all();
+}
+
+void ResponseCache::invalidate(string_view method, string_view path) {
+    string base(method);
+    base += ' ';
+    appendCanonicalPath(base, path);
+    base = string(keyBase(base));
+
+    Shard& shard = shardOf(base);
+    lock_guard<mutex> guard(shard.lock);
+    list<Entry>::iterator it = shard.bases.count(base) > 0 ? shard.lru.begin() : shard.lru.end();
+    while (it != shard.lru.end()) {
+        list<Entry>::iterator next = it;
+        ++next;
+        if (keyBase(it->key) == base) {
+            erase(shard, it);
+        }
+        it = next;
+    }
+    // 지금 채우고 있는 response 는 invalidate 전의 상태로 만든 것일 수 있다.
+    for (unordered_set<string>::iterator f = shard.filling.begin(); f != shard.filling.end(); ++f) {
+        if (keyBase(*f) == base) {
+            shard.stale.insert(*f);
+        }
+    }
+}
+
+void ResponseCache::clear() {
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        lock_guard<mutex> guard(shards[i].lock);
+        shards[i].lru.clear();
+        shards[i].index.clear();
+        shards[i].bases.clear();
+        shards[i].bytes = 0;
+        shards[i].stale = shards[i].filling;
+    }
+}
+
+size_t ResponseCache::bytes() const {
+    size_t total = 0;
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        lock_guard<mutex> guard(shards[i].lock);
+        total += shards[i].bytes;
+    }
+    return total;
+}
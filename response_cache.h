@@ -0,0 +1,101 @@
+﻿#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "http_parser.h"
+
+// 캐시된 response 하나. 만들어진 뒤에는 바뀌지 않으므로 여러 쓰레드가 lock 없이 읽고,
+// 출력 큐가 shared_ptr 로 잡고 있는 동안은 캐시에서 밀려나도 남아있다.
+struct CachedResponse {
+    std::string response;     // 상태 줄부터 body 끝까지. ETag 헤더가 들어있다.
+    std::string notModified;  // 같은 ETag 의 304 응답
+    std::string etag;         // body 의 hash (16진수, 따옴표 포함)
+    uint64_t expireMs;        // timerNowMs() 기준
+};
+
+// 직렬화된 HTTP response 를 key 별로 들고 있는 캐시. key 는 makeKey() 로 만든다.
+// key 를 hash 해서 NUM_SHARDS 개의 shard 중 하나에 넣고, shard 마다 lock 과 LRU 목록이 따로 있으므로
+// 다른 key 를 찾는 쓰레드끼리는 거의 부딪히지 않는다. 메모리 한도도 shard 마다 1/NUM_SHARDS 씩 나눠 지킨다.
+//
+// 없는 key 를 찾으면 그 쓰레드가 채우는 역할을 맡고, 그동안 같은 key 를 찾는 다른 쓰레드들은
+// 채워질 때까지 기다렸다가 결과를 같이 쓴다. (request coalescing) 그래서 key 하나에는 handler 가 한 번에 하나만 돈다.
+// 기다릴 수 없는 쓰레드(event loop)는 만료된 response 가 남아있으면 그것을 쓰고, 없으면 handler 를 직접 돌린다.
+class ResponseCache {
+public:
+    static const int NUM_SHARDS = 16;
+
+    ResponseCache();
+
+    // 전체 메모리 한도. 0 이면 캐시하지 않는다.
+    void setBudget(size_t bytes);
+    bool enabled() const { return budgetPerShard > 0; }
+
+    // method, 경로(query string 포함), varyHeaders 의 값들로 key 를 만든다. HEAD 는 GET 의 key 를 쓴다.
+    // 경로의 퍼센트 인코딩은 구간마다 appendPercentEncoded() 의 형태로 맞춘다.
+    static void makeKey(const HttpRequest& req, const std::vector<std::string>& varyHeaders, std::string& key);
+
+    // 캐시된 response 를 찾는다. 없거나 만료되었으면 NULL 이고 fill 이 true 다. 이때 호출자는 response 를 만들어서
+    // 반드시 insert() 나 abandon() 을 불러야 한다.
+    // 다른 쓰레드가 같은 key 를 채우는 중이면 wait 일 때는 끝날 때까지 기다린다. wait 가 아니면 기다리지 않고
+    // 만료된 response 를 (없으면 NULL 을) 돌려준다. 이때 fill 은 false 이고 insert()/abandon() 을 부르면 안 된다.
+    std::shared_ptr<const CachedResponse> lookup(const std::string& key, bool wait, bool& fill);
+
+    // lookup() 이 NULL 을 돌려준 key 에 response 를 넣고, 기다리던 쓰레드들을 깨운다.
+    // response 는 헤더 끝("\r\n\r\n")이 있는 완전한 응답이어야 한다. 한도보다 크면 넣지는 않고 만든 것만 돌려준다.
+    std::shared_ptr<const CachedResponse> insert(const std::string& key, const std::string& response, uint64_t ttlMs);
+
+    // 캐시할 수 없는 response 였다. 기다리던 쓰레드 중 하나가 다시 채운다.
+    void abandon(const std::string& key);
+
+    // method + path 로 캐시된 것들을 지운다. query string 과 vary 헤더 값이 다른 것들도 모두 지운다.
+    // path 는 makeKey() 처럼 퍼센트 인코딩을 맞춰서 비교하므로 appendPercentEncoded() 로 만들면 된다.
+    // 그 경로가 캐시되어 있지 않으면 바로 끝나고, 있으면 그 shard 의 항목들을 다 훑는다.
+    void invalidate(std::string_view method, std::string_view path);
+
+    void clear();
+
+    // 캐시된 response 들의 크기 합 (근사값)
+    size_t bytes() const;
+
+private:
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CachedResponse> response;
+        size_t bytes;
+    };
+
+    struct alignas(64) Shard {
+        Shard() : bytes(0) {}
+
+        mutable std::mutex lock;
+        std::condition_variable filled;
+        std::list<Entry> lru;  // 앞쪽이 최근에 쓴 것
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        std::unordered_map<std::string, size_t> bases;  // keyBase() 별 항목 수. invalidate() 가 훑을지 정한다.
+        std::unordered_set<std::string> filling;  // 지금 채우는 중인 key
+        std::unordered_set<std::string> stale;    // 채우는 중에 invalidate() 된 key. 다 채워도 넣지 않는다.
+        size_t bytes;
+    };
+
+    Shard& shardOf(std::string_view key);
+    static void erase(Shard& shard, std::list<Entry>::iterator it);
+
+    size_t budgetPerShard;
+    Shard shards[NUM_SHARDS];
+};
+
+#endif
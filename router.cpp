@@ -0,0 +1,223 @@
+﻿#include "router.h"
+
+using namespace std;
+
+// methodIndex() 의 순서와 같다.
+static const char* METHOD_NAMES[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS" };
+static const int METHOD_GET = 0;
+static const int METHOD_HEAD = 1;
+
+string_view RouteParams::get(string_view name) const {
+    for (int i = 0; i < count; ++i) {
+        if (params[i].name == name) {
+            return params[i].value;
+        }
+    }
+    return string_view();
+}
+
+Router::Node::~Node() {
+    for (Node* child : children) {
+        delete child;
+    }
+    delete param;
+    delete catchAll;
+}
+
+Router::Router() : numRoutes(0) {
+}
+
+Router::~Router() {
+}
+
+int Router::methodIndex(string_view method) {
+    for (int i = 0; i < NUM_METHODS; ++i) {
+        if (method == METHOD_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool Router::add(string_view method, string_view pattern, RouteHandler handler) {
+    int m = methodIndex(method);
+    if (m < 0 || pattern.empty() || pattern[0] != '/') {
+        return false;
+    }
+
+    Node* node = &root;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        if (pattern[pos] == '{') {
+            // {name} 또는 {*name}. 구간 하나를 통째로 차지해야 한다.
+            size_t close = pattern.find('}', pos);
+            if (close == string_view::npos || pattern[pos - 1] != '/') {
+                return false;
+            }
+            string_view name = pattern.substr(pos + 1, close - pos - 1);
+            bool all = !name.empty() && name[0] == '*';
+            if (all) {
+                name.remove_prefix(1);
+            }
+            if (name.empty() || (all && close + 1 != pattern.size())
+                || (close + 1 < pattern.size() && pattern[close + 1] != '/')) {
+                return false;
+            }
+
+            // 같은 자리의 변수는 이름도 같아야 한다. (/users/{id} 와 /users/{name} 은 구분할 수 없다)
+            Node*& slot = all ? node->catchAll : node->param;
+            if (!slot) {
+                slot = new Node();
+                slot->name = string(name);
+            } else if (slot->name != name) {
+                return false;
+            }
+            node = slot;
+            pos = close + 1;
+            continue;
+        }
+
+        // 다음 변수 전까지의 고정 경로를 트리에 넣는다. 기존 노드와 일부만 겹치면 노드를 둘로 나눈다.
+        size_t end = pattern.find('{', pos);
+        if (end == string_view::npos) {
+            end = pattern.size();
+        }
+        string_view seg = pattern.substr(pos, end - pos);
+        while (!seg.empty()) {
+            size_t idx = node->indices.find(seg[0]);
+            if (idx == string::npos) {
+                Node* child = new Node();
+                child->prefix = string(seg);
+                node->indices.push_back(seg[0]);
+                node->children.push_back(child);
+                node = child;
+                break;
+            }
+
+            Node* child = node->children[idx];
+            size_t l = 0;
+            while (l < seg.size() && l < child->prefix.size() && seg[l] == child->prefix[l]) {
+                ++l;
+            }
+            if (l < child->prefix.size()) {
+                Node* mid = new Node();
+                mid->prefix = child->prefix.substr(0, l);
+                child->prefix.erase(0, l);
+                mid->indices.push_back(child->prefix[0]);
+                mid->children.push_back(child);
+                node->children[idx] = mid;
+                child = mid;
+            }
+            node = child;
+            seg.remove_prefix(l);
+        }
+        pos = end;
+    }
+
+    if (node->methods & (1u << m)) {
+        return false;
+    }
+    node->methods |= 1u << m;
+    node->handlers[m] = handler;
+    ++numRoutes;
+    return true;
+}
+
+// node 의 prefix 까지는 path[0, pos) 와 이미 맞았다. 나머지를 맞춰본다.
+// method 의 handler 가 있는 노드를 찾으면 반환한다. 경로만 맞는 노드들의 method 는 pathMethods 에 모은다.
+const Router::Node* Router::find(const Node* node, string_view path, size_t pos, int method,
+    RouteParams& params, uint32_t& pathMethods) const {
+    if (pos == path.size()) {
+        pathMethods |= node->methods;
+        if (node->methods & (1u << method)) {
+            return node;
+        }
+    } else {
+        size_t idx = node->indices.find(path[pos]);
+        if (idx != string::npos) {
+            const Node* child = node->children[idx];
+            if (path.compare(pos, child->prefix.size(), child->prefix) == 0) {
+                const Node* found = find(child, path, pos + child->prefix.size(), method, params, pathMethods);
+                if (found) {
+                    return found;
+                }
+            }
+        }
+
+        if (node->param && params.count < RouteParams::MAX_PARAMS) {
+            size_t end = path.find('/', pos);
+            if (end == string_view::npos) {
+                end = path.size();
+            }
+            if (end > pos) {
+                RouteParams::Param& p = params.params[params.count++];
+                p.name = node->param->name;
+                p.value = path.substr(pos, end - pos);
+                const Node* found = find(node->param, path, end, method, params, pathMethods);
+                if (found) {
+                    return found;
+                }
+                --params.count;
+            }
+        }
+    }
+
+    // {*name} 은 남은 경로가 비어있어도 맞는다.
+    if (node->catchAll && params.count < RouteParams::MAX_PARAMS) {
+        pathMethods |= node->catchAll->methods;
+        if (node->catchAll->methods & (1u << method)) {
+            RouteParams::Param& p = params.params[params.count++];
+            p.name = node->catchAll->name;
+            p.value = path.substr(pos);
+            return node->catchAll;
+        }
+    }
+    return NULL;
+}
+
+int Router::match(string_view method, string_view path, const RouteHandler*& handler, RouteParams& params,
+    string* allow) const {
+    int m = methodIndex(method);
+    if (m < 0) {
+        return 501;
+    }
+
+    size_t query = path.find('?');
+    if (query != string_view::npos) {
+        path = path.substr(0, query);
+    }
+
+    params.count = 0;
+    uint32_t pathMethods = 0;
+    const Node* node = find(&root, path, 0, m, params, pathMethods);
+    if (!node && m == METHOD_HEAD && (pathMethods & (1u << METHOD_GET))) {
+        // HEAD 를 따로 등록하지 않은 경로는 GET 의 handler 로 처리한다.
+        params.count = 0;
+        m = METHOD_GET;
+        node = find(&root, path, 0, m, params, pathMethods);
+    }
+    if (node) {
+        handler = &node->handlers[m];
+        return 200;
+    }
+
+    params.count = 0;
+    if (!pathMethods) {
+        return 404;
+    }
+    if (pathMethods & (1u << METHOD_GET)) {
+        pathMethods |= 1u << METHOD_HEAD;
+    }
+    if (allow) {
+        allow->clear();
+        for (int i = 0; i < NUM_METHODS; ++i) {
+            if (pathMethods & (1u << i)) {
+                if (!allow->empty()) {
+                    allow->append(", ");
+                }
+                allow->append(METHOD_NAMES[i]);
+            }
+        }
+    }
+    return 405;
+}
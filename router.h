@@ -0,0 +1,93 @@
+﻿#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http_parser.h"
+#include "response_batch.h"
+
+// 경로 패턴의 {name} 부분에 걸린 값들. 값은 request 버퍼를, 이름은 Router 를 가리킨다.
+struct RouteParams {
+    static const int MAX_PARAMS = 8;
+
+    struct Param {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    Param params[MAX_PARAMS];
+    int count;
+
+    RouteParams() : count(0) {}
+
+    // 이름으로 값을 찾는다. 없으면 빈 string_view.
+    std::string_view get(std::string_view name) const;
+};
+
+// request 하나를 처리하고 response 를 batch 에 쌓는다.
+typedef std::function<void(const HttpRequest& req, const RouteParams& params, ResponseBatch& batch)> RouteHandler;
+
+// method + 경로 패턴으로 handler 를 찾는 라우터.
+// 경로는 공통 접두사를 합친 radix tree 에 들어가므로, 찾는 비용은 등록된 route 수가 아니라 경로 길이에 비례한다.
+//
+// 패턴 문법:
+//   /users            고정 경로
+//   /users/{name}     '/' 를 포함하지 않는 한 구간. 비어있으면 안 된다.
+//   /static/{*path}   나머지 전부. 패턴의 맨 끝에만 올 수 있다.
+// 같은 위치에서는 고정 경로, {name}, {*name} 순서로 시도하고, 막히면 되돌아가서 다음 것을 시도한다.
+//
+// 시작할 때 add() 로 모두 등록한 뒤에는 읽기만 하므로 여러 쓰레드가 lock 없이 match() 해도 된다.
+class Router {
+public:
+    Router();
+    ~Router();
+
+    // 잘못된 패턴이거나 같은 method + 패턴이 이미 있으면 false.
+    bool add(std::string_view method, std::string_view pattern, RouteHandler handler);
+
+    // path 의 '?' 뒤(query string)는 보지 않는다.
+    // HEAD 의 handler 가 없으면 GET 의 handler 를 준다. 이때 body 를 버리는 것은 부르는 쪽의 일이다.
+    // 200: handler 를 찾았다.
+    // 404: 경로가 없다.
+    // 405: 경로는 있지만 method 가 다르다. allow 에 허용되는 method 들을 ", " 로 이어서 채운다.
+    // 501: 모르는 method 다.
+    int match(std::string_view method, std::string_view path, const RouteHandler*& handler, RouteParams& params,
+        std::string* allow = NULL) const;
+
+    size_t size() const { return numRoutes; }
+
+private:
+    Router(const Router&);
+    Router& operator=(const Router&);
+
+    enum { NUM_METHODS = 7 };
+
+    struct Node {
+        Node() : param(NULL), catchAll(NULL), methods(0) {}
+        ~Node();
+
+        std::string prefix;         // 고정 경로 조각. {name}/{*name} 노드는 비어있다.
+        std::string name;           // {name}/{*name} 노드의 이름
+        std::string indices;        // children[i] 의 prefix 첫 글자
+        std::vector<Node*> children;
+        Node* param;
+        Node* catchAll;
+
+        uint32_t methods;           // handler 가 있는 method bitmask
+        RouteHandler handlers[NUM_METHODS];
+    };
+
+    static int methodIndex(std::string_view method);
+
+    const Node* find(const Node* node, std::string_view path, size_t pos, int method,
+        RouteParams& params, uint32_t& pathMethods) const;
+
+    Node root;
+    size_t numRoutes;
+};
+
+#endif
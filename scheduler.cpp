@@ -0,0 +1,303 @@
+﻿#include "scheduler.h"
+
+#include <thread>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// MutexScheduler
+
+MutexScheduler::MutexScheduler() : stopped(false), submitted(0), executed(0), parks(0), maxQueueDepth(0) {
+}
+
+void MutexScheduler::submit(uint64_t job) {
+    lock_guard<mutex> lg(jobQueueMutex);
+
+    bool wasEmpty = jobQueue.empty();
+    jobQueue.push(job);
+    ++submitted;
+    if (jobQueue.size() > maxQueueDepth) {
+        maxQueueDepth = jobQueue.size();
+    }
+
+    // 큐의 길이가 0에서 1이 되는 순간에만 notify 한다.
+    if (wasEmpty) {
+        jobQueueFilledCv.notify_one();
+    }
+}
+
+bool MutexScheduler::take(int worker, uint64_t& job) {
+    (void)worker;
+    unique_lock<mutex> ul(jobQueueMutex);
+
+    // job queue 에 이벤트가 발생할 때까지 condition variable 을 잡을 것이다.
+    while (jobQueue.empty() && !stopped) {
+        ++parks;
+        jobQueueFilledCv.wait(ul);
+    }
+    if (stopped) {
+        return false;
+    }
+
+    job = jobQueue.front();
+    jobQueue.pop();
+    ++executed;
+    return true;
+}
+
+void MutexScheduler::stop() {
+    lock_guard<mutex> lg(jobQueueMutex);
+    stopped = true;
+    jobQueueFilledCv.notify_all();
+}
+
+SchedulerStats MutexScheduler::stats() {
+    lock_guard<mutex> lg(jobQueueMutex);
+    SchedulerStats s;
+    s.submitted = submitted;
+    s.executed = executed;
+    s.steals = 0;
+    s.parks = parks;
+    s.wakeups = 0;
+    s.queueDepth = jobQueue.size();
+    s.maxQueueDepth = maxQueueDepth;
+    return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MpmcRing
+
+MpmcRing::MpmcRing(size_t capacityPow2) : enqueuePos(0), dequeuePos(0) {
+    size_t capacity = 2;
+    while (capacity < capacityPow2) {
+        capacity <<= 1;
+    }
+    cells = new Cell[capacity];
+    mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        cells[i].seq.store(i, memory_order_relaxed);
+    }
+}
+
+MpmcRing::~MpmcRing() {
+    delete[] cells;
+}
+
+// 각 cell 의 seq 가 지금 넣을 차례(pos)인지, 꺼낼 차례(pos + 1)인지를 나타낸다.
+bool MpmcRing::push(uint64_t value) {
+    size_t pos = enqueuePos.load(memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells[pos & mask];
+        size_t seq = cell.seq.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                cell.value = value;
+                cell.seq.store(pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // 가득 찼다.
+        } else {
+            pos = enqueuePos.load(memory_order_relaxed);
+        }
+    }
+}
+
+bool MpmcRing::pop(uint64_t& value) {
+    size_t pos = dequeuePos.load(memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells[pos & mask];
+        size_t seq = cell.seq.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                value = cell.value;
+                cell.seq.store(pos + mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // 비어있다.
+        } else {
+            pos = dequeuePos.load(memory_order_relaxed);
+        }
+    }
+}
+
+size_t MpmcRing::sizeApprox() const {
+    size_t tail = enqueuePos.load(memory_order_relaxed);
+    size_t head = dequeuePos.load(memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// WorkStealingScheduler
+
+// 잠들기 전에 큐들을 다시 확인하는 횟수
+static const int SPIN_ROUNDS = 64;
+
+WorkStealingScheduler::WorkStealingScheduler(int numWorkers, size_t queueCapacity)
+    : overflowSize(0), nextWorker(0), numSleeping(0), stopped(false),
+      submitted(0), wakeups(0), maxQueueDepth(0) {
+    for (int i = 0; i < numWorkers; ++i) {
+        workers.push_back(new Worker(queueCapacity));
+    }
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+    for (Worker* w : workers) {
+        delete w;
+    }
+}
+
+void WorkStealingScheduler::submit(uint64_t job) {
+    int n = (int)workers.size();
+    int target = (int)(nextWorker.fetch_add(1, memory_order_relaxed) % n);
+
+    // 고른 worker 의 큐가 가득 차 있으면 다음 worker 로 넘어간다. 모두 가득 차면 예비 큐에 넣는다.
+    bool pushed = false;
+    for (int i = 0; i < n && !pushed; ++i) {
+        int w = (target + i) % n;
+        if (workers[w]->ring.push(job)) {
+            target = w;
+            pushed = true;
+        }
+    }
+    if (!pushed) {
+        lock_guard<mutex> lg(overflowMutex);
+        overflow.push(job);
+        overflowSize.store(overflow.size(), memory_order_release);
+    }
+    submitted.fetch_add(1, memory_order_relaxed);
+
+    size_t depth = pushed ? workers[target]->ring.sizeApprox() : overflowSize.load(memory_order_relaxed);
+    size_t maxDepth = maxQueueDepth.load(memory_order_relaxed);
+    while (depth > maxDepth && !maxQueueDepth.compare_exchange_weak(maxDepth, depth, memory_order_relaxed)) {
+    }
+
+    // 작업을 넣은 것과 numSleeping 을 읽는 것의 순서를 보장해야 한다.
+    // 잠들려는 worker 는 numSleeping 을 올린 뒤 큐를 다시 확인하므로, 둘 중 하나는 반드시 상대를 보게 된다.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (numSleeping.load(memory_order_relaxed) > 0) {
+        if (!wake(target)) {
+            for (int i = 1; i < n; ++i) {
+                if (wake((target + i) % n)) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool WorkStealingScheduler::wake(int worker) {
+    Worker* w = workers[worker];
+    lock_guard<mutex> lg(w->m);
+    if (!w->sleeping) {
+        return false;
+    }
+    w->sleeping = false;
+    numSleeping.fetch_sub(1, memory_order_relaxed);
+    wakeups.fetch_add(1, memory_order_relaxed);
+    w->cv.notify_one();
+    return true;
+}
+
+bool WorkStealingScheduler::tryTake(int worker, uint64_t& job) {
+    Worker* self = workers[worker];
+    if (self->ring.pop(job)) {
+        return true;
+    }
+
+    // 자기 큐가 비었으면 옆 worker 부터 차례로 훔쳐온다.
+    int n = (int)workers.size();
+    for (int i = 1; i < n; ++i) {
+        if (workers[(worker + i) % n]->ring.pop(job)) {
+            self->steals.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+
+    if (overflowSize.load(memory_order_acquire) > 0) {
+        lock_guard<mutex> lg(overflowMutex);
+        if (!overflow.empty()) {
+            job = overflow.front();
+            overflow.pop();
+            overflowSize.store(overflow.size(), memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingScheduler::hasWork() {
+    for (Worker* w : workers) {
+        if (w->ring.sizeApprox() > 0) {
+            return true;
+        }
+    }
+    return overflowSize.load(memory_order_acquire) > 0;
+}
+
+bool WorkStealingScheduler::take(int worker, uint64_t& job) {
+    Worker* self = workers[worker];
+
+    while (!stopped.load(memory_order_acquire)) {
+        for (int i = 0; i < SPIN_ROUNDS; ++i) {
+            if (tryTake(worker, job)) {
+                self->executed.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+            this_thread::yield();
+        }
+
+        // 잠들겠다고 먼저 알린 뒤 큐를 다시 확인한다. (submit() 의 fence 와 짝을 이룬다)
+        {
+            lock_guard<mutex> lg(self->m);
+            self->sleeping = true;
+        }
+        numSleeping.fetch_add(1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (hasWork() || stopped.load(memory_order_acquire)) {
+            // 잠들기를 취소한다. 그 사이에 누가 이미 깨웠다면 numSleeping 도 이미 줄어있다.
+            lock_guard<mutex> lg(self->m);
+            if (self->sleeping) {
+                self->sleeping = false;
+                numSleeping.fetch_sub(1, memory_order_relaxed);
+            }
+            continue;
+        }
+
+        self->parks.fetch_add(1, memory_order_relaxed);
+        unique_lock<mutex> ul(self->m);
+        while (self->sleeping) {
+            self->cv.wait(ul);
+        }
+    }
+    return false;
+}
+
+void WorkStealingScheduler::stop() {
+    stopped.store(true, memory_order_release);
+    for (int i = 0; i < (int)workers.size(); ++i) {
+        wake(i);
+    }
+}
+
+SchedulerStats WorkStealingScheduler::stats() {
+    SchedulerStats s;
+    s.submitted = submitted.load(memory_order_relaxed);
+    s.executed = 0;
+    s.steals = 0;
+    s.parks = 0;
+    s.wakeups = wakeups.load(memory_order_relaxed);
+    s.queueDepth = overflowSize.load(memory_order_relaxed);
+    for (Worker* w : workers) {
+        s.executed += w->executed.load(memory_order_relaxed);
+        s.steals += w->steals.load(memory_order_relaxed);
+        s.parks += w->parks.load(memory_order_relaxed);
+        s.queueDepth += w->ring.sizeApprox();
+    }
+    s.maxQueueDepth = maxQueueDepth.load(memory_order_relaxed);
+    return s;
+}
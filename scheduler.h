@@ -0,0 +1,143 @@
+﻿#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+// 스케줄러 통계. stats() 를 부를 때마다 worker 별 값을 합쳐서 만든다.
+struct SchedulerStats {
+    uint64_t submitted;  // 넣은 작업 수
+    uint64_t executed;   // worker 가 꺼내간 작업 수
+    uint64_t steals;     // 다른 worker 의 큐에서 훔쳐온 작업 수
+    uint64_t parks;      // worker 가 잠든 횟수
+    uint64_t wakeups;    // 잠든 worker 를 깨운 횟수
+    size_t queueDepth;   // 지금 큐에 남아있는 작업 수
+    size_t maxQueueDepth;  // 큐 하나가 가장 길었을 때의 길이
+};
+
+// job queue 추상화. 작업은 64비트 값 하나이며 의미는 쓰는 쪽이 정한다.
+// submit() 은 어느 쓰레드에서 불러도 되고, take() 는 worker 쓰레드가 자기 번호로 부른다.
+class Scheduler {
+public:
+    virtual ~Scheduler() {}
+
+    virtual const char* name() const = 0;
+
+    virtual void submit(uint64_t job) = 0;
+
+    // 작업이 생길 때까지 기다렸다가 하나를 꺼낸다. stop() 이후에는 false 를 반환한다.
+    virtual bool take(int worker, uint64_t& job) = 0;
+
+    // 기다리고 있는 worker 들을 모두 깨우고 이후의 take() 를 실패하게 한다.
+    virtual void stop() = 0;
+
+    virtual SchedulerStats stats() = 0;
+};
+
+// 예전 방식: std::queue 하나를 mutex 로 보호하고, 큐가 비어있다가 채워질 때만 condition variable 을 깨운다.
+// 비교용으로 남겨둔다. (--scheduler mutex)
+class MutexScheduler : public Scheduler {
+public:
+    MutexScheduler();
+
+    const char* name() const { return "mutex"; }
+    void submit(uint64_t job);
+    bool take(int worker, uint64_t& job);
+    void stop();
+    SchedulerStats stats();
+
+private:
+    std::queue<uint64_t> jobQueue;
+    std::mutex jobQueueMutex;
+    std::condition_variable jobQueueFilledCv;
+    bool stopped;
+
+    uint64_t submitted;
+    uint64_t executed;
+    uint64_t parks;
+    size_t maxQueueDepth;
+};
+
+// 고정 크기 lock-free MPMC ring. (Dmitry Vyukov 의 bounded queue)
+// 주인 worker 의 pop 과 다른 worker 의 steal 이 모두 pop() 이다.
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacityPow2);
+    ~MpmcRing();
+
+    bool push(uint64_t value);
+    bool pop(uint64_t& value);
+    size_t sizeApprox() const;
+
+private:
+    MpmcRing(const MpmcRing&);
+    MpmcRing& operator=(const MpmcRing&);
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        uint64_t value;
+    };
+
+    Cell* cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+// worker 마다 lock-free 큐를 두고, 자기 큐가 비면 다른 worker 의 큐에서 훔쳐온다. (--scheduler steal)
+// submit() 은 round-robin 으로 worker 큐를 고르고, 잠든 worker 가 있으면 하나를 바로 깨운다.
+// 큐가 비어있다가 채워질 때만 깨우는 예전 방식과 달리, 몰려 들어온 작업도 놀고 있는 worker 들이 바로 나눠 가진다.
+class WorkStealingScheduler : public Scheduler {
+public:
+    explicit WorkStealingScheduler(int numWorkers, size_t queueCapacity = 4096);
+    ~WorkStealingScheduler();
+
+    const char* name() const { return "steal"; }
+    void submit(uint64_t job);
+    bool take(int worker, uint64_t& job);
+    void stop();
+    SchedulerStats stats();
+
+private:
+    struct alignas(64) Worker {
+        explicit Worker(size_t capacity) : ring(capacity), sleeping(false),
+            executed(0), steals(0), parks(0) {}
+
+        MpmcRing ring;
+
+        // 잠들기/깨우기. 빠른 경로에서는 잡지 않는다.
+        std::mutex m;
+        std::condition_variable cv;
+        bool sleeping;
+
+        // 이 worker 만 쓰는 통계. 다른 쓰레드는 relaxed 로 읽기만 한다.
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> steals;
+        std::atomic<uint64_t> parks;
+    };
+
+    bool tryTake(int worker, uint64_t& job);
+    bool hasWork();
+    bool wake(int worker);
+
+    std::vector<Worker*> workers;
+
+    // 모든 ring 이 가득 찬 경우에만 쓰는 예비 큐
+    std::mutex overflowMutex;
+    std::queue<uint64_t> overflow;
+    std::atomic<size_t> overflowSize;
+
+    alignas(64) std::atomic<uint64_t> nextWorker;
+    alignas(64) std::atomic<int> numSleeping;
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> wakeups;
+    std::atomic<size_t> maxQueueDepth;
+};
+
+#endif
@@ -0,0 +1,413 @@
+﻿#include "static_files.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef S_ISDIR
+#define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#endif
+
+#include "platform.h"
+#include "timer_wheel.h"
+
+using namespace std;
+
+StaticFile::StaticFile() : data(NULL), size(0), mtime(0), mapped(false), checkedMs(0) {
+}
+
+StaticFile::~StaticFile() {
+    if (!data) {
+        return;
+    }
+#ifndef _WIN32
+    if (mapped) {
+        munmap((void*)data, size);
+        return;
+    }
+#endif
+    delete[] data;
+}
+
+// 확장자로 Content-Type 을 정한다.
+static const char* contentTypeOf(const string& path) {
+    static const struct {
+        const char* ext;
+        const char* type;
+    } TYPES[] = {
+        { ".html", "text/html; charset=utf-8" },
+        { ".htm", "text/html; charset=utf-8" },
+        { ".css", "text/css; charset=utf-8" },
+        { ".js", "text/javascript; charset=utf-8" },
+        { ".json", "application/json" },
+        { ".txt", "text/plain; charset=utf-8" },
+        { ".svg", "image/svg+xml" },
+        { ".png", "image/png" },
+        { ".jpg", "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" },
+        { ".ico", "image/x-icon" },
+        { ".wasm", "application/wasm" },
+    };
+    size_t dot = path.rfind('.');
+    if (dot != string::npos && path.find('/', dot) == string::npos) {
+        for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i) {
+            if (path.compare(dot, string::npos, TYPES[i].ext) == 0) {
+                return TYPES[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// 일반 파일이면 크기와 수정 시각을 채운다.
+static bool statFile(const string& path, size_t& size, time_t& mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0 || !(st.st_mode & _S_IFREG)) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+#endif
+    size = (size_t)st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+// URL 경로를 디코딩해서 root 아래의 상대 경로로 바꾼다.
+// 빈 구간, '.', '..' 이 있거나 디코딩한 결과에 NUL 이나 '\' 가 있으면 root 밖을 가리킬 수 있으므로 false.
+static bool toRelativePath(string_view urlPath, string& rel) {
+    size_t query = urlPath.find('?');
+    if (query != string_view::npos) {
+        urlPath = urlPath.substr(0, query);
+    }
+
+    if (!percentDecode(urlPath, rel)) {
+        return false;
+    }
+    for (char c : rel) {
+#ifdef _WIN32
+        if (c == ':') {
+            return false;
+        }
+#endif
+        if (c == '\0' || c == '\\') {
+            return false;
+        }
+    }
+
+    // 디렉터리(빈 경로나 '/' 로 끝나는 경로)는 그 안의 index.html 이다.
+    if (rel.empty() || rel.back() == '/') {
+        rel += "index.html";
+    }
+
+    size_t start = 0;
+    while (start < rel.size()) {
+        size_t end = rel.find('/', start);
+        if (end == string::npos) {
+            end = rel.size();
+        }
+        string_view segment(rel.data() + start, end - start);
+        if (segment.empty() || segment == "." || segment == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool StaticFileCache::open(const string& rootDir) {
+    struct stat st;
+    if (stat(rootDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+#ifdef _WIN32
+    root = rootDir;
+#else
+    char* real = realpath(rootDir.c_str(), NULL);
+    if (!real) {
+        return false;
+    }
+    root = real;
+    free(real);
+#endif
+    if (root.back() != '/') {
+        root += '/';
+    }
+    return true;
+}
+
+// root 아래의 상대 경로를 열 경로로 바꾼다.
+// toRelativePath() 가 '..' 은 막지만 root 안의 symlink 가 밖을 가리킬 수 있으므로, symlink 를 모두 따라간 실제 경로가
+// root 아래에 있는지 확인한다. load() 는 이 경로를 O_NOFOLLOW 로 열어서 그 사이에 마지막 구간이 symlink 로 바뀌는 것도 막는다.
+bool StaticFileCache::resolve(const string& relPath, string& path) const {
+#ifdef _WIN32
+    path = root + relPath;
+    return true;
+#else
+    char* real = realpath((root + relPath).c_str(), NULL);
+    if (!real) {
+        return false;
+    }
+    path = real;
+    free(real);
+    return path.size() > root.size() && path.compare(0, root.size(), root) == 0;
+#endif
+}
+
+#ifndef _WIN32
+// 파일 전체를 새 버퍼에 읽는다. 읽는 사이에 파일이 줄었으면 false.
+static bool readWhole(int fd, StaticFile& file) {
+    char* buffer = new char[file.size];
+    size_t done = 0;
+    while (done < file.size) {
+        ssize_t n = pread(fd, buffer + done, file.size - done, (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            delete[] buffer;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    file.data = buffer;
+    return true;
+}
+#endif
+
+shared_ptr<StaticFile> StaticFileCache::load(const string& relPath) {
+    string path;
+    if (!resolve(relPath, path)) {
+        return shared_ptr<StaticFile>();
+    }
+    shared_ptr<StaticFile> file(new StaticFile());
+    if (!statFile(path, file->size, file->mtime)) {
+        return shared_ptr<StaticFile>();
+    }
+
+    if (file->size > 0) {
+#ifdef _WIN32
+        // Windows 에서는 매핑 대신 읽어둔다.
+        FILE* f = NULL;
+        if (fopen_s(&f, path.c_str(), "rb") != 0 || !f) {
+            return shared_ptr<StaticFile>();
+        }
+        char* buffer = new char[file->size];
+        size_t n = fread(buffer, 1, file->size, f);
+        fclose(f);
+        if (n != file->size) {
+            delete[] buffer;
+            return shared_ptr<StaticFile>();
+        }
+        file->data = buffer;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            return shared_ptr<StaticFile>();
+        }
+        // stat 과 open 사이에 파일이 바뀌었을 수 있으므로 연 파일로 다시 확인한다.
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+        if (ok) {
+            file->size = (size_t)st.st_size;
+            file->mtime = st.st_mtime;
+            if (file->size <= COPY_MAX_BYTES) {
+                ok = readWhole(fd, *file);
+            } else {
+                void* p = mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0);
+                ok = p != MAP_FAILED;
+                if (ok) {
+                    file->data = (const char*)p;
+                    file->mapped = true;
+                }
+            }
+        }
+        close(fd);
+        if (!ok) {
+            return shared_ptr<StaticFile>();
+        }
+#endif
+    }
+
+    char buffer[64];
+    sprintf_s(buffer, sizeof(buffer), "\"%llx-%llx\"", (unsigned long long)file->mtime, (unsigned long long)file->size);
+    file->etag = buffer;
+
+    struct tm t;
+#ifdef _WIN32
+    gmtime_s(&t, &file->mtime);
+#else
+    gmtime_r(&file->mtime, &t);
+#endif
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &t);
+    file->lastModified = buffer;
+
+    file->headers = string("Content-Type: ") + contentTypeOf(relPath) + "\r\n"
+        + "ETag: " + file->etag + "\r\n"
+        + "Last-Modified: " + file->lastModified + "\r\n"
+        + "Accept-Ranges: bytes\r\n";
+    file->checkedMs = timerNowMs();
+    return file;
+}
+
+shared_ptr<const StaticFile> StaticFileCache::get(string_view urlPath) {
+    string rel;
+    if (!toRelativePath(urlPath, rel)) {
+        return shared_ptr<const StaticFile>();
+    }
+
+    shared_ptr<StaticFile> file;
+    {
+        lock_guard<mutex> guard(lock);
+        unordered_map<string, shared_ptr<StaticFile> >::iterator it = files.find(rel);
+        if (it != files.end()) {
+            file = it->second;
+        }
+    }
+
+    // 캐시에 있으면 가끔씩만 바뀌었는지 확인한다. 바뀌지 않았으면 확인한 시각만 고친다.
+    uint64_t now = timerNowMs();
+    if (file) {
+        if (now - file->checkedMs.load(memory_order_relaxed) < STATIC_RECHECK_MS) {
+            return file;
+        }
+        string path;
+        size_t size = 0;
+        time_t mtime = 0;
+        if (resolve(rel, path) && statFile(path, size, mtime) && size == file->size && mtime == file->mtime) {
+            file->checkedMs.store(now, memory_order_relaxed);
+            return file;
+        }
+    }
+
+    // 파일 stat, open, mmap 은 lock 밖에서 한다. 같은 파일을 두 worker 가 동시에 읽으면 나중 것이 남는다.
+    file = load(rel);
+    lock_guard<mutex> guard(lock);
+    if (!file) {
+        files.erase(rel);
+        return shared_ptr<const StaticFile>();
+    }
+    // 넘치면 통째로 비운다. 보내는 중인 응답은 자기 shared_ptr 로 매핑을 잡고 있다.
+    if (files.size() >= MAX_ENTRIES) {
+        files.clear();
+    }
+    files[rel] = file;
+    return file;
+}
+
+static string_view trimView(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// 10진수 숫자로만 이루어졌으면 읽는다.
+static bool parseNumber(string_view s, uint64_t& out) {
+    if (s.empty() || s.size() > 19) {
+        return false;
+    }
+    out = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        out = out * 10 + (uint64_t)(c - '0');
+    }
+    return true;
+}
+
+StaticReply evaluateStaticRequest(const StaticFile& file, const HttpRequest& req) {
+    StaticReply reply = { 200, 0, file.size };
+
+    // If-None-Match 가 있으면 If-Modified-Since 는 보지 않는다.
+    // If-Modified-Since 는 날짜를 파싱하지 않고 보내준 Last-Modified 를 그대로 돌려받았는지만 본다.
+    const HttpHeader* h = req.findHeader("If-None-Match");
+    bool notModified = h ? etagMatches(h->value, file.etag)
+        : (h = req.findHeader("If-Modified-Since")) != NULL && trimView(h->value) == file.lastModified;
+    if (notModified) {
+        reply.status = 304;
+        reply.length = 0;
+        return reply;
+    }
+
+    const HttpHeader* range = req.findHeader("Range");
+    if (!range) {
+        return reply;
+    }
+    // If-Range 가 지금 파일과 다르면 Range 를 무시하고 전체를 보낸다.
+    const HttpHeader* ifRange = req.findHeader("If-Range");
+    if (ifRange) {
+        string_view v = trimView(ifRange->value);
+        if (v != file.etag && v != file.lastModified) {
+            return reply;
+        }
+    }
+
+    string_view spec = trimView(range->value);
+    if (spec.substr(0, 6) != "bytes=" || spec.find(',') != string_view::npos) {
+        return reply;
+    }
+    spec.remove_prefix(6);
+    size_t dash = spec.find('-');
+    if (dash == string_view::npos) {
+        return reply;
+    }
+    string_view first = trimView(spec.substr(0, dash));
+    string_view last = trimView(spec.substr(dash + 1));
+
+    uint64_t begin = 0;
+    uint64_t end = 0;  // 포함
+    if (first.empty()) {
+        // "-n": 마지막 n 바이트
+        uint64_t n = 0;
+        if (!parseNumber(last, n)) {
+            return reply;
+        }
+        if (n == 0 || file.size == 0) {
+            reply.status = 416;
+            reply.length = 0;
+            return reply;
+        }
+        begin = n >= file.size ? 0 : file.size - n;
+        end = file.size - 1;
+    } else {
+        if (!parseNumber(first, begin)) {
+            return reply;
+        }
+        if (last.empty()) {
+            end = file.size == 0 ? 0 : file.size - 1;
+        } else if (!parseNumber(last, end) || end < begin) {
+            return reply;
+        }
+        if (begin >= file.size) {
+            reply.status = 416;
+            reply.length = 0;
+            return reply;
+        }
+        if (end >= file.size) {
+            end = file.size - 1;
+        }
+    }
+
+    reply.status = 206;
+    reply.offset = (size_t)begin;
+    reply.length = (size_t)(end - begin + 1);
+    return reply;
+}
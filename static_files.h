@@ -0,0 +1,86 @@
+﻿#ifndef STATIC_FILES_H
+#define STATIC_FILES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "http_parser.h"
+
+// 디스크의 파일 하나. 처음 요청될 때 통째로 읽거나 mmap 해두고, 응답 헤더 중 바뀌지 않는 부분도 미리 만들어둔다.
+// 응답은 그 메모리를 ResponseBatch::appendRef() 로 참조만 하므로 보낼 때마다 body 를 복사하지 않는다.
+// 파일이 바뀌어 새 StaticFile 로 교체되어도, 아직 보내고 있는 응답이 shared_ptr 로 잡고 있는 동안은 메모리가 남는다.
+struct StaticFile {
+    StaticFile();
+    ~StaticFile();
+
+    const char* data;
+    size_t size;
+    time_t mtime;
+    bool mapped;               // true 면 data 는 mmap 한 것, 아니면 new[] 한 복사본
+
+    std::string etag;          // "수정시각-크기" (16진수, 따옴표 포함)
+    std::string lastModified;  // IMF-fixdate
+    std::string headers;       // Content-Type, ETag, Last-Modified, Accept-Ranges 줄들. "\r\n" 으로 끝난다.
+
+    // 마지막으로 stat 해서 바뀌지 않았음을 확인한 시각 (timerNowMs()). 여러 worker 가 고친다.
+    std::atomic<uint64_t> checkedMs;
+
+private:
+    StaticFile(const StaticFile&);
+    StaticFile& operator=(const StaticFile&);
+};
+
+// request 에 대해 보낼 응답. status 는 200, 206, 304, 416 중 하나이고
+// 200/206 이면 [offset, offset + length) 를 body 로 보낸다.
+struct StaticReply {
+    int status;
+    size_t offset;
+    size_t length;
+};
+
+// If-None-Match / If-Modified-Since 와 Range / If-Range 를 보고 응답을 정한다.
+// Range 는 "bytes=" 하나짜리만 지원하고, 여러 구간이거나 문법이 틀리면 무시하고 전체를 보낸다.
+StaticReply evaluateStaticRequest(const StaticFile& file, const HttpRequest& req);
+
+// root 디렉터리 아래의 파일들을 경로별로 캐시한다. 여러 worker 가 같이 쓴다.
+// 캐시된 파일은 STATIC_RECHECK_MS 마다 한 번 stat 해서 바뀌었으면 다시 읽는다.
+class StaticFileCache {
+public:
+    static const uint64_t STATIC_RECHECK_MS = 1000;
+    static const size_t MAX_ENTRIES = 4096;
+
+    // 이 크기까지는 mmap 하지 않고 읽어둔다. 매핑한 파일이 잘리면 잘린 부분을 읽을 때 SIGBUS 가 나기 때문이다.
+    // 더 큰 파일은 매핑하지만 body 는 커널(writev, io_uring send)만 읽으므로, 그때는 EFAULT 로 그 연결만 끊긴다.
+    static const size_t COPY_MAX_BYTES = 256 * 1024;
+
+    StaticFileCache() {}
+
+    // root 가 디렉터리가 아니면 false. root 는 symlink 를 따라간 실제 경로로 바꿔서 기억한다.
+    bool open(const std::string& rootDir);
+
+    bool enabled() const { return !root.empty(); }
+
+    // URL 의 경로 부분(퍼센트 인코딩 그대로)으로 파일을 찾는다. 비어있거나 '/' 로 끝나면 index.html 이다.
+    // 없거나, 일반 파일이 아니거나, root 밖을 가리키는 경로('..' 나 root 밖으로 나가는 symlink)면 NULL.
+    std::shared_ptr<const StaticFile> get(std::string_view urlPath);
+
+private:
+    StaticFileCache(const StaticFileCache&);
+    StaticFileCache& operator=(const StaticFileCache&);
+
+    std::shared_ptr<StaticFile> load(const std::string& relPath);
+    bool resolve(const std::string& relPath, std::string& path) const;
+
+    std::string root;
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<StaticFile> > files;
+};
+
+#endif
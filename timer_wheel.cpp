@@ -0,0 +1,117 @@
+﻿#include "timer_wheel.h"
+
+#include <chrono>
+
+using namespace std;
+
+uint64_t timerNowMs() {
+    return (uint64_t)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TimerWheel::TimerWheel(uint64_t tickMs, uint64_t nowMs)
+    : tickMs(tickMs > 0 ? tickMs : 1), startMs(nowMs), currentTick(0), numScheduled(0) {
+    for (int l = 0; l < LEVELS; ++l) {
+        for (int s = 0; s < SLOTS; ++s) {
+            slots[l][s].prev = &slots[l][s];
+            slots[l][s].next = &slots[l][s];
+        }
+    }
+}
+
+void TimerWheel::schedule(TimerNode* node, uint64_t deadlineMs) {
+    if (node->scheduled()) {
+        unlink(node);
+    } else {
+        ++numScheduled;
+    }
+    // 올림해서 deadline 보다 일찍 만료되지 않게 한다.
+    node->expireTick = deadlineMs > startMs ? (deadlineMs - startMs + tickMs - 1) / tickMs : 0;
+    link(node, currentTick + 1);
+}
+
+void TimerWheel::cancel(TimerNode* node) {
+    if (node->scheduled()) {
+        unlink(node);
+        --numScheduled;
+    }
+}
+
+// 남은 tick 수로 바퀴를 고른다. earliestTick 보다 앞선 타이머는 earliestTick 에 만료되게 한다.
+void TimerWheel::link(TimerNode* node, uint64_t earliestTick) {
+    uint64_t tick = node->expireTick > earliestTick ? node->expireTick : earliestTick;
+    uint64_t delta = tick - currentTick;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    if (delta >= (1ull << (SLOT_BITS * LEVELS))) {
+        // 가장 먼 칸에 넣는다. 그 칸이 내려올 때 남은 시간으로 다시 건다.
+        tick = currentTick + (1ull << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    TimerNode* head = &slots[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::unlink(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+// 위 바퀴의 칸 하나를 비우고 그 안의 타이머들을 남은 시간에 맞는 칸으로 다시 건다.
+void TimerWheel::cascade(int level, int slot) {
+    TimerNode* head = &slots[level][slot];
+    TimerNode* node = head->next;
+    head->prev = head;
+    head->next = head;
+    while (node != head) {
+        TimerNode* next = node->next;
+        // 지금 tick 에 만료될 타이머는 바로 이어서 처리할 첫 바퀴의 지금 칸으로 보낸다.
+        link(node, currentTick);
+        node = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t nowMs, vector<uint64_t>& expired) {
+    uint64_t nowTick = nowMs > startMs ? (nowMs - startMs) / tickMs : 0;
+    if (numScheduled == 0) {
+        // 걸린 타이머가 없으면 칸을 하나씩 지나갈 필요가 없다.
+        if (nowTick > currentTick) {
+            currentTick = nowTick;
+        }
+        return;
+    }
+
+    while (currentTick < nowTick) {
+        ++currentTick;
+
+        // 아래 바퀴가 한 바퀴를 다 돌았으면 위 바퀴의 다음 칸을 내려보낸다. 가장 위 바퀴부터 내려야 한다.
+        int top = 0;
+        while (top < LEVELS - 1 && (currentTick & ((1ull << (SLOT_BITS * (top + 1))) - 1)) == 0) {
+            ++top;
+        }
+        for (int l = top; l > 0; --l) {
+            cascade(l, (int)((currentTick >> (SLOT_BITS * l)) & (SLOTS - 1)));
+        }
+
+        TimerNode* head = &slots[0][currentTick & (SLOTS - 1)];
+        TimerNode* node = head->next;
+        while (node != head) {
+            TimerNode* next = node->next;
+            unlink(node);
+            if (node->expireTick <= currentTick) {
+                --numScheduled;
+                expired.push_back(node->token);
+            } else {
+                link(node, currentTick + 1);
+            }
+            node = next;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+﻿#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 단조 증가하는 시각 (millisecond)
+uint64_t timerNowMs();
+
+// 타이머 하나. 감시할 객체(Client 등) 안에 넣어두므로 타이머를 걸거나 지울 때 할당이 없다.
+struct TimerNode {
+    TimerNode() : prev(NULL), next(NULL), expireTick(0), token(0) {}
+
+    bool scheduled() const { return prev != NULL; }
+
+    TimerNode* prev;
+    TimerNode* next;
+    uint64_t expireTick;
+    uint64_t token;  // 만료될 때 돌려주는 값
+};
+
+// 계층형 timing wheel. (Varghese & Lauck)
+// 64칸짜리 바퀴 4개로 이루어지며, 아래 바퀴 한 칸은 tick 하나, 위 바퀴 한 칸은 아래 바퀴 한 바퀴다.
+// tick 이 100ms 이면 첫 바퀴가 6.4초, 네 번째 바퀴가 약 19일을 덮는다. 더 먼 시각은 가장 먼 칸에 넣었다가 다시 건다.
+// 타이머를 걸고 지우는 것은 칸의 이중 연결 리스트에 넣고 빼는 것이라 O(1) 이고,
+// tick 이 지날 때는 그 칸만 보면 된다. 위 바퀴의 칸은 아래 바퀴가 한 바퀴 돌 때 한 번씩 아래로 내려보낸다.
+//
+// 한 쓰레드에서만 쓴다.
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    TimerWheel(uint64_t tickMs, uint64_t nowMs);
+
+    // node 를 deadlineMs 에 만료되도록 건다. 이미 걸려 있으면 옮긴다.
+    void schedule(TimerNode* node, uint64_t deadlineMs);
+
+    void cancel(TimerNode* node);
+
+    // nowMs 까지 시간을 진행하고 만료된 타이머의 token 을 expired 뒤에 붙인다. 만료된 타이머는 풀린다.
+    void advance(uint64_t nowMs, std::vector<uint64_t>& expired);
+
+    // poller 를 얼마나 기다려도 되는지. 걸린 타이머가 없으면 -1 (무한정).
+    int pollTimeoutMs() const { return numScheduled > 0 ? (int)tickMs : -1; }
+
+    size_t size() const { return numScheduled; }
+
+private:
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    void link(TimerNode* node, uint64_t earliestTick);
+    static void unlink(TimerNode* node);
+    void cascade(int level, int slot);
+
+    uint64_t tickMs;
+    uint64_t startMs;
+    uint64_t currentTick;
+    size_t numScheduled;
+
+    // 칸마다 리스트의 머리. 빈 리스트는 자기 자신을 가리킨다.
+    TimerNode slots[LEVELS][SLOTS];
+};
+
+#endif
@@ -0,0 +1,278 @@
+﻿#include "uring.h"
+
+#include <cerrno>
+
+#ifdef HAVE_IO_URING
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+using namespace std;
+
+// provided buffer ring 의 group 번호. ring 마다 하나만 쓴다.
+static const uint16_t BUFFER_GROUP = 0;
+
+static int sysSetup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int sysRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// multishot recv 는 Linux 6.0 부터다. 그 전 커널은 ring 은 만들어지지만 recv 가 -EINVAL 로 끝나므로 미리 거른다.
+static bool kernelAtLeast(int major, int minor) {
+    struct utsname u;
+    int kMajor = 0, kMinor = 0;
+    if (uname(&u) != 0 || sscanf(u.release, "%d.%d", &kMajor, &kMinor) != 2) {
+        return false;
+    }
+    return kMajor > major || (kMajor == major && kMinor >= minor);
+}
+
+bool ioUringAvailable() {
+    if (!kernelAtLeast(6, 0)) {
+        errno = ENOSYS;
+        return false;
+    }
+    IoUring ring;
+    return ring.init(4, 1, 4096);
+}
+
+IoUring::IoUring()
+    : ringFd(-1), ringMemory(NULL), ringMemorySize(0), sqes(NULL), sqesSize(0),
+      sqHead(NULL), sqTail(NULL), sqMask(0), sqEntries(0), sqLocalTail(0), sqSubmitted(0),
+      cqHead(NULL), cqTail(NULL), cqMask(0), cqes(NULL),
+      bufRing(NULL), bufRingSize(0), bufMask(0), bufTail(0), bufferMemory(NULL), bufferMemorySize(0), bufferSize(0) {
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    // ring 을 닫으면 커널이 등록된 buffer ring 도 놓아준다.
+    if (ringFd >= 0) {
+        close(ringFd);
+        ringFd = -1;
+    }
+    if (bufferMemory) {
+        munmap(bufferMemory, bufferMemorySize);
+        bufferMemory = NULL;
+    }
+    if (bufRing) {
+        munmap(bufRing, bufRingSize);
+        bufRing = NULL;
+    }
+    if (sqes) {
+        munmap(sqes, sqesSize);
+        sqes = NULL;
+    }
+    if (ringMemory) {
+        munmap(ringMemory, ringMemorySize);
+        ringMemory = NULL;
+    }
+}
+
+bool IoUring::init(unsigned entries, unsigned bufferCount, unsigned bufferSizeBytes) {
+    // completion 을 이 쓰레드(ring 을 만든 쓰레드)가 syscall 할 때만 처리하게 하면 커널이 중간에 끼어드는 일이 줄어든다. (6.1+)
+    // 지원하지 않는 커널이면 flag 없이 다시 만든다.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    ringFd = sysSetup(entries, &p);
+    if (ringFd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        ringFd = sysSetup(entries, &p);
+    }
+    if (ringFd < 0) {
+        return false;
+    }
+
+    // 시간 제한을 두고 기다리는 것(EXT_ARG)과 SQ/CQ 를 한 번에 mmap 하는 것(SINGLE_MMAP)이 필요하다.
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        release();
+        errno = ENOSYS;
+        return false;
+    }
+
+    size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ringMemorySize = sqSize > cqSize ? sqSize : cqSize;
+    ringMemory = mmap(NULL, ringMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (ringMemory == MAP_FAILED) {
+        ringMemory = NULL;
+        release();
+        return false;
+    }
+    sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = NULL;
+        release();
+        return false;
+    }
+
+    char* base = (char*)ringMemory;
+    sqHead = (unsigned*)(base + p.sq_off.head);
+    sqTail = (unsigned*)(base + p.sq_off.tail);
+    sqMask = *(unsigned*)(base + p.sq_off.ring_mask);
+    sqEntries = p.sq_entries;
+    sqLocalTail = *sqTail;
+    sqSubmitted = sqLocalTail;
+    // SQE 는 순서대로 쓰므로 index 배열은 처음에 한 번만 채운다.
+    unsigned* sqArray = (unsigned*)(base + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; ++i) {
+        sqArray[i] = i;
+    }
+
+    cqHead = (unsigned*)(base + p.cq_off.head);
+    cqTail = (unsigned*)(base + p.cq_off.tail);
+    cqMask = *(unsigned*)(base + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)(base + p.cq_off.cqes);
+
+    // recv 버퍼들과 그것을 커널에 알려주는 ring. ring 은 page 단위로 정렬되어야 한다.
+    bufferSize = bufferSizeBytes;
+    bufMask = bufferCount - 1;
+    bufRingSize = bufferCount * sizeof(struct io_uring_buf);
+    void* ringAddr = mmap(NULL, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufferMemorySize = (size_t)bufferCount * bufferSize;
+    void* bufferAddr = mmap(NULL, bufferMemorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufRing = ringAddr == MAP_FAILED ? NULL : (struct io_uring_buf_ring*)ringAddr;
+    bufferMemory = bufferAddr == MAP_FAILED ? NULL : (char*)bufferAddr;
+    if (!bufRing || !bufferMemory) {
+        release();
+        return false;
+    }
+
+    for (unsigned i = 0; i < bufferCount; ++i) {
+        recycleBuffer((uint16_t)i);
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+    reg.ring_entries = bufferCount;
+    reg.bgid = BUFFER_GROUP;
+    if (sysRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int error = errno;
+        release();
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+void IoUring::recycleBuffer(uint16_t bid) {
+    // bufs 는 C 의 flexible array 라서 C++ 에서는 위치가 8바이트 밀려 보인다. 배열로 직접 센다.
+    struct io_uring_buf* buf = (struct io_uring_buf*)bufRing + (bufTail & bufMask);
+    buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+    buf->len = bufferSize;
+    buf->bid = bid;
+    ++bufTail;
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    // 가득 찼으면 쌓인 것을 먼저 제출한다. 커널은 제출받은 SQE 를 바로 읽어가므로 자리가 생긴다.
+    if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        sysEnter(ringFd, sqLocalTail - sqSubmitted, 0, 0, NULL, 0);
+        sqSubmitted = sqLocalTail;
+    }
+    struct io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    ++sqLocalTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void IoUring::prepMultishotAccept(int fd, uint64_t userData) {
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepMultishotRecv(int fd, uint64_t userData) {
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepSendmsg(int fd, const struct msghdr* msg, uint64_t userData) {
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepCancel(uint64_t targetUserData, uint64_t userData) {
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = targetUserData;
+    sqe->user_data = userData;
+}
+
+int IoUring::submitAndWait(int timeoutMs) {
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqLocalTail - sqSubmitted;
+    sqSubmitted = sqLocalTail;
+
+    // 이미 받을 completion 이 있으면 기다리지 않고 제출만 한다.
+    bool ready = *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (ready && toSubmit == 0) {
+        return 0;
+    }
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int r = sysEnter(ringFd, toSubmit, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (r < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return -1;
+    }
+    return 0;
+}
+
+struct io_uring_cqe* IoUring::peekCqe() {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &cqes[head & cqMask];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool ioUringAvailable() {
+    errno = ENOSYS;
+    return false;
+}
+
+#endif
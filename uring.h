@@ -0,0 +1,101 @@
+﻿#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+// 이 커널에서 IoUring 을 쓸 수 있는지 시험해본다. (io_uring 이 없거나 seccomp 등으로 막혀 있으면 false)
+// 안 되는 이유는 errno 로 남긴다.
+bool ioUringAvailable();
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+// liburing 없이 syscall 로 직접 쓰는 io_uring.
+// submission/completion ring 과, recv 할 때 커널이 골라 쓰는 버퍼들의 ring(provided buffer ring) 하나를 가진다.
+// 요청들은 SQE 에 쌓아두었다가 submitAndWait() 에서 completion 을 기다리는 syscall 한 번으로 같이 제출한다.
+//
+// 한 쓰레드에서만 쓴다.
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    // ring 과 bufferCount 개의 bufferSize 바이트짜리 recv 버퍼를 만든다. bufferCount 는 2의 거듭제곱이어야 한다.
+    // 실패하면 false 이고 errno 를 남긴다.
+    bool init(unsigned entries, unsigned bufferCount, unsigned bufferSize);
+
+    // listener 에 연결이 들어올 때마다 completion 이 온다. res 는 새 소켓(non-blocking)이다.
+    void prepMultishotAccept(int fd, uint64_t userData);
+
+    // 바이트가 올 때마다 completion 이 온다. 데이터는 커널이 고른 buffer(bufferId)에 들어있다.
+    void prepMultishotRecv(int fd, uint64_t userData);
+
+    // msg 는 completion 이 올 때까지 유효해야 한다.
+    void prepSendmsg(int fd, const struct msghdr* msg, uint64_t userData);
+
+    // targetUserData 로 제출한 요청을 취소한다.
+    void prepCancel(uint64_t targetUserData, uint64_t userData);
+
+    // 쌓인 요청을 제출하고, 받을 completion 이 없으면 timeoutMs 동안(음수면 무한정) 기다린다.
+    // 시간이 다 된 것은 오류가 아니다. 오류면 -1.
+    int submitAndWait(int timeoutMs);
+
+    // 받은 completion 을 하나 꺼낸다. 없으면 NULL. 다 쓴 뒤에 cqeSeen() 을 불러야 다음 것이 나온다.
+    struct io_uring_cqe* peekCqe();
+    void cqeSeen();
+
+    // recv completion 의 flags 로 데이터가 든 buffer 를 찾는다. 다 쓴 buffer 는 recycleBuffer() 로 돌려준다.
+    static bool hasBuffer(uint32_t cqeFlags) { return (cqeFlags & IORING_CQE_F_BUFFER) != 0; }
+    static uint16_t bufferId(uint32_t cqeFlags) { return (uint16_t)(cqeFlags >> IORING_CQE_BUFFER_SHIFT); }
+    char* buffer(uint16_t bid) { return bufferMemory + (size_t)bid * bufferSize; }
+    void recycleBuffer(uint16_t bid);
+
+    // multishot 요청이 이 completion 뒤에도 살아있는지
+    static bool more(uint32_t cqeFlags) { return (cqeFlags & IORING_CQE_F_MORE) != 0; }
+
+private:
+    IoUring(const IoUring&);
+    IoUring& operator=(const IoUring&);
+
+    struct io_uring_sqe* getSqe();
+    void release();
+
+    int ringFd;
+
+    void* ringMemory;
+    size_t ringMemorySize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    // 커널과 같이 쓰는 값들은 포인터로 가리킨다.
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;  // 쌓았지만 아직 커널에 알리지 않은 끝
+    unsigned sqSubmitted;  // 커널에 알린 끝
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    struct io_uring_buf_ring* bufRing;
+    size_t bufRingSize;
+    unsigned bufMask;
+    uint16_t bufTail;
+    char* bufferMemory;
+    size_t bufferMemorySize;
+    unsigned bufferSize;
+};
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+﻿#include "user_store.h"
+
+#include <cstring>
+#include <ctime>
+
+#include "timer_wheel.h"
+
+using namespace std;
+
+// shardOf() 는 hash 의 위 6비트로 shard 를 고른다.
+static_assert(UserStore::NUM_SHARDS == 64, "shardOf() uses the top 6 bits of the hash");
+
+static const uint64_t SLOT_EMPTY = 0;
+static const uint64_t SLOT_TOMBSTONE = ~0ULL;
+
+static inline uint32_t slotTag(uint64_t h) {
+    return (uint32_t)(h >> 32);
+}
+
+UserStore::UserStore() : recordsPerShard(0) {
+}
+
+UserStore::~UserStore() {
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        delete[] shards[i].slots;
+        delete[] shards[i].records;
+    }
+}
+
+void UserStore::configure(size_t capacity) {
+    recordsPerShard = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+    if (recordsPerShard == 0) {
+        return;
+    }
+
+    // 살아있는 slot 과 tombstone 을 합쳐 3/4 를 넘지 않도록 record 수의 두 배 이상으로 잡는다.
+    size_t numSlots = 16;
+    while (numSlots < recordsPerShard * 2) {
+        numSlots *= 2;
+    }
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        Shard& shard = shards[i];
+        shard.slots = new atomic<uint64_t>[numSlots];
+        for (size_t s = 0; s < numSlots; ++s) {
+            shard.slots[s].store(SLOT_EMPTY, memory_order_relaxed);
+        }
+        shard.mask = numSlots - 1;
+        shard.records = new Record[recordsPerShard];
+        shard.freeRecords.reserve(recordsPerShard);
+        // 앞 번호부터 꺼내 쓰도록 거꾸로 넣는다.
+        for (size_t r = recordsPerShard; r > 0; --r) {
+            shard.records[r - 1].expireMs = 0;
+            shard.freeRecords.push_back((uint32_t)(r - 1));
+        }
+    }
+}
+
+uint64_t UserStore::nowMs() {
+#ifdef CLOCK_MONOTONIC_COARSE
+    // steady_clock 도 CLOCK_MONOTONIC 이므로 기준이 같다.
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#else
+    return timerNowMs();
+#endif
+}
+
+// FNV-1a 64비트에 splitmix64 의 마무리를 더해서 위쪽 비트(shard)와 아래쪽 비트(slot 위치)를 고르게 섞는다.
+uint64_t UserStore::hashName(string_view name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : name) {
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+void UserStore::beginWrite(Shard& shard) {
+    shard.seq.store(shard.seq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void UserStore::endWrite(Shard& shard) {
+    shard.seq.store(shard.seq.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+bool UserStore::get(string_view name, UserState& state) const {
+    if (!enabled() || name.empty() || name.size() > MAX_NAME_LEN) {
+        return false;
+    }
+    uint64_t h = hashName(name);
+    const Shard& shard = shardOf(h);
+    uint32_t tag = slotTag(h);
+    uint64_t now = nowMs();
+
+    while (true) {
+        uint32_t begin = shard.seq.load(memory_order_acquire);
+        if (begin & 1) {
+            continue;
+        }
+
+        // 쓰는 쪽과 겹쳤다면 여기서 읽은 값은 엉터리일 수 있지만, 아래에서 sequence 를 확인하고 버린다.
+        // slot 에는 항상 올바른 record 번호만 들어가고 이름 길이는 name.size() 와 같을 때만 비교하므로 범위를 넘지는 않는다.
+        bool found = false;
+        size_t pos = (size_t)h & shard.mask;
+        for (size_t probes = 0; probes <= shard.mask; ++probes) {
+            uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+            if (slot == SLOT_EMPTY) {
+                break;
+            }
+            if (slot != SLOT_TOMBSTONE && (uint32_t)(slot >> 32) == tag) {
+                const Record& r = shard.records[(uint32_t)slot - 1];
+                if (r.nameLen == name.size() && memcmp(r.name, name.data(), name.size()) == 0) {
+                    found = r.expireMs > now;
+                    if (found) {
+                        state = r.state;
+                    }
+                    break;
+                }
+            }
+            pos = (pos + 1) & shard.mask;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (shard.seq.load(memory_order_relaxed) == begin) {
+            return found;
+        }
+    }
+}
+
+UserStore::Record* UserStore::findOrInsert(Shard& shard, uint64_t h, string_view name, uint64_t now) {
+    uint32_t tag = slotTag(h);
+    size_t pos = (size_t)h & shard.mask;
+    for (size_t probes = 0; probes <= shard.mask; ++probes) {
+        uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+        if (slot == SLOT_EMPTY) {
+            break;
+        }
+        if (slot != SLOT_TOMBSTONE && (uint32_t)(slot >> 32) == tag) {
+            Record& r = shard.records[(uint32_t)slot - 1];
+            if (r.nameLen == name.size() && memcmp(r.name, name.data(), name.size()) == 0) {
+                // 만료된 세션이면 같은 record 로 새 세션을 시작한다.
+                if (r.expireMs <= now) {
+                    memset(&r.state, 0, sizeof(r.state));
+                    r.state.loginMs = now;
+                }
+                return &r;
+            }
+        }
+        pos = (pos + 1) & shard.mask;
+    }
+
+    // 없는 이름이다. record 가 모자라면 만료된 것들을 회수한다.
+    if (shard.freeRecords.empty()) {
+        reclaimExpired(shard, now);
+        if (shard.freeRecords.empty()) {
+            return NULL;
+        }
+    }
+    // tombstone 이 쌓여서 probe 가 길어지면 table 을 다시 짠다.
+    if ((shard.used + shard.tombstones + 1) * 4 > (shard.mask + 1) * 3) {
+        rehash(shard);
+    }
+
+    uint32_t index = shard.freeRecords.back();
+    shard.freeRecords.pop_back();
+    Record& r = shard.records[index];
+    memcpy(r.name, name.data(), name.size());
+    r.nameLen = (uint32_t)name.size();
+    memset(&r.state, 0, sizeof(r.state));
+    r.state.loginMs = now;
+    r.expireMs = now;  // update() 가 바로 TTL 을 잡는다.
+    placeSlot(shard, h, index);
+    shard.count.fetch_add(1, memory_order_relaxed);
+    return &r;
+}
+
+// 빈 slot 이나 tombstone 중 처음 만나는 곳에 넣는다. 같은 이름이 없다는 것은 호출자가 확인했다.
+void UserStore::placeSlot(Shard& shard, uint64_t h, uint32_t index) {
+    size_t pos = (size_t)h & shard.mask;
+    while (true) {
+        uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+        if (slot == SLOT_EMPTY || slot == SLOT_TOMBSTONE) {
+            if (slot == SLOT_TOMBSTONE) {
+                --shard.tombstones;
+            }
+            shard.slots[pos].store(((uint64_t)slotTag(h) << 32) | (index + 1), memory_order_relaxed);
+            ++shard.used;
+            return;
+        }
+        pos = (pos + 1) & shard.mask;
+    }
+}
+
+// shard 를 다 훑으므로 record 가 다 찼을 때만 부른다.
+void UserStore::reclaimExpired(Shard& shard, uint64_t now) {
+    for (size_t pos = 0; pos <= shard.mask; ++pos) {
+        uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+        if (slot == SLOT_EMPTY || slot == SLOT_TOMBSTONE) {
+            continue;
+        }
+        uint32_t index = (uint32_t)slot - 1;
+        if (shard.records[index].expireMs <= now) {
+            shard.records[index].expireMs = 0;
+            shard.freeRecords.push_back(index);
+            shard.slots[pos].store(SLOT_TOMBSTONE, memory_order_relaxed);
+            --shard.used;
+            ++shard.tombstones;
+            shard.count.fetch_sub(1, memory_order_relaxed);
+        }
+    }
+}
+
+// tombstone 을 없애고 살아있는 record 들을 다시 넣는다. record 번호는 그대로다.
+void UserStore::rehash(Shard& shard) {
+    thread_local vector<uint32_t> live;
+    live.clear();
+    for (size_t pos = 0; pos <= shard.mask; ++pos) {
+        uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+        if (slot != SLOT_EMPTY && slot != SLOT_TOMBSTONE) {
+            live.push_back((uint32_t)slot - 1);
+        }
+        shard.slots[pos].store(SLOT_EMPTY, memory_order_relaxed);
+    }
+    shard.used = 0;
+    shard.tombstones = 0;
+    for (uint32_t index : live) {
+        const Record& r = shard.records[index];
+        placeSlot(shard, hashName(string_view(r.name, r.nameLen)), index);
+    }
+}
+
+bool UserStore::remove(string_view name) {
+    if (!enabled() || name.empty() || name.size() > MAX_NAME_LEN) {
+        return false;
+    }
+    uint64_t h = hashName(name);
+    Shard& shard = shardOf(h);
+    uint32_t tag = slotTag(h);
+    lock_guard<mutex> guard(shard.writeLock);
+    size_t pos = (size_t)h & shard.mask;
+    for (size_t probes = 0; probes <= shard.mask; ++probes) {
+        uint64_t slot = shard.slots[pos].load(memory_order_relaxed);
+        if (slot == SLOT_EMPTY) {
+            return false;
+        }
+        if (slot != SLOT_TOMBSTONE && (uint32_t)(slot >> 32) == tag) {
+            uint32_t index = (uint32_t)slot - 1;
+            Record& r = shard.records[index];
+            if (r.nameLen == name.size() && memcmp(r.name, name.data(), name.size()) == 0) {
+                beginWrite(shard);
+                r.expireMs = 0;
+                shard.slots[pos].store(SLOT_TOMBSTONE, memory_order_relaxed);
+                endWrite(shard);
+                shard.freeRecords.push_back(index);
+                --shard.used;
+                ++shard.tombstones;
+                shard.count.fetch_sub(1, memory_order_relaxed);
+                return true;
+            }
+        }
+        pos = (pos + 1) & shard.mask;
+    }
+    return false;
+}
+
+size_t UserStore::size() const {
+    size_t total = 0;
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        total += shards[i].count.load(memory_order_relaxed);
+    }
+    return total;
+}
@@ -0,0 +1,126 @@
+﻿#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// 사용자 한 명의 상태. store 안에 그대로 복사해 두고 읽을 때도 복사하므로 trivially copyable 이어야 한다.
+struct UserState {
+    int64_t x;            // 마지막으로 move 한 위치
+    int64_t y;
+    uint64_t commands;    // 이번 세션에서 처리한 command 수
+    uint64_t loginMs;     // 세션이 시작된 시각 (UserStore::nowMs() 기준)
+    uint64_t lastSeenMs;  // 마지막 command 를 처리한 시각
+};
+
+// userName 으로 찾는 사용자 세션 저장소. 여러 worker 쓰레드가 같이 쓴다.
+//
+// 이름을 hash 해서 NUM_SHARDS 개의 shard 중 하나에 넣는다. shard 는 open addressing(linear probing) hash table 이고,
+// table 의 slot 에는 hash 일부와 record 번호만 들어있다. record(이름과 UserState)는 configure() 때 shard 마다
+// 한 덩어리로 잡아둔 arena 에서 꺼내 쓰고 지우면 free list 로 돌려놓으므로, 사용자가 들어오고 나갈 때 할당이 없다.
+//
+// 쓰기는 shard 의 mutex 로 막고, 읽기는 lock 없이 seqlock 으로 한다. 쓰는 쪽은 고치기 전후로 sequence 를 올리고
+// 읽는 쪽은 record 를 복사한 뒤 sequence 가 그대로인지 확인해서 바뀌었으면 다시 읽는다.
+// 읽기는 공유 메모리에 쓰지 않으므로 같은 사용자를 여러 쓰레드가 읽어도 cache line 이 오가지 않는다.
+//
+// record 마다 만료 시각이 있어서 TTL 이 지난 사용자는 없는 것으로 본다. 만료된 record 는 같은 이름이 다시 들어오거나
+// shard 의 record 가 모자랄 때 회수한다.
+class UserStore {
+public:
+    static const int NUM_SHARDS = 64;
+    static const size_t MAX_NAME_LEN = 64;
+
+    UserStore();
+    ~UserStore();
+
+    // 최대 사용자 수. 다른 쓰레드가 쓰기 전에 한 번만 부른다. 0 이면 아무것도 저장하지 않는다.
+    // shard 마다 capacity / NUM_SHARDS 씩 나누므로 이름이 한 shard 로 몰리면 그보다 조금 먼저 찰 수 있다.
+    void configure(size_t capacity);
+    bool enabled() const { return recordsPerShard > 0; }
+
+    // 살아있는 사용자가 있으면 state 에 복사하고 true. lock 을 잡지 않는다.
+    bool get(std::string_view name, UserState& state) const;
+
+    // 사용자를 찾아서 f(state) 를 부르고 만료 시각을 지금부터 ttlMs 뒤로 미룬다.
+    // 없거나 만료되었으면 0 으로 채운 새 세션을 만든다. (implicit login)
+    // f 는 shard 의 lock 안에서, 읽는 쪽을 기다리게 한 채로 불리므로 짧아야 한다.
+    // 이름이 비었거나 MAX_NAME_LEN 보다 길거나, 자리가 없으면 false.
+    template <class F>
+    bool update(std::string_view name, uint64_t ttlMs, F f) {
+        if (!enabled() || name.empty() || name.size() > MAX_NAME_LEN) {
+            return false;
+        }
+        uint64_t h = hashName(name);
+        Shard& shard = shardOf(h);
+        std::lock_guard<std::mutex> guard(shard.writeLock);
+        uint64_t now = nowMs();
+        beginWrite(shard);
+        Record* r = findOrInsert(shard, h, name, now);
+        if (r) {
+            f(r->state);
+            r->state.lastSeenMs = now;
+            r->expireMs = now + ttlMs;
+        }
+        endWrite(shard);
+        return r != NULL;
+    }
+
+    // 사용자를 지운다. 없었으면 false.
+    bool remove(std::string_view name);
+
+    // 저장된 사용자 수. 만료되었지만 아직 회수하지 않은 것도 센다.
+    size_t size() const;
+
+    // 만료 시각에 쓰는 시계. timerNowMs() 와 같은 시계를 몇 ms 정밀도로 싸게 읽는다. (Linux 의 CLOCK_MONOTONIC_COARSE)
+    // 읽기마다 부르므로 steady_clock 을 읽는 비용(수십 ns)이 lookup 전체와 맞먹는다.
+    static uint64_t nowMs();
+
+private:
+    UserStore(const UserStore&);
+    UserStore& operator=(const UserStore&);
+
+    struct Record {
+        uint64_t expireMs;  // 0 이면 free list 에 있는 record
+        uint32_t nameLen;
+        char name[MAX_NAME_LEN];
+        UserState state;
+    };
+
+    struct alignas(64) Shard {
+        Shard() : seq(0), slots(NULL), mask(0), records(NULL), count(0), used(0), tombstones(0) {}
+
+        // 읽는 쪽이 보는 것들. 쓰는 중에는 seq 가 홀수다.
+        std::atomic<uint32_t> seq;
+        std::atomic<uint64_t>* slots;  // 위 32비트는 hash 의 일부, 아래 32비트는 record 번호 + 1
+        size_t mask;                   // slot 수 - 1
+        Record* records;
+        std::atomic<size_t> count;     // size() 용
+
+        // 쓰는 쪽만 보는 것들. 읽는 쪽의 cache line 을 건드리지 않도록 떼어둔다.
+        alignas(64) std::mutex writeLock;
+        std::vector<uint32_t> freeRecords;
+        size_t used;        // record 를 가리키는 slot 수
+        size_t tombstones;  // 지워진 slot 수. probe 를 끊지 않도록 빈 slot 과 구분한다.
+    };
+
+    static uint64_t hashName(std::string_view name);
+    Shard& shardOf(uint64_t h) { return shards[h >> 58]; }
+    const Shard& shardOf(uint64_t h) const { return shards[h >> 58]; }
+
+    static void beginWrite(Shard& shard);
+    static void endWrite(Shard& shard);
+
+    Record* findOrInsert(Shard& shard, uint64_t h, std::string_view name, uint64_t now);
+    void reclaimExpired(Shard& shard, uint64_t now);
+    void rehash(Shard& shard);
+    static void placeSlot(Shard& shard, uint64_t h, uint32_t index);
+
+    size_t recordsPerShard;
+    Shard shards[NUM_SHARDS];
+};
+
+#endif